@@ -14,6 +14,7 @@
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
 #define ZSIM_MAGIC_OP_WORK_BEGIN        (1029) //ubik
 #define ZSIM_MAGIC_OP_WORK_END          (1030) //ubik
+#define ZSIM_MAGIC_OP_CHECKPOINT        (1034)
 
 #ifdef __x86_64__
 #define HOOKS_STR  "HOOKS"
@@ -46,4 +47,7 @@ static inline void zsim_heartbeat() {
 static inline void zsim_work_begin() { zsim_magic_op(ZSIM_MAGIC_OP_WORK_BEGIN); }
 static inline void zsim_work_end() { zsim_magic_op(ZSIM_MAGIC_OP_WORK_END); }
 
+//Saves memory-hierarchy state at the end of the current phase (needs sim.checkpoint.saveFile)
+static inline void zsim_checkpoint() { zsim_magic_op(ZSIM_MAGIC_OP_CHECKPOINT); }
+
 #endif /*__ZSIM_HOOKS_H__*/
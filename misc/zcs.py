@@ -0,0 +1,91 @@
+#!/usr/bin/python
+
+# Copyright (C) 2013-2015 by Massachusetts Institute of Technology
+#
+# This file is part of zsim.
+#
+# zsim is free software; you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, version 2.
+#
+# If you use this software in your research, we request that you reference
+# the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+# Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+# source of the simulator in any publications that use this software, and that
+# you send us a citation of your work.
+#
+# zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <http://www.gnu.org/licenses/>.
+
+# Reader for zsim's columnar stats files (sim.periodicStatsFormat = "columnar",
+# see src/columnar_stats.cpp for the format). The file is mmapped, and reading
+# a stat only touches that stat's column in each block.
+#
+# As a library:
+#   s = ZCSFile("zsim.zcs")
+#   s.names()                    # all stat names, e.g., "l2.l2-0.hGETS"
+#   s["procInstrs.0"]            # one stat over all samples (a numpy array if numpy is available)
+# From the command line:
+#   zcs.py zsim.zcs              # list stats
+#   zcs.py zsim.zcs name...      # print the time series of the given stats
+
+import mmap
+import struct
+import sys
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+class ZCSFile(object):
+    def __init__(self, filename):
+        self.f = open(filename, "rb")
+        self.mm = mmap.mmap(self.f.fileno(), 0, access=mmap.ACCESS_READ)
+        mm = self.mm
+        if mm[0:8] != b"ZSTATS01" or mm[-8:] != b"ZSTATEND":
+            raise ValueError("%s is not a zsim columnar stats file" % filename)
+        (numCols, schemaBytes) = struct.unpack_from("=QQ", mm, 8)
+        schema = mm[24:24 + schemaBytes].split(b"\0")[:numCols]
+        self.cols = [c.decode() for c in schema]
+        self.colIdx = dict((c, i) for (i, c) in enumerate(self.cols))
+
+        (footerOffset,) = struct.unpack_from("=Q", mm, len(mm) - 16)
+        (numBlocks,) = struct.unpack_from("=Q", mm, footerOffset)
+        idx = struct.unpack_from("=%dQ" % (2*numBlocks), mm, footerOffset + 8)
+        self.blocks = [(idx[2*i], idx[2*i + 1]) for i in range(numBlocks)]
+
+    def names(self):
+        return list(self.cols)
+
+    def samples(self):
+        return sum(n for (_, n) in self.blocks)
+
+    def __getitem__(self, name):
+        c = self.colIdx[name]
+        parts = []
+        for (offset, n) in self.blocks:
+            start = offset + 8*c*n
+            if np is not None:
+                parts.append(np.frombuffer(self.mm, dtype=np.uint64, count=n, offset=start))
+            else:
+                parts.extend(struct.unpack_from("=%dQ" % n, self.mm, start))
+        if np is not None:
+            return np.concatenate(parts) if parts else np.zeros(0, dtype=np.uint64)
+        return parts
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: %s <file.zcs> [stat names...]" % sys.argv[0])
+        sys.exit(1)
+    s = ZCSFile(sys.argv[1])
+    if len(sys.argv) == 2:
+        for c in s.names(): print(c)
+    else:
+        for c in sys.argv[2:]:
+            print("%s: %s" % (c, " ".join(str(v) for v in s[c])))
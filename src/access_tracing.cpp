@@ -24,13 +24,83 @@
  */
 
 #include "access_tracing.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 #include "bithacks.h"
 #include <hdf5.h>
 #include <hdf5_hl.h>
 
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
 
+/* Compressed format encoding: each block is a sequence of records, each
+ * encoded as four varints: the zigzagged deltas of lineAddr and reqCycle
+ * from the previous record in the block (0 for the first one), the latency,
+ * and childId << 2 | type. The block is then deflated. Deltas restart at
+ * every block, so blocks can be decoded independently.
+ */
+#define ZTRACE_MAX_REC_BYTES (10 + 10 + 5 + 5)  // worst-case encoded record size
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline const uint8_t* getVarint(const uint8_t* p, uint64_t& v) {
+    uint64_t res = 0;
+    uint32_t shift = 0;
+    while (*p & 0x80) {
+        res |= ((uint64_t)(*p++ & 0x7f)) << shift;
+        shift += 7;
+    }
+    res |= ((uint64_t)*p++) << shift;
+    v = res;
+    return p;
+}
+
+static inline uint64_t zigzag(int64_t v) {return (((uint64_t)v) << 1) ^ (uint64_t)(v >> 63);}
+static inline int64_t unzigzag(uint64_t v) {return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);}
+
+bool IsCompressedTraceName(const char* fname) {
+    size_t len = strlen(fname);
+    size_t sufLen = strlen(ZTRACE_SUFFIX);
+    return len >= sufLen && strcmp(fname + len - sufLen, ZTRACE_SUFFIX) == 0;
+}
+
 AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
+    buf = nullptr;
+    map = nullptr;
+    mapSize = 0;
+    blocks = nullptr;
+    numBlocks = 0;
+    curBlock = 0;
+    rawBuf = nullptr;
+
+    // Sniff the format; HDF5 files start with a different signature
+    char magic[sizeof(ZTRACE_MAGIC)];
+    FILE* f = fopen(fname.c_str(), "r");
+    if (!f) panic("Could not open trace file %s", fname.c_str());
+    compressed = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, ZTRACE_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+
+    if (compressed) openCompressed();
+    else openHDF5();
+}
+
+AccessTraceReader::~AccessTraceReader() {
+    if (buf) gm_free(buf);
+    if (rawBuf) gm_free(rawBuf);
+    if (map) munmap((void*)map, mapSize);
+}
+
+void AccessTraceReader::openHDF5() {
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
 
@@ -53,40 +123,159 @@ AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str())
     H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
     H5Aclose(ncAttr);
 
-    curFrameRecord = 0;
-    cur = 0;
-    max = MIN(PT_CHUNKSIZE, numRecords);
-    buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
+    H5PTclose(table);
+    H5Fclose(fid);
 
-    if (max) {
-        H5PTread_packets(table, 0, max, buf);
-    }
+    uint32_t bufSize = MIN(PT_CHUNKSIZE, numRecords);
+    buf = bufSize? gm_calloc<PackedAccessRecord>(bufSize) : nullptr;
+    readHDF5Chunk(0);
+}
 
+void AccessTraceReader::readHDF5Chunk(uint64_t first) {
+    curFrameRecord = first;
+    cur = 0;
+    max = MIN(PT_CHUNKSIZE, numRecords - first);
+    if (!max) return;
+
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+    hid_t table = H5PTopen(fid, "accs");
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+    H5PTread_packets(table, first, max, buf);
     H5PTclose(table);
     H5Fclose(fid);
 }
 
+void AccessTraceReader::openCompressed() {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) panic("Could not open trace file %s", fname.c_str());
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("Could not stat trace file %s", fname.c_str());
+    mapSize = st.st_size;
+    if (mapSize < sizeof(CompressedTraceHeader)) panic("Trace file %s is truncated", fname.c_str());
+    void* m = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) panic("Could not mmap trace file %s", fname.c_str());
+    close(fd);
+    map = (const uint8_t*) m;
+    madvise(m, mapSize, MADV_SEQUENTIAL);
+
+    const CompressedTraceHeader* hdr = (const CompressedTraceHeader*) map;
+    if (hdr->version != ZTRACE_VERSION) panic("Trace file %s has version %d, expected %d", fname.c_str(), hdr->version, ZTRACE_VERSION);
+    if (!hdr->finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+    numChildren = hdr->numChildren;
+    numRecords = hdr->numRecords;
+    numBlocks = hdr->numBlocks;
+    if (hdr->indexOffset + numBlocks*sizeof(CompressedTraceBlock) > mapSize) panic("Trace file %s has a corrupted index", fname.c_str());
+    blocks = (const CompressedTraceBlock*) (map + hdr->indexOffset);
+
+    uint32_t maxRaw = 0;
+    uint32_t maxRecs = 0;
+    for (uint64_t b = 0; b < numBlocks; b++) {
+        if (blocks[b].offset + blocks[b].compressedSize > hdr->indexOffset) panic("Trace file %s has a corrupted block %ld", fname.c_str(), b);
+        maxRaw = MAX(maxRaw, blocks[b].rawSize);
+        maxRecs = MAX(maxRecs, blocks[b].numRecords);
+    }
+    buf = maxRecs? gm_calloc<PackedAccessRecord>(maxRecs) : nullptr;
+    rawBuf = maxRaw? gm_calloc<uint8_t>(maxRaw) : nullptr;
+
+    cur = max = 0;
+    curFrameRecord = 0;
+    curBlock = 0;
+    if (numBlocks) readCompressedBlock(0);
+}
+
+void AccessTraceReader::readCompressedBlock(uint64_t block) {
+    assert(block < numBlocks);
+    const CompressedTraceBlock& b = blocks[block];
+    uLongf rawSize = b.rawSize;
+    int res = uncompress(rawBuf, &rawSize, map + b.offset, b.compressedSize);
+    if (res != Z_OK || rawSize != b.rawSize) panic("Trace file %s: could not decompress block %ld (%d)", fname.c_str(), block, res);
+
+    const uint8_t* p = rawBuf;
+    uint64_t lineAddr = 0;
+    uint64_t reqCycle = 0;
+    for (uint32_t i = 0; i < b.numRecords; i++) {
+        uint64_t dAddr, dCycle, lat, idType;
+        p = getVarint(p, dAddr);
+        p = getVarint(p, dCycle);
+        p = getVarint(p, lat);
+        p = getVarint(p, idType);
+        lineAddr += unzigzag(dAddr);
+        reqCycle += unzigzag(dCycle);
+        buf[i] = {lineAddr, reqCycle, (uint32_t)lat, (uint16_t)(idType >> 2), (uint16_t)(idType & 3)};
+    }
+    assert(p == rawBuf + rawSize);
+
+    curBlock = block;
+    curFrameRecord = b.firstRecord;
+    cur = 0;
+    max = b.numRecords;
+}
+
 void AccessTraceReader::nextChunk() {
     assert(cur == max);
-    curFrameRecord += max;
-
-    if (curFrameRecord < numRecords) {
-        cur = 0;
-        max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
-        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
-        hid_t table = H5PTopen(fid, "accs");
-        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-        H5PTread_packets(table, curFrameRecord, max, buf);
-        H5PTclose(table);
-        H5Fclose(fid);
+    if (compressed) {
+        if (curBlock + 1 < numBlocks) readCompressedBlock(curBlock + 1);
+        else assert_msg(curFrameRecord + max == numRecords, "%ld %ld", curFrameRecord + max, numRecords);
+        return;
+    }
+
+    if (curFrameRecord + max < numRecords) {
+        readHDF5Chunk(curFrameRecord + max);
     } else {
+        curFrameRecord += max;
         assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);  // aaand we're done
     }
 }
 
+void AccessTraceReader::seek(uint64_t record) {
+    assert_msg(record <= numRecords, "%ld %ld", record, numRecords);
+    if (record == numRecords) {
+        // Past the end
+        curFrameRecord = numRecords;
+        cur = max = 0;
+        curBlock = numBlocks;
+        return;
+    }
+
+    if (compressed) {
+        // Binary search for the last block that starts at or before record
+        uint64_t lo = 0, hi = numBlocks;
+        while (hi - lo > 1) {
+            uint64_t mid = (lo + hi)/2;
+            if (blocks[mid].firstRecord <= record) lo = mid;
+            else hi = mid;
+        }
+        if (lo != curBlock || max == 0) readCompressedBlock(lo);
+        cur = record - curFrameRecord;
+    } else {
+        if (record < curFrameRecord || record >= curFrameRecord + max) readHDF5Chunk(record);
+        cur = record - curFrameRecord;
+    }
+    assert(cur < max);
+}
+
+
+AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t _numChildren) : fname(_fname) {
+    compressed = IsCompressedTraceName(fname.c_str());
+    numChildren = _numChildren;
+    numRecords = 0;
+    fileSize = 0;
+    rawBuf = nullptr;
+    zBuf = nullptr;
+    zBufSize = 0;
+
+    if (compressed) initCompressed();
+    else initHDF5();
 
-AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
+    // Initialize buffer
+    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+    cur = 0;
+    max = PT_CHUNKSIZE;
+    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
+}
+
+void AccessTraceWriter::initHDF5() {
     // Create record structure
     hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
     uint16_t val;
@@ -143,15 +332,43 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     H5Aclose(fAttr);
 
     H5Fclose(fid);
+}
 
-    // Initialize buffer
-    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
-    cur = 0;
-    max = PT_CHUNKSIZE;
-    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
+void AccessTraceWriter::initCompressed() {
+    // Blocks are written as they fill up; the file is reopened on every dump
+    // because dumps may come from different processes
+    CompressedTraceHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, ZTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = ZTRACE_VERSION;
+    hdr.numChildren = numChildren;
+    hdr.finished = 0;
+    hdr.blockRecords = PT_CHUNKSIZE;
+
+    FILE* f = fopen(fname.c_str(), "w");
+    if (!f) panic("Could not create trace file %s", fname.c_str());
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+    fclose(f);
+    fileSize = sizeof(hdr);
+
+    rawBuf = gm_calloc<uint8_t>(PT_CHUNKSIZE*ZTRACE_MAX_REC_BYTES);
+    zBufSize = compressBound(PT_CHUNKSIZE*ZTRACE_MAX_REC_BYTES);
+    zBuf = gm_calloc<uint8_t>(zBufSize);
 }
 
 void AccessTraceWriter::dump(bool cont) {
+    if (compressed) dumpCompressed(cont);
+    else dumpHDF5(cont);
+
+    if (!cont) {
+        gm_free(buf);
+        buf = nullptr;
+        max = 0;
+    }
+    cur = 0;
+}
+
+void AccessTraceWriter::dumpHDF5(bool cont) {
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
     hid_t table = H5PTopen(fid, "accs");
@@ -164,13 +381,67 @@ void AccessTraceWriter::dump(bool cont) {
         uint32_t finished = 1;
         H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
         H5Aclose(fAttr);
-
-        gm_free(buf);
-        buf = nullptr;
-        max = 0;
     }
 
-    cur = 0;
     H5PTclose(table);
     H5Fclose(fid);
 }
+
+void AccessTraceWriter::dumpCompressed(bool cont) {
+    FILE* f = fopen(fname.c_str(), "r+");
+    if (!f) panic("Could not open trace file %s", fname.c_str());
+
+    if (cur) {
+        uint8_t* p = rawBuf;
+        uint64_t lineAddr = 0;
+        uint64_t reqCycle = 0;
+        for (uint32_t i = 0; i < cur; i++) {
+            const PackedAccessRecord& pr = buf[i];
+            assert(pr.type < 4);
+            p = putVarint(p, zigzag(pr.lineAddr - lineAddr));
+            p = putVarint(p, zigzag(pr.reqCycle - reqCycle));
+            p = putVarint(p, pr.latency);
+            p = putVarint(p, (((uint64_t)pr.childId) << 2) | pr.type);
+            lineAddr = pr.lineAddr;
+            reqCycle = pr.reqCycle;
+        }
+        uint32_t rawSize = p - rawBuf;
+
+        uLongf zSize = zBufSize;
+        int res = compress2(zBuf, &zSize, rawBuf, rawSize, Z_BEST_SPEED);
+        if (res != Z_OK) panic("Trace file %s: could not compress block (%d)", fname.c_str(), res);
+
+        CompressedTraceBlock b = {fileSize, numRecords, (uint32_t)zSize, rawSize, cur, 0};
+        fseek(f, fileSize, SEEK_SET);
+        if (fwrite(zBuf, 1, zSize, f) != zSize) panic("Could not write trace file %s", fname.c_str());
+        blocks.push_back(b);
+        fileSize += zSize;
+        numRecords += cur;
+    }
+
+    if (!cont) {
+        // Append the index and mark the trace finished
+        fseek(f, fileSize, SEEK_SET);
+        if (blocks.size() && fwrite(&blocks[0], sizeof(CompressedTraceBlock), blocks.size(), f) != blocks.size()) {
+            panic("Could not write trace file %s", fname.c_str());
+        }
+
+        CompressedTraceHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, ZTRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = ZTRACE_VERSION;
+        hdr.numChildren = numChildren;
+        hdr.finished = 1;
+        hdr.blockRecords = PT_CHUNKSIZE;
+        hdr.numRecords = numRecords;
+        hdr.numBlocks = blocks.size();
+        hdr.indexOffset = fileSize;
+        fseek(f, 0, SEEK_SET);
+        if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+
+        gm_free(rawBuf);
+        gm_free(zBuf);
+        rawBuf = zBuf = nullptr;
+    }
+    fclose(f);
+}
@@ -27,9 +27,16 @@
 #define ACCESS_TRACING_H_
 
 #include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 
-/* HDF5-based classes read and write address traces in a consistent format */
+/* These classes read and write address traces in one of two formats:
+ *  - HDF5: a packet table of PackedAccessRecords, shuffled and deflated.
+ *  - Compressed (files ending in .ztrace): independently compressed blocks of
+ *    delta/varint-encoded records, plus a block index for seeking. It's much
+ *    smaller and faster to read (the reader mmaps the file).
+ * Readers detect the format from the file contents, writers from the name.
+ */
 
 struct AccessRecord {
     Address lineAddr;
@@ -47,6 +54,33 @@ struct PackedAccessRecord {
     uint16_t type;  // could be uint8_t, but causes corruption in HDF5? (wtf...)
 } /*__attribute__((packed))*/;  // 24 bytes --> no packing needed
 
+#define ZTRACE_SUFFIX ".ztrace"
+#define ZTRACE_MAGIC "ZSIMTRC"
+#define ZTRACE_VERSION 1
+
+struct CompressedTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numChildren;
+    uint32_t finished;
+    uint32_t blockRecords;  // max records per block
+    uint64_t numRecords;
+    uint64_t numBlocks;
+    uint64_t indexOffset;  // the block index (numBlocks CompressedTraceBlocks) is at the end of the file
+};
+
+struct CompressedTraceBlock {
+    uint64_t offset;  // in the file
+    uint64_t firstRecord;
+    uint32_t compressedSize;
+    uint32_t rawSize;  // encoded, uncompressed
+    uint32_t numRecords;
+    uint32_t pad;
+};
+
+// True if fname should be written in the compressed format
+bool IsCompressedTraceName(const char* fname);
+
 
 class AccessTraceReader {
     private:
@@ -59,12 +93,26 @@ class AccessTraceReader {
         uint64_t numRecords;
         uint32_t numChildren; //i.e., how many parallel streams does this file contain?
 
+        // Compressed format only
+        bool compressed;
+        const uint8_t* map;  // whole file
+        uint64_t mapSize;
+        const CompressedTraceBlock* blocks;  // index, in the map
+        uint64_t numBlocks;
+        uint64_t curBlock;
+        uint8_t* rawBuf;  // one uncompressed block
+
     public:
         AccessTraceReader(std::string fname);
+        ~AccessTraceReader();
 
         inline bool empty() const {return (cur == max);}
         uint32_t getNumChildren() const {return numChildren;}
         uint64_t getNumRecords() const {return numRecords;}
+        bool isCompressed() const {return compressed;}
+
+        // Repositions the reader so that the next read() returns the given record
+        void seek(uint64_t record);
 
         inline AccessRecord read() {
             assert(cur < max);
@@ -76,6 +124,10 @@ class AccessTraceReader {
 
     private:
         void nextChunk();
+        void openHDF5();
+        void openCompressed();
+        void readHDF5Chunk(uint64_t first);
+        void readCompressedBlock(uint64_t block);
 };
 
 class AccessTraceWriter : public GlobAlloc {
@@ -85,6 +137,16 @@ class AccessTraceWriter : public GlobAlloc {
         uint32_t max;
         g_string fname;
 
+        // Compressed format only
+        bool compressed;
+        uint32_t numChildren;
+        uint64_t numRecords;
+        uint64_t fileSize;
+        g_vector<CompressedTraceBlock> blocks;
+        uint8_t* rawBuf;
+        uint8_t* zBuf;
+        uint64_t zBufSize;
+
     public:
         AccessTraceWriter(g_string fname, uint32_t numChildren);
 
@@ -97,6 +159,12 @@ class AccessTraceWriter : public GlobAlloc {
         }
 
         void dump(bool cont);
+
+    private:
+        void initHDF5();
+        void initCompressed();
+        void dumpHDF5(bool cont);
+        void dumpCompressed(bool cont);
 };
 
 #endif  // _ACCESS_TRACING_H
@@ -0,0 +1,213 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures cache array throughput without running zsim:
+ * - SetAssocArray lookups (H3-hashed, as configured by default) across
+ *   associativities, with a configurable hit rate.
+ * - ZArray replacements (preinsert+postinsert, i.e., full candidate walks)
+ *   across ways/candidates and hash families.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "cache_arrays.h"
+#include "galloc.h"
+#include "hash.h"
+#include "log.h"
+#include "mtrand.h"
+#include "repl_policies.h"
+#include "zsim.h"
+
+using namespace std;
+
+//cache_arrays.cpp links in checkpointing code, which references zinfo; we never checkpoint
+GlobSimInfo* zinfo = nullptr;
+
+static uint64_t getNs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000000ul + tv.tv_usec*1000ul;
+}
+
+//Random replacement that, unlike RandReplPolicy, handles walks cut short by invalid lines, and is deterministic
+class BenchReplPolicy : public ReplPolicy {
+    private:
+        MTRand rnd;
+
+    public:
+        BenchReplPolicy() : rnd(0xBE4C8) {}
+
+        void update(uint32_t id, const MemReq* req) {}
+        void replaced(uint32_t id) {}
+
+        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
+            //Reservoir sampling, as we don't know the number of cands upfront
+            uint32_t n = 0;
+            uint32_t bestCand = -1;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                if (rnd.randInt() % (++n) == 0) bestCand = *ci;
+            }
+            return bestCand;
+        }
+
+        DECL_RANK_BINDINGS;
+};
+
+static Address randLine(MTRand& rnd) {
+    return (rnd.randInt() << 20) ^ rnd.randInt();  // never 0 in practice; ZArray panics on 0
+}
+
+static void benchSetAssoc(uint32_t numLines, uint32_t hitPct, uint64_t numLookups) {
+    uint32_t assocs[] = {4, 8, 12, 16, 20, 32};
+    for (uint32_t assoc : assocs) {
+        //Round down to a power-of-2 number of sets, as SetAssocArray requires
+        uint32_t numSets = 1 << ilog2(numLines/assoc);
+        uint32_t lines = numSets*assoc;
+
+        HashFamily* hf = new H3HashFamily(1, ilog2(numSets), 0xCAC7EAFFA1);
+        SetAssocArray* array = new SetAssocArray(lines, assoc, new BenchReplPolicy(), hf);
+
+        //Fill the array; inserted lines may be evicted by later inserts, so re-check them
+        MTRand rnd(assoc);
+        vector<Address> inserted;
+        for (uint32_t i = 0; i < 2*lines; i++) {
+            Address lineAddr = randLine(rnd);
+            if (array->lookup(lineAddr, nullptr, false) != -1) continue;
+            Address wbLineAddr;
+            uint32_t id = array->preinsert(lineAddr, nullptr, &wbLineAddr);
+            array->postinsert(lineAddr, nullptr, id);
+            inserted.push_back(lineAddr);
+        }
+        vector<Address> resident;
+        for (Address lineAddr : inserted) {
+            if (array->lookup(lineAddr, nullptr, false) != -1) resident.push_back(lineAddr);
+        }
+
+        //Fills used 52-bit addresses, so misses come from a disjoint range
+        vector<Address> stream(numLookups);
+        uint64_t expectedHits = 0;
+        for (Address& lineAddr : stream) {
+            if (!resident.empty() && rnd.randInt() % 100 < hitPct) {
+                lineAddr = resident[rnd.randInt() % resident.size()];
+                expectedHits++;
+            } else {
+                lineAddr = (1ul << 60) | randLine(rnd);
+            }
+        }
+
+        uint64_t startNs = getNs();
+        uint64_t hits = 0;
+        for (Address lineAddr : stream) {
+            hits += (array->lookup(lineAddr, nullptr, false) != -1);
+        }
+        uint64_t ns = MAX(getNs() - startNs, 1ul);
+        if (hits != expectedHits) panic("%d ways: %ld hits, expected %ld", assoc, hits, expectedHits);
+
+        info("%2d ways, %6d sets: %.2f Mlookups/s (%.2f ns/lookup, %.1f%% hits)", assoc, numSets,
+                numLookups*1e3/ns, ((double)ns)/numLookups, hits*100.0/numLookups);
+    }
+}
+
+static void benchZWalks(uint32_t numLines, uint64_t numWalks) {
+    struct ZConfig { uint32_t ways, cands; };
+    ZConfig zconfigs[] = {{4, 16}, {4, 52}, {8, 64}};
+    const char* hashTypes[] = {"H3", "H3Table"};  // must produce the same walks
+    for (ZConfig zc : zconfigs) {
+        uint64_t evictionsHash[2];
+        uint32_t numSets = 1 << ilog2(numLines/zc.ways);
+        uint32_t lines = numSets*zc.ways;
+
+        //Table-driven H3 must match plain H3 exactly, since configs can switch between them
+        H3HashFamily h3(zc.ways, ilog2(numSets), 0xCAC7EAFFA1);
+        H3TableHashFamily h3t(zc.ways, ilog2(numSets), 0xCAC7EAFFA1);
+        MTRand checkRnd(zc.cands);
+        uint64_t hashes[zc.ways];
+        for (uint32_t i = 0; i < 10000; i++) {
+            Address lineAddr = randLine(checkRnd);
+            h3t.hashAll(lineAddr, zc.ways, hashes);
+            for (uint32_t w = 0; w < zc.ways; w++) {
+                uint64_t h = h3.hash(w, lineAddr);
+                if (h != hashes[w] || h != h3t.hash(w, lineAddr)) panic("H3Table mismatch on 0x%lx way %d", lineAddr, w);
+            }
+        }
+
+        for (uint32_t h = 0; h < 2; h++) {
+            const char* hashType = hashTypes[h];
+            HashFamily* hf = (h == 0)? (HashFamily*) new H3HashFamily(zc.ways, ilog2(numSets), 0xCAC7EAFFA1) :
+                                                         (HashFamily*) new H3TableHashFamily(zc.ways, ilog2(numSets), 0xCAC7EAFFA1);
+            ZArray* array = new ZArray(lines, zc.ways, zc.cands, new BenchReplPolicy(), hf);
+
+            //Warm up until the array is full, so walks expand all candidates
+            MTRand rnd(zc.ways*zc.cands);
+            Address wbLineAddr;
+            for (uint32_t i = 0; i < 2*lines; i++) {
+                Address lineAddr = randLine(rnd);
+                if (array->lookup(lineAddr, nullptr, false) != -1) continue;
+                uint32_t id = array->preinsert(lineAddr, nullptr, &wbLineAddr);
+                array->postinsert(lineAddr, nullptr, id);
+            }
+
+            vector<Address> stream(numWalks);
+            for (Address& lineAddr : stream) lineAddr = (1ul << 60) | randLine(rnd);  // disjoint from fills, always misses
+
+            uint64_t startNs = getNs();
+            uint64_t evictions = 0;
+            for (Address lineAddr : stream) {
+                uint32_t id = array->preinsert(lineAddr, nullptr, &wbLineAddr);
+                array->postinsert(lineAddr, nullptr, id);
+                evictions = (evictions*31) ^ wbLineAddr;  // keeps the compiler honest, and checks both hashes evict the same lines
+            }
+            uint64_t ns = MAX(getNs() - startNs, 1ul);
+            evictionsHash[h] = evictions;
+
+            info("Z %d ways/%2d cands, %7s: %.2f Mwalks/s (%.2f ns/walk)", zc.ways, zc.cands, hashType,
+                    numWalks*1e3/ns, ((double)ns)/numWalks);
+        }
+        if (evictionsHash[0] != evictionsHash[1]) panic("H3 and H3Table walks evicted different lines");
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc > 4) {
+        info("Reports SetAssocArray lookups/s across associativities, and ZArray walks/s across hash functions");
+        info("Usage: %s [lines (32768)] [hit %% (50)] [lookups (10M), walks are 1/10th]", argv[0]);
+        exit(1);
+    }
+    uint32_t numLines = (argc > 1)? atoi(argv[1]) : 32768;
+    uint32_t hitPct = (argc > 2)? atoi(argv[2]) : 50;
+    uint64_t numLookups = (argc > 3)? atol(argv[3]) : 10*1000*1000;
+    if (hitPct > 100) panic("Hit percentage must be <= 100");
+    if (numLines < 64) panic("Need at least 64 lines");
+
+    gm_init((1<<20) + 128*numLines /*tags + repl state + lookup arrays of all arrays, with plenty of slack*/);
+
+    benchSetAssoc(numLines, hitPct, numLookups);
+    benchZWalks(numLines, numLookups/10);
+    return 0;
+}
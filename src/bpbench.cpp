@@ -0,0 +1,182 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures branch predictor cost and accuracy without running zsim. It
+ * replays a synthetic branch stream with a mix of biased, loop, correlated
+ * and random branches, spread over functions with a skewed call frequency,
+ * through the PAg predictor OOOCore uses by default and several TAGE-SC-L
+ * configurations, and reports ns/branch and mispredictions/Kbranch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "bithacks.h"
+#include "branch_pred.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+
+using namespace std;
+
+static uint64_t getNs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000000ul + tv.tv_usec*1000ul;
+}
+
+enum BranchKind {BIASED, CORRELATED, RANDOM};
+
+struct StaticBranch {
+    Address pc;
+    BranchKind kind;
+    uint32_t bias;  // BIASED: taken if rnd % 1000 < bias
+    uint32_t corrA, corrB;  // CORRELATED: XOR of the outcomes these many branches ago
+};
+
+struct Function {
+    vector<StaticBranch> body;
+    Address loopPc;  // 0 if the body is not a loop
+    uint32_t minTrips, maxTrips;
+};
+
+// Each trace element is the branch PC with the outcome in bit 0 (PCs are 4B-aligned)
+static vector<Address> genTrace(uint32_t numStatic, uint64_t numBranches) {
+    MTRand rnd(0xB7A4C4);
+    vector<Function> funcs;
+    uint32_t made = 0;
+    Address nextPc = 0x400000;
+    while (made < numStatic) {
+        Function f;
+        uint32_t len = 2 + rnd.randInt(14);
+        for (uint32_t i = 0; i < len; i++) {
+            StaticBranch b;
+            nextPc += 4*(1 + rnd.randInt(15));
+            b.pc = nextPc;
+            uint32_t r = rnd.randInt(99);
+            b.kind = (r < 70)? BIASED : ((r < 95)? CORRELATED : RANDOM);
+            uint32_t skew = 900 + rnd.randInt(99);
+            b.bias = rnd.randInt(1)? skew : 1000 - skew;
+            b.corrA = 1 + rnd.randInt(7);
+            b.corrB = 1 + rnd.randInt(23);
+            f.body.push_back(b);
+        }
+        made += len;
+        if (rnd.randInt(1)) {
+            nextPc += 4;
+            f.loopPc = nextPc;
+            f.minTrips = 2 + rnd.randInt(30);
+            f.maxTrips = f.minTrips + (rnd.randInt(3) == 0? rnd.randInt(3) : 0);  // most loops have fixed trip counts
+            made++;
+        } else {
+            f.loopPc = 0;
+            f.minTrips = f.maxTrips = 1;
+        }
+        funcs.push_back(f);
+        nextPc += 4096;
+    }
+
+    vector<Address> trace;
+    trace.reserve(numBranches + 64);
+    uint64_t hist = 0;
+    while (trace.size() < numBranches) {
+        double r = rnd.randExc();
+        const Function& f = funcs[(uint32_t)(r*r*r*funcs.size())];  // skewed: a few hot functions
+        uint32_t trips = f.minTrips + rnd.randInt(f.maxTrips - f.minTrips);
+        for (uint32_t t = 0; t < trips; t++) {
+            for (const StaticBranch& b : f.body) {
+                bool taken;
+                switch (b.kind) {
+                    case BIASED: taken = rnd.randInt(999) < b.bias; break;
+                    case CORRELATED: taken = ((hist >> (b.corrA - 1)) ^ (hist >> (b.corrB - 1))) & 1; break;
+                    default: taken = rnd.randInt(1);
+                }
+                trace.push_back(b.pc | taken);
+                hist = (hist << 1) | taken;
+            }
+            if (f.loopPc) {
+                bool taken = t + 1 < trips;
+                trace.push_back(f.loopPc | taken);
+                hist = (hist << 1) | taken;
+            }
+        }
+    }
+    trace.resize(numBranches);
+    return trace;
+}
+
+static void bench(const char* name, BranchPredictor* bp, const vector<Address>& trace) {
+    AggregateStat* rootStat = new AggregateStat();
+    rootStat->init("root", "Stats");
+    bp->initStats(rootStat);
+
+    //Train on the first pass, so we measure the steady state
+    for (Address a : trace) bp->predict(a & ~1ul, a & 1);
+
+    //Report the fastest pass, as other load on the host only ever adds time
+    uint64_t ns = -1ul;
+    uint64_t mispreds = 0;
+    for (uint32_t pass = 0; pass < 5; pass++) {
+        uint64_t startNs = getNs();
+        mispreds = 0;
+        for (Address a : trace) mispreds += !bp->predict(a & ~1ul, a & 1);
+        ns = MIN(ns, MAX(getNs() - startNs, 1ul));
+    }
+
+    info("%-32s %6.2f ns/branch, %6.2f mispreds/Kbranch", name, ((double)ns)/trace.size(), mispreds*1000.0/trace.size());
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc > 3) {
+        info("Reports branch predictor ns/branch and accuracy on a synthetic branch stream");
+        info("Usage: %s [branches (4M)] [static branches (8192)]", argv[0]);
+        exit(1);
+    }
+    uint64_t numBranches = (argc > 1)? atol(argv[1]) : 4*1000*1000;
+    uint32_t numStatic = (argc > 2)? atoi(argv[2]) : 8192;
+
+    gm_init(64<<20);
+    vector<Address> trace = genTrace(numStatic, numBranches);
+
+    bench("PAg (11, 18, 14)", new BranchPredictorPAg<11, 18, 14>(), trace);
+
+    struct TAGEConfig { uint32_t tables, logEntries, minHist, maxHist; bool loop, sc; };
+    TAGEConfig configs[] = {
+        {7, 10, 4, 200, true, true},  // the default
+        {7, 10, 4, 200, false, false},
+        {12, 10, 4, 640, true, true},
+        {4, 10, 4, 64, true, true},
+    };
+    for (TAGEConfig& c : configs) {
+        char name[128];
+        snprintf(name, sizeof(name), "TAGE %2d x 2^%d, hist %d-%d%s%s", c.tables, c.logEntries, c.minHist, c.maxHist,
+                c.loop? " L" : "", c.sc? " SC" : "");
+        bench(name, new TAGEPredictor(c.tables, c.logEntries, c.minHist, c.maxHist, c.loop, c.sc), trace);
+    }
+    return 0;
+}
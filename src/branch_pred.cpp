@@ -0,0 +1,369 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "branch_pred.h"
+#include <immintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bithacks.h"
+#include "log.h"
+
+// Saturating increment/decrement towards the outcome. Branch-free, as outcomes are often unpredictable to the host.
+template <typename T> static inline void satUpdate(T& ctr, bool up, int32_t minVal, int32_t maxVal) {
+    ctr += (int32_t)(up & (ctr < maxVal)) - (int32_t)(!up & (ctr > minVal));
+}
+
+static const uint32_t scHistLens[] = {5, 9, 15, 24};  // SC GEHL tables; bias table has no history
+static const uint16_t LOOP_VALID = 0x8000;  // set on loop tags, so empty entries never match
+static const uint8_t LOOP_CONF_MAX = 15;  // predict exits after this many identical trip counts
+static const uint8_t LOOP_AGE_MAX = 7;
+
+TAGEPredictor::TAGEPredictor(uint32_t _numTables, uint32_t _logEntries, uint32_t minHist, uint32_t maxHist, bool _useLoop, bool _useSC)
+    : numTables(_numTables), numLanes((_numTables + LANE_BLOCK - 1) & ~(LANE_BLOCK - 1)), logEntries(_logEntries), useLoop(_useLoop), useSC(_useSC)
+{
+    static_assert(sizeof(TaggedEntry) == 4, "TAGE entries should be 4 bytes");
+    static_assert(sizeof(scHistLens)/sizeof(scHistLens[0]) == SC_TABLES, "SC history lengths mismatch");
+    if (numTables < 2 || numTables > 32) panic("TAGE needs 2-32 tagged tables, %d given", numTables);
+    if (logEntries < 6 || logEntries > 16) panic("TAGE tables need 2^6-2^16 entries, 2^%d given", logEntries);
+    if (minHist < 1 || maxHist <= minHist) panic("TAGE needs 1 <= minHist < maxHist (%d, %d given)", minHist, maxHist);
+
+    bimodal = gm_calloc<int8_t>(1 << BIMODAL_BITS);
+    for (uint32_t i = 0; i < (1u << BIMODAL_BITS); i++) bimodal[i] = 1;  // weak not-taken
+    tables = gm_calloc<TaggedEntry>(numTables << logEntries);
+
+    // Geometric history lengths. Padding lanes have zero-length histories, so their folds stay 0.
+    for (uint32_t i = 0; i < MAX_TABLES; i++) {
+        idxFolds[i] = tagFolds[i] = idxOutBits[i] = tagOutBits[i] = pathMasks[i] = tags[i] = probedTags[i] = 0;
+        histLens[i] = tableBases[i] = entries[i] = 0;
+    }
+    for (uint32_t i = 0; i < numTables; i++) {
+        uint32_t len = (uint32_t)(minHist*pow(((double)maxHist)/minHist, ((double)i)/(numTables - 1)) + 0.5);
+        histLens[i] = (i && len <= histLens[i-1])? histLens[i-1] + 1 : len;
+        idxOutBits[i] = 1 << (histLens[i] % logEntries);
+        tagOutBits[i] = 1 << (histLens[i] % TAG_BITS);
+        pathMasks[i] = (1 << MIN(histLens[i], 16u)) - 1;
+        tableBases[i] = i << logEntries;
+    }
+
+    // Extra space amortizes copying the live window back to the end of the buffer
+    ghistLen = histLens[numTables-1] + 1 + 4096;
+    ghist = gm_calloc<uint16_t>(ghistLen);
+    ghistPtr = ghistLen - histLens[numTables-1] - 1;
+    pathHist = 0;
+    useAltOnNA = 0;
+    branches = 0;
+    rnd = 0x7A6E5C1;
+
+    loops = gm_calloc<LoopEntry>(1 << LOOP_BITS);
+    loopUseCtr = 0;
+
+    scBias = gm_calloc<int8_t>(1 << SC_BITS);
+    scTables = gm_calloc<int8_t>(SC_TABLES << SC_BITS);
+    shortHist = 0;
+    scThreshold = 35;
+    scThresholdCtr = 0;
+}
+
+void TAGEPredictor::initStats(AggregateStat* parentStat) {
+    AggregateStat* bpStat = new AggregateStat();
+    bpStat->init("bp", "TAGE-SC-L branch predictor stats");
+    static const char* componentNames[] = {"bimodal", "tagged", "alt", "loop", "sc"};
+    profPreds.init("preds", "Predictions by providing component", NUM_COMPONENTS, componentNames);
+    bpStat->append(&profPreds);
+    profMispreds.init("mispreds", "Mispredictions by providing component", NUM_COMPONENTS, componentNames);
+    bpStat->append(&profMispreds);
+    parentStat->append(bpStat);
+}
+
+bool TAGEPredictor::predict(Address branchPc, bool taken) {
+    return access<true>(branchPc, taken);
+}
+
+void TAGEPredictor::warm(Address branchPc, bool taken) {
+    access<false>(branchPc, taken);
+}
+
+template <bool recordStats>
+bool TAGEPredictor::access(Address branchPc, bool taken) {
+    uint32_t pc = (uint32_t)(branchPc ^ (branchPc >> 32));
+    uint32_t mask = (1 << logEntries) - 1;
+
+    /* TAGE prediction */
+    // Indexes and tags of all tables, as uniform lane operations
+    uint16_t pcIdx = pc ^ (pc >> logEntries);
+    uint16_t pcTag = (pc << 3) ^ (pc >> 13);
+#if defined(__SSE2__)
+    __m128i vPcIdx = _mm_set1_epi16(pcIdx);
+    __m128i vPcTag = _mm_set1_epi16(pcTag);
+    __m128i vPath = _mm_set1_epi16(pathHist);
+    __m128i vMask = _mm_set1_epi16(mask);
+    __m128i vShift = _mm_cvtsi32_si128(logEntries);
+    __m128i vZero = _mm_setzero_si128();
+    for (uint32_t b = 0; b < numLanes; b += LANE_BLOCK) {
+        __m128i p = _mm_and_si128(vPath, _mm_loadu_si128((const __m128i*)&pathMasks[b]));
+        __m128i idx = _mm_xor_si128(vPcIdx, _mm_loadu_si128((const __m128i*)&idxFolds[b]));
+        idx = _mm_xor_si128(idx, _mm_xor_si128(p, _mm_srl_epi16(p, vShift)));
+        idx = _mm_and_si128(idx, vMask);
+        _mm_storeu_si128((__m128i*)&entries[b], _mm_add_epi32(_mm_unpacklo_epi16(idx, vZero), _mm_loadu_si128((const __m128i*)&tableBases[b])));
+        _mm_storeu_si128((__m128i*)&entries[b+4], _mm_add_epi32(_mm_unpackhi_epi16(idx, vZero), _mm_loadu_si128((const __m128i*)&tableBases[b+4])));
+        _mm_storeu_si128((__m128i*)&tags[b], _mm_xor_si128(vPcTag, _mm_loadu_si128((const __m128i*)&tagFolds[b])));
+    }
+#else
+    for (uint32_t i = 0; i < numLanes; i++) {
+        uint16_t p = pathHist & pathMasks[i];
+        entries[i] = tableBases[i] + ((pcIdx ^ idxFolds[i] ^ p ^ (p >> logEntries)) & mask);
+        tags[i] = pcTag ^ tagFolds[i];
+    }
+#endif
+    // Branch-free, so all tables are probed in parallel; tags are then matched as lanes too
+    // Padding lanes index table 0 too (their base is 0), so whole blocks are probed without a tail
+    for (uint32_t b = 0; b < numLanes; b += LANE_BLOCK) {
+        for (uint32_t i = b; i < b + LANE_BLOCK; i++) probedTags[i] = tables[entries[i]].tag;
+    }
+    uint32_t hits = 0;
+#if defined(__SSE2__)
+    for (uint32_t b = 0; b < numLanes; b += LANE_BLOCK) {
+        __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)&probedTags[b]), _mm_loadu_si128((const __m128i*)&tags[b]));
+        hits |= (uint32_t)(_mm_movemask_epi8(_mm_packs_epi16(eq, eq)) & 0xff) << b;
+    }
+#else
+    for (uint32_t i = 0; i < numLanes; i++) hits |= (uint32_t)(probedTags[i] == tags[i]) << i;
+#endif
+    hits &= (uint32_t)((1ul << numTables) - 1);  // drop padding lanes
+    // Longest-history hit provides, next longest is the alternate
+    int32_t provider = hits? 31 - __builtin_clz(hits) : -1;
+    hits &= ~(1u << (provider & 31));
+    int32_t alt = hits? 31 - __builtin_clz(hits) : -1;
+
+    int8_t& bim = bimodal[(pc ^ (pc >> BIMODAL_BITS)) & ((1 << BIMODAL_BITS) - 1)];
+    TaggedEntry* pe = (provider >= 0)? &tables[entries[provider]] : nullptr;
+    TaggedEntry* ae = (alt >= 0)? &tables[entries[alt]] : nullptr;
+    bool bimPred = bim >= 2;
+    bool altPred = ae? ae->ctr >= 0 : bimPred;
+    bool providerPred = pe? pe->ctr >= 0 : bimPred;
+    // Newly allocated entries are unreliable, so use the alternate prediction if that's been working better
+    bool providerWeak = pe && (pe->ctr == 0 || pe->ctr == -1) && pe->u == 0;
+    bool usedAlt = providerWeak && useAltOnNA >= 0;
+    bool tagePred = usedAlt? altPred : providerPred;
+
+    Component comp = !pe? BIMODAL : (usedAlt? ALT : TAGGED);
+    bool pred = tagePred;
+
+    /* Loop predictor */
+    uint32_t loopIdx = (pc ^ (pc >> LOOP_BITS)) & ((1 << LOOP_BITS) - 1);
+    uint16_t loopTag = ((pc >> LOOP_BITS) & (LOOP_VALID - 1)) | LOOP_VALID;
+    LoopEntry* le = nullptr;
+    bool loopValid = false;
+    bool loopPred = false;
+    if (useLoop) {
+        if (loops[loopIdx].tag == loopTag) {
+            le = &loops[loopIdx];
+            loopValid = le->conf == LOOP_CONF_MAX;
+            loopPred = (le->curIter + 1 == le->pastIter)? !le->dir : le->dir;
+        }
+        if (loopValid && loopUseCtr >= 0) {
+            pred = loopPred;
+            comp = LOOP;
+        }
+    }
+
+    /* Statistical corrector */
+    uint32_t scMask = (1 << SC_BITS) - 1;
+    uint32_t biasIdx = 0;
+    uint32_t scIdxs[SC_TABLES];
+    int32_t scSum = 0;
+    if (useSC) {
+        // TAGE's own (centered) counter is part of the sum, so SC only reverts it when its tables clearly disagree
+        int32_t tageCtr = usedAlt? (ae? 2*ae->ctr + 1 : 2*bim - 3) : (pe? 2*pe->ctr + 1 : 2*bim - 3);
+        biasIdx = (((pc ^ (pc >> SC_BITS)) << 1) | tagePred) & scMask;
+        scSum = 8*tageCtr + 2*scBias[biasIdx] + 1;
+        for (uint32_t t = 0; t < SC_TABLES; t++) {
+            uint64_t h = shortHist & ((1ul << scHistLens[t]) - 1);
+            scIdxs[t] = (pc ^ (pc >> (SC_BITS - t)) ^ (uint32_t)(h ^ (h >> SC_BITS) ^ (h >> 2*SC_BITS))) & scMask;
+            scSum += 2*scTables[(t << SC_BITS) + scIdxs[t]] + 1;
+        }
+        bool scPred = scSum >= 0;
+        if (comp != LOOP && scPred != tagePred && abs(scSum) >= scThreshold) {
+            pred = scPred;
+            comp = SC;
+        }
+    }
+
+    if (recordStats) {
+        profPreds.inc(comp);
+        if (pred != taken) profMispreds.inc(comp);
+    }
+
+    /* Updates */
+    if (useSC) {
+        bool scPred = scSum >= 0;
+        if (scPred != taken || abs(scSum) < scThreshold) {
+            satUpdate(scBias[biasIdx], taken, -32, 31);
+            for (uint32_t t = 0; t < SC_TABLES; t++) satUpdate(scTables[(t << SC_BITS) + scIdxs[t]], taken, -32, 31);
+        }
+        // Adapt the override threshold to how often overrides are right
+        if (scPred != tagePred) {
+            scThresholdCtr += (scPred != taken)? 1 : -1;
+            if (scThresholdCtr >= 32) {
+                scThreshold += 2;
+                scThresholdCtr = 0;
+            } else if (scThresholdCtr <= -32) {
+                scThreshold = MAX(scThreshold - 2, 6);
+                scThresholdCtr = 0;
+            }
+        }
+    }
+
+    if (useLoop) {
+        if (le) {
+            if (loopValid && loopPred != tagePred) satUpdate(loopUseCtr, loopPred == taken, -8, 7);
+            if (loopValid && loopPred != taken) {
+                memset(le, 0, sizeof(LoopEntry));  // trip count changed, free the entry
+            } else {
+                if (loopValid && tagePred != taken && le->age < LOOP_AGE_MAX) le->age++;
+                if (taken == le->dir) {
+                    if (++le->curIter == (uint16_t)-1) memset(le, 0, sizeof(LoopEntry));  // too long to track
+                } else {  // loop exit
+                    if (le->curIter + 1 == le->pastIter) {
+                        if (le->conf < LOOP_CONF_MAX) le->conf++;
+                    } else {
+                        le->pastIter = le->curIter + 1;
+                        le->conf = 0;
+                    }
+                    le->curIter = 0;
+                }
+            }
+        } else if (tagePred != taken) {
+            // Allocate on TAGE mispredictions, assuming they are loop exits
+            LoopEntry& e = loops[loopIdx];
+            if (e.age == 0) {
+                e.tag = loopTag;
+                e.dir = !taken;
+                e.pastIter = 0;
+                e.curIter = 0;
+                e.conf = 0;
+                e.age = LOOP_AGE_MAX;
+            } else {
+                e.age--;
+            }
+        }
+    }
+
+    // On mispredictions, allocate an entry in a table with longer history than the provider
+    if (tagePred != taken && provider < (int32_t)numTables - 1) {
+        uint32_t start = provider + 1;
+        if (start + 1 < numTables && (nextRand() & 1)) start++;  // spread allocations
+        bool allocated = false;
+        for (uint32_t i = start; i < numTables; i++) {
+            TaggedEntry& e = tables[entries[i]];
+            if (e.u == 0) {
+                e.tag = tags[i];
+                e.ctr = taken? 0 : -1;
+                allocated = true;
+                break;
+            }
+        }
+        if (!allocated) {
+            for (uint32_t i = start; i < numTables; i++) {
+                TaggedEntry& e = tables[entries[i]];
+                if (e.u) e.u--;
+            }
+        }
+    }
+
+    if (pe) {
+        if (providerWeak && providerPred != altPred) satUpdate(useAltOnNA, altPred == taken, -8, 7);
+        satUpdate(pe->ctr, taken, -4, 3);
+        if (providerWeak) {  // the alternate prediction was (or could have been) used, so train it too
+            if (ae) satUpdate(ae->ctr, taken, -4, 3);
+            else satUpdate(bim, taken, 0, 3);
+        }
+        if (providerPred != altPred) satUpdate(pe->u, providerPred == taken, 0, 3);
+    } else {
+        satUpdate(bim, taken, 0, 3);
+    }
+
+    // Periodically decay usefulness, so stale entries can be replaced
+    if (++branches == U_RESET_PERIOD) {
+        branches = 0;
+        for (uint32_t i = 0; i < (numTables << logEntries); i++) tables[i].u >>= 1;
+    }
+
+    updateHistories(pc, taken);
+    return pred == taken;
+}
+
+inline void TAGEPredictor::updateHistories(uint32_t pc, bool taken) {
+    uint32_t maxLen = histLens[numTables-1];
+    if (ghistPtr == 0) {
+        memmove(&ghist[ghistLen - maxLen - 1], &ghist[0], (maxLen + 1)*sizeof(uint16_t));
+        ghistPtr = ghistLen - maxLen - 1;
+    }
+    ghist[--ghistPtr] = -(uint16_t)taken;
+
+    // Rotate, fold in the newest outcome, and fold out the outgoing one
+    const uint16_t* hist = &ghist[ghistPtr];
+    uint32_t idxTop = logEntries - 1;
+    uint16_t idxMask = (1 << logEntries) - 1;
+#if defined(__SSE2__)
+    __m128i vNewest = _mm_set1_epi16(taken);
+    __m128i vIdxMask = _mm_set1_epi16(idxMask);
+    __m128i vIdxTop = _mm_cvtsi32_si128(idxTop);
+    for (uint32_t b = 0; b < numLanes; b += LANE_BLOCK) {
+        // Gather outgoing outcomes (already masks) into lanes; padding lanes have zero-length histories
+        const uint32_t* lens = &histLens[b];
+        __m128i out = _mm_cvtsi32_si128(hist[lens[0]]);
+        out = _mm_insert_epi16(out, hist[lens[1]], 1);
+        out = _mm_insert_epi16(out, hist[lens[2]], 2);
+        out = _mm_insert_epi16(out, hist[lens[3]], 3);
+        out = _mm_insert_epi16(out, hist[lens[4]], 4);
+        out = _mm_insert_epi16(out, hist[lens[5]], 5);
+        out = _mm_insert_epi16(out, hist[lens[6]], 6);
+        out = _mm_insert_epi16(out, hist[lens[7]], 7);
+
+        __m128i fi = _mm_loadu_si128((const __m128i*)&idxFolds[b]);
+        fi = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(fi, 1), _mm_srl_epi16(fi, vIdxTop)), vIdxMask);
+        fi = _mm_xor_si128(_mm_xor_si128(fi, vNewest), _mm_and_si128(out, _mm_loadu_si128((const __m128i*)&idxOutBits[b])));
+        _mm_storeu_si128((__m128i*)&idxFolds[b], fi);
+
+        __m128i ft = _mm_loadu_si128((const __m128i*)&tagFolds[b]);
+        ft = _mm_or_si128(_mm_slli_epi16(ft, 1), _mm_srli_epi16(ft, TAG_BITS - 1));
+        ft = _mm_xor_si128(_mm_xor_si128(ft, vNewest), _mm_and_si128(out, _mm_loadu_si128((const __m128i*)&tagOutBits[b])));
+        _mm_storeu_si128((__m128i*)&tagFolds[b], ft);
+    }
+#else
+    uint16_t newest = taken;
+    for (uint32_t i = 0; i < numLanes; i++) {
+        uint16_t out = hist[histLens[i]];
+        uint16_t fi = idxFolds[i];
+        uint16_t ft = tagFolds[i];
+        idxFolds[i] = (((fi << 1) | (fi >> idxTop)) & idxMask) ^ newest ^ (out & idxOutBits[i]);
+        tagFolds[i] = ((ft << 1) | (ft >> (TAG_BITS - 1))) ^ newest ^ (out & tagOutBits[i]);
+    }
+#endif
+    pathHist = (pathHist << 1) | ((pc ^ (pc >> 4)) & 1);
+    shortHist = (shortHist << 1) | taken;
+}
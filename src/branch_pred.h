@@ -0,0 +1,236 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRANCH_PRED_H_
+#define BRANCH_PRED_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Conditional branch direction predictor interface, used by OOOCore. Each
+ * core has its own predictor, selected with the core group's branchPredictor
+ * option (see init.cpp).
+ */
+class BranchPredictor : public GlobAlloc {
+    public:
+        virtual ~BranchPredictor() {}
+
+        // Predicts and updates; returns false if mispredicted
+        virtual bool predict(Address branchPc, bool taken) = 0;
+
+        // Updates without recording stats, for functional warming
+        virtual void warm(Address branchPc, bool taken) {predict(branchPc, taken);}
+
+        virtual void initStats(AggregateStat* parentStat) {}
+};
+
+/* 2-level branch predictor:
+ *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
+ *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
+ *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
+ */
+template<uint32_t NB, uint32_t HB, uint32_t LB>
+class BranchPredictorPAg : public BranchPredictor {
+    private:
+        uint32_t bhsr[1 << NB];
+        uint8_t pht[1 << LB];
+        bool useA2; // Ture: use A2, else use A3
+
+    public:
+        explicit BranchPredictorPAg(bool useA3 = false) {
+            useA2 = !useA3;
+            uint32_t numBhsrs = 1 << NB;
+            uint32_t phtSize = 1 << LB;
+
+            for (uint32_t i = 0; i < numBhsrs; i++) {
+                bhsr[i] = 0;
+            }
+            for (uint32_t i = 0; i < phtSize; i++) {
+                pht[i] = 1;  // weak non-taken
+            }
+
+            static_assert(LB <= HB, "Too many PHT entries");
+            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
+        }
+
+        // Predicts and updates; returns false if mispredicted
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t bhsrMask = (1 << NB) - 1;
+            uint32_t histMask = (1 << HB) - 1;
+            uint32_t phtMask  = (1 << LB) - 1;
+
+            // Predict
+            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
+            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
+            uint32_t phtIdx = bhsr[bhsrIdx];
+
+            // Shift-XOR-mask to fit in PHT
+            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
+            phtIdx &= phtMask;
+
+            // If uncommented, behaves like a global history predictor
+            // bhsrIdx = 0;
+            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
+
+            bool pred = pht[phtIdx] > 1;
+
+            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
+
+            // Update
+            if (useA2) {
+                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
+            } else {
+                // Please implement Automaton 3 for update
+                pht[phtIdx] = taken? (pht[phtIdx]==0? 1 : 3) : (pht[phtIdx]==3? 2: 0);
+            }
+            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
+
+            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
+            return (taken == pred);
+        }
+};
+
+/* TAGE-SC-L predictor (Seznec, "TAGE-SC-L branch predictors again", CBP 2016),
+ * somewhat simplified:
+ *  - TAGE: a bimodal base predictor plus numTables partially-tagged tables
+ *    indexed with geometric global history lengths (minHist..maxHist). The
+ *    longest matching table provides the prediction, unless its entry is newly
+ *    allocated and the alternate prediction has been doing better.
+ *  - L: a small loop predictor that overrides TAGE on loop exits once it has
+ *    seen the same trip count several times.
+ *  - SC: a statistical corrector (bias table + GEHL tables over short global
+ *    histories) that reverts TAGE predictions that are statistically wrong.
+ * Tagged entries are 4 bytes and each table is contiguous, so a prediction
+ * touches one line per table; defaults (7 tables of 1K entries) take ~40KB.
+ * Shrinking the tables barely changes simulation speed, though: the cost is
+ * the fixed per-branch work (indexes, history folds, SC sum), which makes a
+ * prediction ~5x as expensive as PAg. Use PAg if accuracy doesn't matter.
+ *
+ * This is in the core's inner loop, so per-table work is done as uniform
+ * operations on arrays of 16-bit lanes (one lane per table, padded to a
+ * multiple of 8 lanes, i.e., one SSE2 vector): all tables fold their
+ * history to the same index and tag widths, so folds are updated with the
+ * same rotate and indexes and tags are computed the same way in every lane.
+ * Only the table reads themselves are per-table.
+ */
+class TAGEPredictor : public BranchPredictor {
+    private:
+        struct TaggedEntry {
+            uint16_t tag;
+            int8_t ctr;  // 3-bit signed, taken if >= 0
+            uint8_t u;  // 2-bit usefulness
+        };
+
+        struct LoopEntry {
+            uint16_t tag;
+            uint16_t pastIter;  // trip count, including the exit, 0 if not seen yet
+            uint16_t curIter;
+            uint8_t conf;
+            uint8_t age;
+            bool dir;  // direction of the loop body
+        };
+
+        enum Component {BIMODAL, TAGGED, ALT, LOOP, SC, NUM_COMPONENTS};
+
+        static const uint32_t BIMODAL_BITS = 13;
+        static const uint32_t TAG_BITS = 16;
+        static const uint32_t MAX_TABLES = 32;
+        static const uint32_t LANE_BLOCK = 8;  // 16-bit lanes per 128-bit vector
+        static const uint32_t LOOP_BITS = 6;
+        static const uint32_t SC_BITS = 10;
+        static const uint32_t SC_TABLES = 4;
+        static const uint32_t U_RESET_PERIOD = 1 << 18;  // branches between usefulness decays
+
+        // Configuration
+        const uint32_t numTables;
+        const uint32_t numLanes;  // numTables rounded up to a multiple of LANE_BLOCK
+        const uint32_t logEntries;
+        const bool useLoop;
+        const bool useSC;
+
+        // TAGE state
+        int8_t* bimodal;  // 2-bit counters, taken if >= 2
+        TaggedEntry* tables;  // numTables tables of 2^logEntries entries
+        /* Global histories are folded (XORed) down to logEntries and TAG_BITS
+         * bits and updated incrementally: rotate left by one, XOR in the
+         * newest outcome, and XOR out the outgoing one, which lands on bit
+         * histLen % width. Lane arrays are members rather than allocated, so
+         * the compiler knows they don't alias and vectorizes loops over them
+         * without runtime overlap checks.
+         */
+        uint16_t idxFolds[MAX_TABLES];
+        uint16_t tagFolds[MAX_TABLES];
+        uint16_t idxOutBits[MAX_TABLES];
+        uint16_t tagOutBits[MAX_TABLES];
+        uint16_t pathMasks[MAX_TABLES];  // path history bits used by each table
+        uint32_t tableBases[MAX_TABLES];  // i << logEntries
+        // Per-prediction scratch, avoids recomputing indexes on updates
+        uint32_t entries[MAX_TABLES];  // each table's entry, as an index into tables
+        uint16_t tags[MAX_TABLES];
+        uint16_t probedTags[MAX_TABLES];
+        uint32_t histLens[MAX_TABLES];
+        uint16_t* ghist;  // one outcome per element, as a 0/0xffff mask; ghist[ghistPtr] is the newest
+        uint32_t ghistLen;
+        uint32_t ghistPtr;
+        uint16_t pathHist;
+        int8_t useAltOnNA;
+        uint32_t branches;  // for usefulness decay
+        uint32_t rnd;  // xorshift state, for allocation
+
+        // Loop predictor state
+        LoopEntry* loops;
+        int8_t loopUseCtr;
+
+        // SC state
+        int8_t* scBias;
+        int8_t* scTables;  // SC_TABLES tables of 2^SC_BITS entries
+        uint64_t shortHist;  // last 64 outcomes
+        int32_t scThreshold;
+        int32_t scThresholdCtr;
+
+        VectorCounter profPreds, profMispreds;
+
+    public:
+        TAGEPredictor(uint32_t _numTables, uint32_t _logEntries, uint32_t minHist, uint32_t maxHist, bool _useLoop, bool _useSC);
+
+        bool predict(Address branchPc, bool taken);
+        void warm(Address branchPc, bool taken);
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        inline uint32_t nextRand() {
+            rnd ^= rnd << 13;
+            rnd ^= rnd >> 17;
+            rnd ^= rnd << 5;
+            return rnd;
+        }
+
+        template <bool recordStats> bool access(Address branchPc, bool taken);
+        void updateHistories(uint32_t pc, bool taken);
+};
+
+#endif  // BRANCH_PRED_H_
@@ -24,6 +24,7 @@
  */
 
 #include "cache.h"
+#include "checkpoint.h"
 #include "hash.h"
 
 #include "event_recorder.h"
@@ -58,6 +59,26 @@ void Cache::initCacheStats(AggregateStat* cacheStat) {
     rp->initStats(cacheStat);
 }
 
+void Cache::saveState(CheckpointWriter& cw) {
+    cw.pushScope(name.c_str());
+    array->saveState(cw);
+    cc->saveState(cw);
+    rp->saveState(cw);
+    cw.popScope();
+}
+
+void Cache::restoreState(CheckpointReader& cr) {
+    cr.pushScope(name.c_str());
+    if (cr.contains("array")) {
+        array->restoreState(cr);
+        cc->restoreState(cr);
+        rp->restoreState(cr);
+    } else {
+        warn("[%s] Not in checkpoint, starting cold", name.c_str());
+    }
+    cr.popScope();
+}
+
 uint64_t Cache::access(MemReq& req) {
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
@@ -74,13 +95,14 @@ uint64_t Cache::access(MemReq& req) {
 
             //Evictions are not in the critical path in any sane implementation -- we do not include their delays
             //NOTE: We might be "evicting" an invalid line for all we know. Coherence controllers will know what to do
+            if (cc->isValid(lineId)) evicted(wbLineAddr);
             cc->processEviction(req, wbLineAddr, lineId, respCycle); //1. if needed, send invalidates/downgrades to lower level
 
             array->postinsert(req.lineAddr, &req, lineId); //do the actual insertion. NOTE: Now we must split insert into a 2-phase thing because cc unlocks us.
         }
         // Enforce single-record invariant: Writeback access may have a timing
         // record. If so, read it.
-        EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+        EventRecorder* evRec = req.is(MemReq::WARMUP)? nullptr : zinfo->eventRecorders[req.srcId];
         TimingRecord wbAcc;
         wbAcc.clear();
         if (unlikely(evRec && evRec->hasRecord())) {
@@ -125,8 +147,8 @@ uint64_t Cache::access(MemReq& req) {
     return respCycle;
 }
 
-void Cache::startInvalidate() {
-    cc->startInv(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
+void Cache::startInvalidate(const InvReq& req) {
+    cc->startInv(req); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
 }
 
 uint64_t Cache::finishInvalidate(const InvReq& req) {
@@ -63,19 +63,25 @@ class Cache : public BaseCache {
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         void initStats(AggregateStat* parentStat);
 
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
+
         virtual uint64_t access(MemReq& req);
 
         //NOTE: reqWriteback is pulled up to true, but not pulled down to false.
         virtual uint64_t invalidate(const InvReq& req) {
-            startInvalidate();
+            startInvalidate(req);
             return finishInvalidate(req);
         }
 
     protected:
         void initCacheStats(AggregateStat* cacheStat);
 
-        void startInvalidate(); // grabs cc's downLock
+        void startInvalidate(const InvReq& req); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
+
+        //Called on access-triggered evictions of valid lines, before they are written back (FilterCache drops its copies)
+        virtual void evicted(Address wbLineAddr) {}
 };
 
 #endif  // CACHE_H_
@@ -24,33 +24,92 @@
  */
 
 #include "cache_arrays.h"
+#include <immintrin.h>
+#include "checkpoint.h"
 #include "hash.h"
 #include "repl_policies.h"
 
+void CacheArray::saveState(CheckpointWriter& cw) {
+    panic("%s: cache array does not support checkpoints", cw.scope().c_str());
+}
+
+void CacheArray::restoreState(CheckpointReader& cr) {
+    panic("%s: cache array does not support checkpoints", cr.scope().c_str());
+}
+
 /* Set-associative array implementation */
 
+/* Returns the position of tag in tags[0..n), or -1. Compares a whole vector
+ * of tags at a time, using the widest ISA the build targets (with the default
+ * -march=core2 that's SSE2; build with -march=native for AVX2/AVX-512).
+ * Duplicate tags never happen, so the result matches the scalar loop.
+ */
+static inline int32_t matchTag(const Address* tags, uint32_t n, Address tag) {
+    uint32_t i = 0;
+#if defined(__AVX512F__)
+    __m512i vtag = _mm512_set1_epi64(tag);
+    for (; i + 8 <= n; i += 8) {
+        __mmask8 m = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512((const void*)(tags + i)), vtag);
+        if (m) return i + __builtin_ctz(m);
+    }
+#elif defined(__AVX2__)
+    __m256i vtag = _mm256_set1_epi64x(tag);
+    for (; i + 4 <= n; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(tags + i)), vtag);
+        uint32_t m = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (m) return i + __builtin_ctz(m);
+    }
+#elif defined(__SSE2__)
+    // No 64-bit compare in SSE2: compare 32-bit halves, and AND each with its swapped pair
+    __m128i vtag = _mm_set1_epi64x(tag);
+    for (; i + 4 <= n; i += 4) {
+        __m128i eq0 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + i)), vtag);
+        __m128i eq1 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + i + 2)), vtag);
+        eq0 = _mm_and_si128(eq0, _mm_shuffle_epi32(eq0, _MM_SHUFFLE(2, 3, 0, 1)));
+        eq1 = _mm_and_si128(eq1, _mm_shuffle_epi32(eq1, _MM_SHUFFLE(2, 3, 0, 1)));
+        uint32_t m = _mm_movemask_pd(_mm_castsi128_pd(eq0)) | (_mm_movemask_pd(_mm_castsi128_pd(eq1)) << 2);
+        if (m) return i + __builtin_ctz(m);
+    }
+#endif
+    for (; i < n; i++) {
+        if (tags[i] == tag) return i;
+    }
+    return -1;
+}
+
 SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
     array = gm_calloc<Address>(numLines);
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+
+    //Skip the virtual call on lookups for the hash families we instantiate for set-assoc caches
+    if (dynamic_cast<H3HashFamily*>(hf)) hashKind = HASH_H3;
+    else if (dynamic_cast<H3TableHashFamily*>(hf)) hashKind = HASH_H3TABLE;
+    else if (dynamic_cast<IdHashFamily*>(hf)) hashKind = HASH_ID;
+    else hashKind = HASH_GENERIC;
 }
 
-int32_t SetAssocArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
-    uint32_t set = hf->hash(0, lineAddr) & setMask;
-    uint32_t first = set*assoc;
-    for (uint32_t id = first; id < first + assoc; id++) {
-        if (array[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
-            return id;
-        }
+inline uint32_t SetAssocArray::getSet(const Address lineAddr) const {
+    switch (hashKind) {
+        case HASH_H3: return static_cast<H3HashFamily*>(hf)->H3HashFamily::hash(0, lineAddr) & setMask;
+        case HASH_H3TABLE: return static_cast<H3TableHashFamily*>(hf)->H3TableHashFamily::hash(0, lineAddr) & setMask;
+        case HASH_ID: return lineAddr & setMask;
+        default: return hf->hash(0, lineAddr) & setMask;
     }
-    return -1;
+}
+
+int32_t SetAssocArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+    uint32_t first = getSet(lineAddr)*assoc;
+    int32_t way = matchTag(array + first, assoc, lineAddr);
+    if (way < 0) return -1;
+    uint32_t id = first + way;
+    if (updateReplacement) rp->update(id, req);
+    return id;
 }
 
 uint32_t SetAssocArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) { //TODO: Give out valid bit of wb cand?
-    uint32_t set = hf->hash(0, lineAddr) & setMask;
-    uint32_t first = set*assoc;
+    uint32_t first = getSet(lineAddr)*assoc;
 
     uint32_t candidate = rp->rankCands(req, SetAssocCands(first, first+assoc));
 
@@ -64,6 +123,21 @@ void SetAssocArray::postinsert(const Address lineAddr, const MemReq* req, uint32
     rp->update(candidate, req);
 }
 
+void SetAssocArray::saveState(CheckpointWriter& cw) {
+    cw.beginRecord("array", "SetAssoc");
+    cw.write(assoc);
+    cw.writeArray(array, numLines);
+    cw.endRecord();
+}
+
+void SetAssocArray::restoreState(CheckpointReader& cr) {
+    cr.beginRecord("array", "SetAssoc");
+    uint32_t savedAssoc = cr.read<uint32_t>();
+    if (savedAssoc != assoc) panic("%s: checkpoint has %d ways, array has %d", cr.scope().c_str(), savedAssoc, assoc);
+    cr.readArray(array, numLines);
+    cr.endRecord();
+}
+
 
 /* ZCache implementation */
 
@@ -124,9 +198,12 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
 
     //info("Replacement for incoming 0x%lx", lineAddr);
 
+    uint64_t hashes[ways]; //all ways' hashes of an address, computed at once
+    hf->hashAll(lineAddr, ways, hashes);
+
     //Seeds
     for (uint32_t w = 0; w < ways; w++) {
-        uint32_t pos = w*numSets + (hf->hash(w, lineAddr) & setMask);
+        uint32_t pos = w*numSets + (hashes[w] & setMask);
         uint32_t lineId = lookupArray[pos];
         candidates[w].set(pos, lineId, -1);
         all_valid &= (array[lineId] != 0);
@@ -138,8 +215,9 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
         uint32_t fringeId = candidates[fringeStart].lineId;
         Address fringeAddr = array[fringeId];
         assert(fringeAddr);
+        hf->hashAll(fringeAddr, ways, hashes);
         for (uint32_t w = 0; w < ways; w++) {
-            uint32_t hval = hf->hash(w, fringeAddr) & setMask;
+            uint32_t hval = hashes[w] & setMask;
             uint32_t pos = w*numSets + hval;
             uint32_t lineId = lookupArray[pos];
 
@@ -216,3 +294,20 @@ void ZArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t cand
     statSwaps.inc(swapArrayLen-1);
 }
 
+// The candidates walk depends on the ways and hash functions, not on the number of candidates
+void ZArray::saveState(CheckpointWriter& cw) {
+    cw.beginRecord("array", "ZArray");
+    cw.write(ways);
+    cw.writeArray(array, numLines);
+    cw.writeArray(lookupArray, numLines);
+    cw.endRecord();
+}
+
+void ZArray::restoreState(CheckpointReader& cr) {
+    cr.beginRecord("array", "ZArray");
+    uint32_t savedWays = cr.read<uint32_t>();
+    if (savedWays != ways) panic("%s: checkpoint has %d ways, array has %d", cr.scope().c_str(), savedWays, ways);
+    cr.readArray(array, numLines);
+    cr.readArray(lookupArray, numLines);
+    cr.endRecord();
+}
@@ -49,6 +49,12 @@ class CacheArray : public GlobAlloc {
         virtual void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) = 0;
 
         virtual void initStats(AggregateStat* parent) {}
+
+        /* Checkpointing (see checkpoint.h). Arrays that support it save their
+         * tags in an "array" record; the default implementation panics.
+         */
+        virtual void saveState(CheckpointWriter& cw);
+        virtual void restoreState(CheckpointReader& cr);
 };
 
 class ReplPolicy;
@@ -65,12 +71,20 @@ class SetAssocArray : public CacheArray {
         uint32_t assoc;
         uint32_t setMask;
 
+        enum HashKind {HASH_GENERIC, HASH_H3, HASH_H3TABLE, HASH_ID};
+        HashKind hashKind;
+
+        inline uint32_t getSet(const Address lineAddr) const;
+
     public:
         SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
 
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
         uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
         void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate);
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 };
 
 /* The cache array that started this simulator :) */
@@ -106,6 +120,9 @@ class ZArray : public CacheArray {
         uint32_t getLastCandIdx() const {return lastCandIdx;}
 
         void initStats(AggregateStat* parentStat);
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 };
 
 // Simple wrapper classes and iterators for candidates in each case; simplifies replacement policy interface without sacrificing performance
@@ -0,0 +1,283 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "checkpoint.h"
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+#include "zsim.h"
+
+#define CKPT_MAGIC "ZSIMCKPT"
+#define CKPT_VERSION 1
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t lineSize;
+    uint64_t numPhases;  // informational
+};
+
+/* CheckpointWriter */
+
+CheckpointWriter::CheckpointWriter(const char* filename) : fname(filename), inRecord(false) {
+    // Write to a temporary file and rename it on commit, so we never leave a partial checkpoint behind
+    tmpName = fname + ".tmp";
+    f = fopen(tmpName.c_str(), "w");
+    if (!f) panic("Could not open checkpoint file %s for writing", tmpName.c_str());
+
+    CheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic));
+    hdr.version = CKPT_VERSION;
+    hdr.lineSize = zinfo->lineSize;
+    hdr.numPhases = zinfo->numPhases;
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    assert(!inRecord);
+    ok = (fclose(f) == 0) && ok;
+    if (ok && rename(tmpName.c_str(), fname.c_str()) == 0) {
+        info("Saved checkpoint %s", fname.c_str());
+    } else {
+        warn("Could not write checkpoint %s", fname.c_str());
+        unlink(tmpName.c_str());
+    }
+}
+
+std::string CheckpointWriter::scope() const {
+    std::string s;
+    for (const std::string& sc : scopes) s += sc + ".";
+    return s;
+}
+
+void CheckpointWriter::beginRecord(const char* key, const char* type) {
+    assert(!inRecord);
+    inRecord = true;
+    curKey = scope() + key;
+    curType = type;
+    curData.clear();
+}
+
+void CheckpointWriter::endRecord() {
+    assert(inRecord);
+    inRecord = false;
+    uint32_t keyLen = curKey.size();
+    uint32_t typeLen = curType.size();
+    uint64_t size = curData.size();
+    ok = ok && fwrite(&keyLen, sizeof(keyLen), 1, f) == 1;
+    ok = ok && fwrite(curKey.c_str(), 1, keyLen, f) == keyLen;
+    ok = ok && fwrite(&typeLen, sizeof(typeLen), 1, f) == 1;
+    ok = ok && fwrite(curType.c_str(), 1, typeLen, f) == typeLen;
+    ok = ok && fwrite(&size, sizeof(size), 1, f) == 1;
+    ok = ok && fwrite(curData.data(), 1, size, f) == size;
+}
+
+void CheckpointWriter::write(const void* buf, size_t bytes) {
+    assert(inRecord);
+    const char* b = static_cast<const char*>(buf);
+    curData.insert(curData.end(), b, b + bytes);
+}
+
+/* CheckpointReader */
+
+CheckpointReader::CheckpointReader(const char* filename) : fname(filename), curPos(0), curEnd(0), inRecord(false) {
+    FILE* f = fopen(filename, "r");
+    if (!f) panic("Could not open checkpoint file %s", filename);
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(fileSize);
+    if (fread(data.data(), 1, fileSize, f) != (size_t)fileSize) panic("Could not read checkpoint file %s", filename);
+    fclose(f);
+
+    CheckpointHeader hdr;
+    if (data.size() < sizeof(hdr)) panic("Checkpoint %s is truncated", filename);
+    memcpy(&hdr, data.data(), sizeof(hdr));
+    if (memcmp(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != CKPT_VERSION) {
+        panic("%s is not a checkpoint, or has an incompatible version", filename);
+    }
+    if (hdr.lineSize != zinfo->lineSize) panic("Checkpoint %s has %d-byte lines, system has %d-byte lines", filename, hdr.lineSize, zinfo->lineSize);
+
+    // Index records
+    uint64_t pos = sizeof(hdr);
+    auto get = [&](void* buf, uint64_t bytes) {
+        if (pos + bytes > data.size()) panic("Checkpoint %s is truncated", fname.c_str());
+        memcpy(buf, &data[pos], bytes);
+        pos += bytes;
+    };
+    while (pos < data.size()) {
+        uint32_t keyLen, typeLen;
+        uint64_t size;
+        get(&keyLen, sizeof(keyLen));
+        std::string key(keyLen, '\0');
+        get(&key[0], keyLen);
+        get(&typeLen, sizeof(typeLen));
+        std::string type(typeLen, '\0');
+        get(&type[0], typeLen);
+        get(&size, sizeof(size));
+        if (pos + size > data.size()) panic("Checkpoint %s is truncated", fname.c_str());
+        Record r = {type, pos, size};
+        records[key] = r;
+        pos += size;
+    }
+    info("Read checkpoint %s: %ld records, taken at phase %ld", filename, records.size(), hdr.numPhases);
+}
+
+std::string CheckpointReader::scope() const {
+    std::string s;
+    for (const std::string& sc : scopes) s += sc + ".";
+    return s;
+}
+
+std::string CheckpointReader::fullKey(const char* key) const {
+    return scope() + key;
+}
+
+bool CheckpointReader::contains(const char* key) const {
+    return records.count(fullKey(key));
+}
+
+void CheckpointReader::beginRecord(const char* key, const char* type) {
+    assert(!inRecord);
+    curKey = fullKey(key);
+    auto it = records.find(curKey);
+    if (it == records.end()) panic("Checkpoint %s has no record %s", fname.c_str(), curKey.c_str());
+    const Record& r = it->second;
+    if (r.type != type) panic("Checkpoint record %s has type %s, expected %s", curKey.c_str(), r.type.c_str(), type);
+    curPos = r.offset;
+    curEnd = r.offset + r.size;
+    inRecord = true;
+}
+
+void CheckpointReader::endRecord() {
+    assert(inRecord);
+    if (curPos != curEnd) panic("Checkpoint record %s has %ld unread bytes", curKey.c_str(), curEnd - curPos);
+    inRecord = false;
+}
+
+void CheckpointReader::read(void* buf, size_t bytes) {
+    assert(inRecord);
+    if (curPos + bytes > curEnd) panic("Checkpoint record %s is too short", curKey.c_str());
+    memcpy(buf, &data[curPos], bytes);
+    curPos += bytes;
+}
+
+void CheckpointReader::geometryMismatch(uint64_t saved, uint64_t expected) const {
+    panic("Checkpoint record %s has %ld elements, expected %ld; restored objects must have the same geometry",
+            curKey.c_str(), saved, expected);
+}
+
+/* Stats: counters are saved by their full name, and restored into the
+ * counters with the same name and size (others are left alone)
+ */
+
+typedef std::vector<std::pair<std::string, std::vector<uint64_t>>> CounterList;
+
+static void CollectCounters(const Stat* s, const std::string& prefix, CounterList& counters) {
+    std::string path = prefix + s->name();
+    if (const AggregateStat* as = dynamic_cast<const AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) CollectCounters(as->get(i), path + ".", counters);
+        return;
+    }
+
+    std::vector<uint64_t> vals;
+    if (const Counter* c = dynamic_cast<const Counter*>(s)) {
+        vals.push_back(c->get());
+    } else if (const VectorCounter* vc = dynamic_cast<const VectorCounter*>(s)) {
+        for (uint32_t i = 0; i < vc->size(); i++) vals.push_back(vc->count(i));
+    } else {
+        return;  // derived stats (proxies, lambdas) are not restorable
+    }
+    counters.push_back(std::make_pair(path, vals));
+}
+
+static void RestoreCounters(Stat* s, const std::string& prefix, const std::unordered_map<std::string, std::vector<uint64_t>>& vals,
+        uint64_t& restored) {
+    std::string path = prefix + s->name();
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) RestoreCounters(as->get(i), path + ".", vals, restored);
+        return;
+    }
+
+    auto it = vals.find(path);
+    if (it == vals.end()) return;
+    const std::vector<uint64_t>& v = it->second;
+    if (Counter* c = dynamic_cast<Counter*>(s)) {
+        if (v.size() != 1) return;
+        c->set(v[0]);
+        restored++;
+    } else if (VectorCounter* vc = dynamic_cast<VectorCounter*>(s)) {
+        if (v.size() != vc->size()) return;
+        for (uint32_t i = 0; i < v.size(); i++) vc->set(i, v[i]);
+        restored++;
+    }
+}
+
+void SaveCheckpoint(const char* filename) {
+    info("Checkpointing system state at phase %ld", zinfo->numPhases);
+    CheckpointWriter cw(filename);
+    for (MemObject* obj : *zinfo->checkpointObjs) obj->saveState(cw);
+
+    CounterList counters;
+    CollectCounters(zinfo->rootStat, "", counters);
+    cw.beginRecord("stats", "Counters");
+    cw.write((uint64_t)counters.size());
+    for (auto& c : counters) {
+        uint32_t pathLen = c.first.size();
+        cw.write(pathLen);
+        cw.write(c.first.c_str(), pathLen);
+        cw.writeArray(c.second.data(), c.second.size());
+    }
+    cw.endRecord();
+}
+
+void RestoreCheckpoint(const char* filename, bool restoreStats) {
+    CheckpointReader cr(filename);
+    for (MemObject* obj : *zinfo->checkpointObjs) obj->restoreState(cr);
+
+    if (restoreStats) {
+        std::unordered_map<std::string, std::vector<uint64_t>> vals;
+        cr.beginRecord("stats", "Counters");
+        uint64_t numCounters = cr.read<uint64_t>();
+        for (uint64_t i = 0; i < numCounters; i++) {
+            uint32_t pathLen = cr.read<uint32_t>();
+            std::string path(pathLen, '\0');
+            cr.read(&path[0], pathLen);
+            uint64_t n = cr.read<uint64_t>();
+            std::vector<uint64_t>& v = vals[path];
+            v.resize(n);
+            cr.read(v.data(), n*sizeof(uint64_t));
+        }
+        cr.endRecord();
+
+        uint64_t restored = 0;
+        RestoreCounters(zinfo->rootStat, "", vals, restored);
+        info("Restored %ld/%ld stats counters", restored, numCounters);
+    }
+    info("Restored checkpoint %s", filename);
+}
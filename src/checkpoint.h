@@ -0,0 +1,146 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Checkpoints of the simulated system's functional state.
+ *
+ * A checkpoint captures what is expensive to warm up: cache contents,
+ * replacement and coherence state, partitioning state, DRAM open rows, and
+ * (optionally restored) stats counters. It does not capture anything that
+ * depends on Pin or the running processes (cores, threads, scheduler), nor
+ * transient timing state (in-flight requests, bank timings), which starts
+ * idle after a restore.
+ *
+ * Checkpoints are saved at the end of a phase, when the system is quiescent,
+ * either on the CHECKPOINT magic op or at a fixed phase; they are restored
+ * right after the system is built. The restored run should then fast-forward
+ * to the point where the checkpoint was taken (e.g., with ROI hooks or
+ * ffiPoints); fast-forwarding does not touch the memory hierarchy.
+ *
+ * The file is a sequence of records, each with a key (the object's name plus
+ * the component, e.g., "l2-0.repl"), a type tag, and a blob. Objects restore
+ * their records by key, so a checkpoint can be restored on a different
+ * configuration as long as the restored caches have the same names, types
+ * and geometry; other parameters (latencies, cores, memory timings) may
+ * differ. Objects that are not in the checkpoint start cold.
+ */
+
+class CheckpointWriter {
+    private:
+        FILE* f;
+        std::string fname;
+        std::string tmpName;
+        std::vector<std::string> scopes;
+        std::string curKey;
+        std::string curType;
+        std::vector<char> curData;
+        bool inRecord;
+        bool ok;
+
+    public:
+        explicit CheckpointWriter(const char* filename);
+        ~CheckpointWriter();  // commits the file
+
+        void pushScope(const char* name) { scopes.push_back(name); }
+        void popScope() { scopes.pop_back(); }
+        std::string scope() const;
+
+        void beginRecord(const char* key, const char* type);
+        void endRecord();
+
+        void write(const void* buf, size_t bytes);
+
+        template <typename T> void write(const T& v) {
+            write(&v, sizeof(T));
+        }
+
+        template <typename T> void writeArray(const T* a, uint64_t n) {
+            write(n);
+            write(a, n*sizeof(T));
+        }
+};
+
+class CheckpointReader {
+    private:
+        struct Record {
+            std::string type;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        std::string fname;
+        std::vector<char> data;
+        std::unordered_map<std::string, Record> records;
+        std::vector<std::string> scopes;
+        std::string curKey;
+        uint64_t curPos, curEnd;
+        bool inRecord;
+
+    public:
+        explicit CheckpointReader(const char* filename);
+
+        void pushScope(const char* name) { scopes.push_back(name); }
+        void popScope() { scopes.pop_back(); }
+        std::string scope() const;
+
+        bool contains(const char* key) const;
+
+        // Panics if the record is missing or has a different type
+        void beginRecord(const char* key, const char* type);
+        void endRecord();  // panics if the record was not fully read
+
+        void read(void* buf, size_t bytes);
+
+        template <typename T> T read() {
+            T v;
+            read(&v, sizeof(T));
+            return v;
+        }
+
+        // Panics if the array has a different number of elements
+        template <typename T> void readArray(T* a, uint64_t n) {
+            uint64_t sn = read<uint64_t>();
+            if (sn != n) geometryMismatch(sn, n);
+            read(a, n*sizeof(T));
+        }
+
+    private:
+        std::string fullKey(const char* key) const;
+        void geometryMismatch(uint64_t saved, uint64_t expected) const;
+};
+
+// Save/restore all checkpointed objects (zinfo->checkpointObjs) and stats
+void SaveCheckpoint(const char* filename);
+void RestoreCheckpoint(const char* filename, bool restoreStats);
+
+#endif  // CHECKPOINT_H_
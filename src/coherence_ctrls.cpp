@@ -25,6 +25,7 @@
 
 #include "coherence_ctrls.h"
 #include "cache.h"
+#include "checkpoint.h"
 #include "network.h"
 
 /* Do a simple XOR block hash on address to determine its bank. Hacky for now,
@@ -53,7 +54,7 @@ void MESIBottomCC::init(const g_vector<MemObject*>& _parents, Network* network,
 }
 
 
-uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId) {
+uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     MESIState* state = &array[lineId];
     if (lowerLevelWriteback) {
         //If this happens, when tcc issued the invalidations, it got a writeback. This means we have to do a PUTX, i.e. we have to transition to M if we are in E
@@ -67,13 +68,13 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
         case S:
         case E:
             {
-                MemReq req = {wbLineAddr, PUTS, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
+                MemReq req = {wbLineAddr, PUTS, selfId, state, cycle, getLock(wbLineAddr), *state, srcId, flags};
                 respCycle = parents[getParentId(wbLineAddr)]->access(req);
             }
             break;
         case M:
             {
-                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
+                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, getLock(wbLineAddr), *state, srcId, flags};
                 respCycle = parents[getParentId(wbLineAddr)]->access(req);
             }
             break;
@@ -91,7 +92,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
         // A PUTS/PUTX does nothing w.r.t. higher coherence levels --- it dies here
         case PUTS: //Clean writeback, nothing to do (except profiling)
             assert(*state != I);
-            profPUTS.inc();
+            profInc(flags, profPUTS);
             break;
         case PUTX: //Dirty writeback
             assert(*state == M || *state == E);
@@ -99,34 +100,34 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 //Silent transition, record that block was written to
                 *state = M;
             }
-            profPUTX.inc();
+            profInc(flags, profPUTX);
             break;
         case GETS:
             if (*state == I) {
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETS, selfId, state, cycle, getLock(lineAddr), *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                profInc(flags, profGETNextLevelLat, nextLevelLat);
+                profInc(flags, profGETNetLat, netLat);
                 respCycle += nextLevelLat + netLat;
-                profGETSMiss.inc();
+                profInc(flags, profGETSMiss);
                 assert(*state == S || *state == E);
             } else {
-                profGETSHit.inc();
+                profInc(flags, profGETSHit);
             }
             break;
         case GETX:
             if (*state == I || *state == S) {
                 //Profile before access, state changes
-                if (*state == I) profGETXMissIM.inc();
-                else profGETXMissSM.inc();
+                if (*state == I) profInc(flags, profGETXMissIM);
+                else profInc(flags, profGETXMissSM);
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETX, selfId, state, cycle, getLock(lineAddr), *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                profInc(flags, profGETNextLevelLat, nextLevelLat);
+                profInc(flags, profGETNetLat, netLat);
                 respCycle += nextLevelLat + netLat;
             } else {
                 if (*state == E) {
@@ -139,7 +140,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                      */
                     *state = M;
                 }
-                profGETXHit.inc();
+                profInc(flags, profGETXHit);
             }
             assert_msg(*state == M, "Wrong final state on GETX, lineId %d numLines %d, finalState %s", lineId, numLines, MESIStateName(*state));
             break;
@@ -159,7 +160,7 @@ void MESIBottomCC::processWritebackOnAccess(Address lineAddr, uint32_t lineId, A
     }
 }
 
-void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback) {
+void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint32_t flags) {
     MESIState* state = &array[lineId];
     assert(*state != I);
     switch (type) {
@@ -168,17 +169,17 @@ void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type,
             assert_msg(*state == E || *state == M, "Invalid state %s", MESIStateName(*state));
             if (*state == M) *reqWriteback = true;
             *state = S;
-            profINVX.inc();
+            profInc(flags, profINVX);
             break;
         case INV: //invalidate
             assert(*state != I);
             if (*state == M) *reqWriteback = true;
             *state = I;
-            profINV.inc();
+            profInc(flags, profINV);
             break;
         case FWD: //forward
             assert_msg(*state == S, "Invalid state %s on FWD", MESIStateName(*state));
-            profFWD.inc();
+            profInc(flags, profFWD);
             break;
         default: panic("!?");
     }
@@ -190,11 +191,19 @@ uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType
     if (!nonInclusiveHack) panic("Non-inclusive %s on line 0x%lx, this cache should be inclusive", AccessTypeName(type), lineAddr);
 
     //info("Non-inclusive wback, forwarding");
-    MemReq req = {lineAddr, type, selfId, state, cycle, &ccLock, *state, srcId, flags | MemReq::NONINCLWB};
+    MemReq req = {lineAddr, type, selfId, state, cycle, getLock(lineAddr), *state, srcId, flags | MemReq::NONINCLWB};
     uint64_t respCycle = parents[getParentId(lineAddr)]->access(req);
     return respCycle;
 }
 
+void MESIBottomCC::saveState(CheckpointWriter& cw) {
+    cw.writeArray(array, numLines);
+}
+
+void MESIBottomCC::restoreState(CheckpointReader& cr) {
+    cr.readArray(array, numLines);
+}
+
 
 /* MESITopCC implementation */
 
@@ -210,7 +219,7 @@ void MESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, co
     }
 }
 
-uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     //Send down downgrades/invalidates
     Entry* e = &array[lineId];
 
@@ -225,7 +234,7 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
         uint32_t sentInvs = 0;
         for (uint32_t c = 0; c < numChildren; c++) {
             if (e->sharers[c]) {
-                InvReq req = {lineAddr, type, reqWriteback, cycle, srcId};
+                InvReq req = {lineAddr, type, reqWriteback, cycle, srcId, flags & MemReq::WARMUP};
                 uint64_t respCycle = children[c]->invalidate(req);
                 respCycle += childrenRTTs[c];
                 maxCycle = MAX(respCycle, maxCycle);
@@ -247,14 +256,14 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
 }
 
 
-uint64_t MESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+uint64_t MESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     if (nonInclusiveHack) {
         // Don't invalidate anything, just clear our entry
         array[lineId].clear();
         return cycle;
     } else {
         //Send down invalidates
-        return sendInvalidates(wbLineAddr, lineId, INV, reqWriteback, cycle, srcId);
+        return sendInvalidates(wbLineAddr, lineId, INV, reqWriteback, cycle, srcId, flags);
     }
 }
 
@@ -291,7 +300,7 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
 
                 if (e->isExclusive()) {
                     //Downgrade the exclusive sharer
-                    respCycle = sendInvalidates(lineAddr, lineId, INVX, inducedWriteback, cycle, srcId);
+                    respCycle = sendInvalidates(lineAddr, lineId, INVX, inducedWriteback, cycle, srcId, flags);
                 }
 
                 assert_msg(!e->isExclusive(), "Can't have exclusivity here. isExcl=%d excl=%d numSharers=%d", e->isExclusive(), e->exclusive, e->numSharers);
@@ -313,7 +322,7 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
             }
 
             // Invalidate all other copies
-            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId);
+            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId, flags);
 
             // Set current sharer, mark exclusive
             e->sharers[childId] = true;
@@ -331,13 +340,53 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
     return respCycle;
 }
 
-uint64_t MESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+uint64_t MESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     if (type == FWD) {//if it's a FWD, we should be inclusive for now, so we must have the line, just invLat works
         assert(!nonInclusiveHack); //dsm: ask me if you see this failing and don't know why
         return cycle;
     } else {
         //Just invalidate or downgrade down to children as needed
-        return sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId);
+        return sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId, flags);
     }
 }
 
+//Sharer bits are child ids, so the restored cache must have as many children
+void MESITopCC::saveState(CheckpointWriter& cw) {
+    cw.write((uint32_t)children.size());
+    cw.writeArray(array, numLines);
+}
+
+void MESITopCC::restoreState(CheckpointReader& cr) {
+    uint32_t savedChildren = cr.read<uint32_t>();
+    if (savedChildren != children.size()) panic("%s: checkpoint has %d children, cache has %ld", cr.scope().c_str(), savedChildren, children.size());
+    cr.readArray(array, numLines);
+}
+
+
+/* MESICC/MESITerminalCC checkpointing */
+
+void MESICC::saveState(CheckpointWriter& cw) {
+    cw.beginRecord("cc", "MESI");
+    bcc->saveState(cw);
+    tcc->saveState(cw);
+    cw.endRecord();
+}
+
+void MESICC::restoreState(CheckpointReader& cr) {
+    cr.beginRecord("cc", "MESI");
+    bcc->restoreState(cr);
+    tcc->restoreState(cr);
+    cr.endRecord();
+}
+
+void MESITerminalCC::saveState(CheckpointWriter& cw) {
+    cw.beginRecord("cc", "MESITerminal");
+    bcc->saveState(cw);
+    cw.endRecord();
+}
+
+void MESITerminalCC::restoreState(CheckpointReader& cr) {
+    cr.beginRecord("cc", "MESITerminal");
+    bcc->restoreState(cr);
+    cr.endRecord();
+}
@@ -27,9 +27,11 @@
 #define COHERENCE_CTRLS_H_
 
 #include <bitset>
+#include "bithacks.h"
 #include "constants.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
+#include "hash.h"
 #include "locks.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -53,12 +55,16 @@ class CC : public GlobAlloc {
         virtual void endAccess(const MemReq& req) = 0;
 
         //Inv methods
-        virtual void startInv() = 0;
+        virtual void startInv(const InvReq& req) = 0;
         virtual uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) = 0;
 
         //Repl policy interface
         virtual uint32_t numSharers(uint32_t lineId) = 0;
         virtual bool isValid(uint32_t lineId) = 0;
+
+        //Checkpointing (see checkpoint.h), saves coherence state in a "cc" record
+        virtual void saveState(CheckpointWriter& cw) = 0;
+        virtual void restoreState(CheckpointReader& cr) = 0;
 };
 
 
@@ -76,6 +82,40 @@ class CC : public GlobAlloc {
 class Cache;
 class Network;
 
+/* Lock striping for coherence controllers. By default, each controller has a
+ * single lock, so all accesses to a bank serialize. With N stripes, lines are
+ * mapped to N locks by their array set, and accesses to different sets proceed
+ * in parallel. A replacement touches a whole set, so lines of the same set must
+ * share a lock; hence stripes are derived from the same hash the
+ * (set-associative) array uses. Each stripe behaves exactly like the single
+ * lock did (hand-over-hand locking, race checks), since a line and everything
+ * an access to it touches in this bank is covered by one stripe.
+ */
+class CCLockStripes : public GlobAlloc {
+    private:
+        struct PaddedLock {
+            lock_t lock;
+            PAD_SZ(sizeof(lock_t));
+        };
+
+        PaddedLock* locks;
+        HashFamily* hf;
+        uint32_t setMask;
+        uint32_t stripeMask;
+
+    public:
+        CCLockStripes(HashFamily* _hf, uint32_t numSets, uint32_t numStripes) : hf(_hf), setMask(numSets - 1), stripeMask(numStripes - 1) {
+            assert(isPow2(numSets) && isPow2(numStripes) && numStripes <= numSets);
+            locks = gm_memalign<PaddedLock>(CACHE_LINE_BYTES, numStripes);
+            for (uint32_t i = 0; i < numStripes; i++) futex_init(&locks[i].lock);
+        }
+
+        inline lock_t* get(Address lineAddr) {
+            uint32_t set = hf->hash(0, lineAddr) & setMask;
+            return &locks[set & stripeMask].lock;
+        }
+};
+
 /* NOTE: To avoid virtual function overheads, there is no BottomCC interface, since we only have a MESI controller for now */
 
 class MESIBottomCC : public GlobAlloc {
@@ -96,12 +136,16 @@ class MESIBottomCC : public GlobAlloc {
 
         bool nonInclusiveHack;
 
+        CCLockStripes* stripes; //if set, used instead of ccLock
+
         PAD();
         lock_t ccLock;
         PAD();
 
     public:
-        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack) {
+        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack, CCLockStripes* _stripes = nullptr)
+            : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack), stripes(_stripes)
+        {
             array = gm_calloc<MESIState>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i] = I;
@@ -144,22 +188,30 @@ class MESIBottomCC : public GlobAlloc {
             parentStat->append(&profGETNetLat);
         }
 
-        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
         void processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type);
 
-        void processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback);
+        void processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint32_t flags);
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 
         uint64_t processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags);
 
-        inline void lock() {
-            futex_lock(&ccLock);
+        //lineAddr selects the lock stripe; ignored with a single lock
+        inline lock_t* getLock(Address lineAddr) {
+            return stripes? stripes->get(lineAddr) : &ccLock;
+        }
+
+        inline void lock(Address lineAddr) {
+            futex_lock(getLock(lineAddr));
         }
 
-        inline void unlock() {
-            futex_unlock(&ccLock);
+        inline void unlock(Address lineAddr) {
+            futex_unlock(getLock(lineAddr));
         }
 
         /* Replacement policy query interface */
@@ -171,6 +223,17 @@ class MESIBottomCC : public GlobAlloc {
 
     private:
         uint32_t getParentId(Address lineAddr);
+
+        //With lock stripes, accesses to different sets update counters concurrently
+        inline void profInc(Counter& c, uint64_t delta = 1) {
+            if (stripes) c.atomicInc(delta);
+            else c.inc(delta);
+        }
+
+        //Functional warming (WARMUP) changes state, but is not profiled
+        inline void profInc(uint32_t flags, Counter& c, uint64_t delta = 1) {
+            if (!(flags & MemReq::WARMUP)) profInc(c, delta);
+        }
 };
 
 
@@ -204,12 +267,16 @@ class MESITopCC : public GlobAlloc {
 
         bool nonInclusiveHack;
 
+        CCLockStripes* stripes; //if set, used instead of ccLock
+
         PAD();
         lock_t ccLock;
         PAD();
 
     public:
-        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack) : numLines(_numLines), nonInclusiveHack(_nonInclusiveHack) {
+        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack, CCLockStripes* _stripes = nullptr)
+            : numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), stripes(_stripes)
+        {
             array = gm_calloc<Entry>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i].clear();
@@ -220,19 +287,22 @@ class MESITopCC : public GlobAlloc {
 
         void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
 
-        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
                 MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
-        uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 
-        inline void lock() {
-            futex_lock(&ccLock);
+        inline void lock(Address lineAddr) {
+            futex_lock(stripes? stripes->get(lineAddr) : &ccLock);
         }
 
-        inline void unlock() {
-            futex_unlock(&ccLock);
+        inline void unlock(Address lineAddr) {
+            futex_unlock(stripes? stripes->get(lineAddr) : &ccLock);
         }
 
         /* Replacement policy query interface */
@@ -241,7 +311,7 @@ class MESITopCC : public GlobAlloc {
         }
 
     private:
-        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 };
 
 static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIState initialState) {
@@ -281,19 +351,28 @@ class MESICC : public CC {
         uint32_t numLines;
         bool nonInclusiveHack;
         g_string name;
+        CCLockStripes* tccStripes;
+        CCLockStripes* bccStripes;
 
     public:
         //Initialization
         MESICC(uint32_t _numLines, bool _nonInclusiveHack, g_string& _name) : tcc(nullptr), bcc(nullptr),
-            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name) {}
+            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name), tccStripes(nullptr), bccStripes(nullptr) {}
+
+        //Must be called before setParents/setChildren. hf and numSets must match the array's
+        void setLockStripes(HashFamily* hf, uint32_t numSets, uint32_t numStripes) {
+            assert(!tcc && !bcc);
+            tccStripes = new CCLockStripes(hf, numSets, numStripes);
+            bccStripes = new CCLockStripes(hf, numSets, numStripes);
+        }
 
         void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
-            bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack);
+            bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack, bccStripes);
             bcc->init(parents, network, name.c_str());
         }
 
         void setChildren(const g_vector<BaseCache*>& children, Network* network) {
-            tcc = new MESITopCC(numLines, nonInclusiveHack);
+            tcc = new MESITopCC(numLines, nonInclusiveHack, tccStripes);
             tcc->init(children, network, name.c_str());
         }
 
@@ -314,8 +393,8 @@ class MESICC : public CC {
                 futex_unlock(req.childLock);
             }
 
-            tcc->lock(); //must lock tcc FIRST
-            bcc->lock();
+            tcc->lock(req.lineAddr); //must lock tcc FIRST
+            bcc->lock(req.lineAddr);
 
             /* The situation is now stable, true race-wise. No one can touch the child state, because we hold
              * both parent's locks. So, we first handle races, which may cause us to skip the access.
@@ -339,8 +418,8 @@ class MESICC : public CC {
 
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
             bool lowerLevelWriteback = false;
-            uint64_t evCycle = tcc->processEviction(wbLineAddr, lineId, &lowerLevelWriteback, startCycle, triggerReq.srcId); //1. if needed, send invalidates/downgrades to lower level
-            evCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, evCycle, triggerReq.srcId); //2. if needed, write back line to upper level
+            uint64_t evCycle = tcc->processEviction(wbLineAddr, lineId, &lowerLevelWriteback, startCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP); //1. if needed, send invalidates/downgrades to lower level
+            evCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, evCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP); //2. if needed, write back line to upper level
             return evCycle;
         }
 
@@ -385,26 +464,29 @@ class MESICC : public CC {
                 futex_lock(req.childLock);
             }
 
-            bcc->unlock();
-            tcc->unlock();
+            bcc->unlock(req.lineAddr);
+            tcc->unlock(req.lineAddr);
         }
 
         //Inv methods
-        void startInv() {
-            bcc->lock(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
+        void startInv(const InvReq& req) {
+            bcc->lock(req.lineAddr); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
-            uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
-            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
+            uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId, req.flags); //send invalidates or downgrades to children
+            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback, req.flags); //adjust our own state
 
-            bcc->unlock();
+            bcc->unlock(req.lineAddr);
             return respCycle;
         }
 
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return tcc->numSharers(lineId);}
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 };
 
 // Terminal CC, i.e., without children --- accepts GETS/X, but not PUTS/X
@@ -443,7 +525,7 @@ class MESITerminalCC : public CC {
                 futex_unlock(req.childLock);
             }
 
-            bcc->lock();
+            bcc->lock(req.lineAddr);
 
             /* The situation is now stable, true race-wise. No one can touch the child state, because we hold
              * both parent's locks. So, we first handle races, which may cause us to skip the access.
@@ -458,7 +540,7 @@ class MESITerminalCC : public CC {
 
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
             bool lowerLevelWriteback = false;
-            uint64_t endCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, startCycle, triggerReq.srcId); //2. if needed, write back line to upper level
+            uint64_t endCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, startCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP); //2. if needed, write back line to upper level
             return endCycle;  // critical path unaffected, but TimingCache needs it
         }
 
@@ -476,23 +558,26 @@ class MESITerminalCC : public CC {
             if (req.childLock) {
                 futex_lock(req.childLock);
             }
-            bcc->unlock();
+            bcc->unlock(req.lineAddr);
         }
 
         //Inv methods
-        void startInv() {
-            bcc->lock();
+        void startInv(const InvReq& req) {
+            bcc->lock(req.lineAddr);
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
-            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
-            bcc->unlock();
+            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback, req.flags); //adjust our own state
+            bcc->unlock(req.lineAddr);
             return startCycle; //no extra delay in terminal caches
         }
 
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return 0;} //no sharers
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
 };
 
 #endif  // COHERENCE_CTRLS_H_
@@ -0,0 +1,198 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string>
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "zsim.h"
+
+/** Implements the columnar backend, an append-only format that is cheap to write and that analysis tools can mmap to
+ * read one stat's time series without touching the others (see misc/zcs.py). Layout (native endianness):
+ *
+ *   Header:  "ZSTATS01", uint64 numCols, uint64 schemaBytes, schema (numCols NUL-terminated leaf stat names,
+ *            e.g., "l2.l2-0.hGETS" or "procInstrs.3"), zero padding to 8 bytes
+ *   Blocks:  numCols columns of numSamples uint64s each, back to back (i.e., column-major)
+ *   Footer:  uint64 numBlocks, then numBlocks {uint64 offset, uint64 numSamples}
+ *   Trailer: uint64 footerOffset, "ZSTATEND"
+ *
+ * Dumps are buffered in row-major order and transposed when a block is written. Each block write goes over the old
+ * footer and appends a new footer and trailer, so the file is readable mid-simulation. As with HDF5, we open and
+ * close the file on every write, because dump may be called from multiple processes.
+ */
+class ColumnarBackendImpl : public GlobAlloc {
+    private:
+        const char* filename;
+        AggregateStat* rootStat;
+        bool skipVectors;
+        bool sumRegularAggregates;
+
+        uint64_t numCols;
+        uint64_t* rowBuf; //buffered samples, row-major
+        uint64_t* colBuf; //one column of a block, used to transpose on writes
+        uint64_t* curPtr; //next element to write in dump
+        uint32_t samplesPerBlock;
+        uint32_t bufferedSamples;
+
+        uint64_t footerOffset; //where the next block goes
+        g_vector<uint64_t> blockIndex; //offset, numSamples pairs
+
+        bool skipStat(Stat* s) {
+            return skipVectors && dynamic_cast<VectorStat*>(s);
+        }
+
+        // Builds the schema, in the same order dumpWalk produces values. path is the full name of s ("" for the root).
+        // Returns the number of columns.
+        uint64_t schemaWalk(Stat* s, const std::string& path, std::string* schema) {
+            if (skipStat(s)) return 0;
+            uint64_t cols = 0;
+            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+                if (as->isRegular() && sumRegularAggregates) {
+                    cols += schemaWalk(as->get(0), path, schema); //summed children all share the aggregate's name
+                } else {
+                    for (uint32_t i = 0; i < as->size(); i++) {
+                        Stat* child = as->get(i);
+                        cols += schemaWalk(child, path.empty()? child->name() : path + "." + child->name(), schema);
+                    }
+                }
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                schema->append(path);
+                schema->push_back('\0');
+                cols++;
+            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+                for (uint32_t i = 0; i < vs->size(); i++) {
+                    schema->append(path + "." + (vs->hasCounterNames()? std::string(vs->counterName(i)) : std::to_string(i)));
+                    schema->push_back('\0');
+                    cols++;
+                }
+            } else {
+                panic("Unrecognized stat type");
+            }
+            return cols;
+        }
+
+        // Dump the stats, inorder walk (same as the HDF5 backend)
+        void dumpWalk(Stat* s) {
+            if (skipStat(s)) return;
+            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+                if (as->isRegular() && sumRegularAggregates) {
+                    uint64_t* startPtr = curPtr;
+                    dumpWalk(as->get(0));
+                    uint64_t* tmpPtr = curPtr;
+                    uint32_t sz = tmpPtr - startPtr;
+                    for (uint32_t i = 1; i < as->size(); i++) {
+                        dumpWalk(as->get(i));
+                        assert(curPtr == tmpPtr + sz);
+                        for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
+                        curPtr = tmpPtr;
+                    }
+                } else {
+                    for (uint32_t i = 0; i < as->size(); i++) dumpWalk(as->get(i));
+                }
+            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+                *(curPtr++) = ss->get();
+            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+                for (uint32_t i = 0; i < vs->size(); i++) *(curPtr++) = vs->count(i);
+            } else {
+                panic("Unrecognized stat type");
+            }
+        }
+
+        void writeBlock() {
+            FILE* f = fopen(filename, "r+b");
+            if (!f) panic("Columnar backend: could not open %s", filename);
+            fseek(f, footerOffset, SEEK_SET);
+            uint64_t blockOffset = footerOffset;
+            for (uint64_t c = 0; c < numCols; c++) {
+                for (uint32_t s = 0; s < bufferedSamples; s++) colBuf[s] = rowBuf[s*numCols + c];
+                fwrite(colBuf, sizeof(uint64_t), bufferedSamples, f);
+            }
+            footerOffset += numCols*bufferedSamples*sizeof(uint64_t);
+            blockIndex.push_back(blockOffset);
+            blockIndex.push_back(bufferedSamples);
+
+            uint64_t numBlocks = blockIndex.size()/2;
+            fwrite(&numBlocks, sizeof(uint64_t), 1, f);
+            fwrite(&blockIndex[0], sizeof(uint64_t), blockIndex.size(), f);
+            fwrite(&footerOffset, sizeof(uint64_t), 1, f);
+            fwrite("ZSTATEND", 1, 8, f);
+            fclose(f);
+        }
+
+    public:
+        ColumnarBackendImpl(const char* _filename, AggregateStat* _rootStat, size_t bytesPerBlock, bool _skipVectors, bool _sumRegularAggregates) :
+            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+        {
+            info("Columnar backend: Opening %s", filename);
+            std::string schema;
+            numCols = schemaWalk(rootStat, "", &schema);
+            while (schema.size() % sizeof(uint64_t)) schema.push_back('\0');
+
+            FILE* f = fopen(filename, "wb");
+            if (!f) panic("Columnar backend: could not create %s", filename);
+            uint64_t schemaBytes = schema.size();
+            fwrite("ZSTATS01", 1, 8, f);
+            fwrite(&numCols, sizeof(uint64_t), 1, f);
+            fwrite(&schemaBytes, sizeof(uint64_t), 1, f);
+            fwrite(schema.c_str(), 1, schemaBytes, f);
+            footerOffset = 3*sizeof(uint64_t) + schemaBytes;
+            uint64_t numBlocks = 0;
+            fwrite(&numBlocks, sizeof(uint64_t), 1, f);
+            fwrite(&footerOffset, sizeof(uint64_t), 1, f);
+            fwrite("ZSTATEND", 1, 8, f);
+            fclose(f);
+
+            uint64_t recordSize = MAX(numCols, 1ul)*sizeof(uint64_t);
+            samplesPerBlock = bytesPerBlock/recordSize + 1;
+            //conservatively add space for a record, dumpWalk bleeds into the buffer a bit when summing regular aggregates
+            rowBuf = gm_calloc<uint64_t>((samplesPerBlock + 1)*MAX(numCols, 1ul));
+            colBuf = gm_calloc<uint64_t>(samplesPerBlock);
+            curPtr = rowBuf;
+            bufferedSamples = 0;
+            info("Columnar backend: %ld columns, %d samples/block", numCols, samplesPerBlock);
+        }
+
+        void dump(bool buffered) {
+            dumpWalk(rootStat);
+            bufferedSamples++;
+            assert_msg(rowBuf + bufferedSamples*numCols == curPtr, "Columnar (%s): schema and dump walks disagree", filename);
+
+            if (bufferedSamples == samplesPerBlock || !buffered) {
+                writeBlock();
+                bufferedSamples = 0;
+                curPtr = rowBuf;
+            }
+        }
+};
+
+ColumnarBackend::ColumnarBackend(const char* filename, AggregateStat* rootStat, size_t bytesPerBlock, bool skipVectors, bool sumRegularAggregates) {
+    backend = new ColumnarBackendImpl(filename, rootStat, bytesPerBlock, skipVectors, sumRegularAggregates);
+}
+
+void ColumnarBackend::dump(bool buffered) {
+    backend->dump(buffered);
+}
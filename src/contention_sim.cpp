@@ -58,10 +58,12 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    workStealing = _workStealing;
     threadsDone = 0;
+    domainsDone = 0;
     limit = 0;
     lastLimit = 0;
     inCSim = false;
@@ -73,6 +75,8 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
+        spin_init(&domains[i].simLock);
+        domains[i].finished = false;
     }
 
     if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
@@ -101,6 +105,15 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
 }
 
 void ContentionSim::postInit() {
+#if PQ_RECORD_STREAMS
+    for (uint32_t i = 0; i < numDomains; i++) {
+        std::stringstream ss;
+        ss << zinfo->outputDir << "/pq-domain-" << i << ".bin";
+        FILE* f = fopen(ss.str().c_str(), "w");
+        if (!f) panic("Could not open %s for writing", ss.str().c_str());
+        domains[i].pq.setRecordFile(f);
+    }
+#endif
     for (uint32_t i = 0; i < zinfo->numCores; i++) {
         TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
         if (tcore) {
@@ -138,6 +151,17 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+        ProxyStat* farEnqStat = new ProxyStat();
+        farEnqStat->init("farEnqs", "Events enqueued beyond the event queue's near window", &domains[i].pq.profFarEnqueues);
+        domStat->append(farEnqStat);
+        ProxyStat* ovfEnqStat = new ProxyStat();
+        ovfEnqStat->init("ovfEnqs", "Events enqueued beyond the event queue's far wheel", &domains[i].pq.profOverflowEnqueues);
+        domStat->append(ovfEnqStat);
+        if (workStealing) {
+            new (&domains[i].profStolen) Counter();
+            domains[i].profStolen.init("stolen", "Event batches simulated by another thread (work stealing)");
+            domStat->append(&domains[i].profStolen);
+        }
         objStat->append(domStat);
     }
     parentStat->append(objStat);
@@ -157,6 +181,11 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (workStealing) {
+        for (uint32_t i = 0; i < numDomains; i++) domains[i].finished = false;
+        domainsDone = 0;
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -276,7 +305,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (workStealing) simulatePhaseThreadStealing(thid);
+        else simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
@@ -410,6 +440,84 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Work-stealing weave phase. During the weave phase, domains only interact
+ * through CrossingEvents, which poll the source domain's curCycle and requeue
+ * themselves until it's safe to proceed. So any thread can simulate any
+ * domain, as long as only one does so at a time. Each thread first simulates
+ * its own domains in batches; when none of them is available, it steals
+ * unfinished domains from other threads instead of idling.
+ */
+void ContentionSim::simulatePhaseThreadStealing(uint32_t thid) {
+    SimThreadData& th = simThreads[thid];
+    uint32_t victim = thid;
+    while (domainsDone < numDomains) {
+        bool progress = false;
+        for (uint32_t i = th.firstDomain; i < th.supDomain; i++) {
+            progress |= simulateDomainBatch(i, false);
+        }
+        if (progress) continue;
+
+        //Nothing to do locally, steal a batch, round-robin across victims
+        for (uint32_t v = 0; v < numSimThreads - 1 && !progress; v++) {
+            victim = (victim + 1 == numSimThreads)? 0 : victim + 1;
+            if (victim == thid) victim = (victim + 1 == numSimThreads)? 0 : victim + 1;
+            for (uint32_t i = simThreads[victim].firstDomain; i < simThreads[victim].supDomain; i++) {
+                if (simulateDomainBatch(i, true)) {
+                    progress = true;
+                    break;
+                }
+            }
+        }
+        if (!progress) _mm_pause();
+    }
+}
+
+/* Simulates up to WEAVE_STEAL_BATCH events of a domain, if no other thread is
+ * simulating it. Stops early if the domain stalls on a crossing, so that
+ * other domains can advance. Returns true if the domain made progress, i.e.,
+ * it ran at least one event that was not just a stalled crossing polling its
+ * source domain.
+ */
+bool ContentionSim::simulateDomainBatch(uint32_t d, bool stolen) {
+    DomainData& domain = domains[d];
+    if (domain.finished || spin_trylock(&domain.simLock)) return false;
+    if (domain.finished) { //finished while we were grabbing the lock
+        spin_unlock(&domain.simLock);
+        return false;
+    }
+    domain.profTime.start();  // under simLock, so whichever thread simulates the domain accounts for it
+
+    bool progress = false;
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
+    for (uint32_t e = 0; e < WEAVE_STEAL_BATCH; e++) {
+        if (!pq.size() || pq.firstCycle() > limit) {
+            domain.curCycle = limit;
+            domain.finished = true;
+            __sync_fetch_and_add(&domainsDone, 1);
+            break;
+        }
+
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        if (cycle != domain.curCycle) domain.curCycle = cycle;
+        if (domain.prio == 0) {
+            te->run(cycle);
+            progress = true;
+        } else { //stalled on a crossing, see simulatePhaseThread
+            te->state = EV_RUNNING;
+            te->simulate(cycle);
+        }
+        domain.curCycle = pq.size()? pq.firstCycle() : limit;
+        domain.queuePrio = domain.curCycle;
+        if (domain.prio != 0) break;
+    }
+    if (stolen) domain.profStolen.inc();
+    domain.profTime.end();
+
+    spin_unlock(&domain.simLock);
+    return progress;
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -49,6 +49,9 @@ class CrossingEvent;
 
 #define PQ_BLOCKS 1024
 
+//In work-stealing mode, max events simulated per domain before releasing it
+#define WEAVE_STEAL_BATCH 64
+
 class ContentionSim : public GlobAlloc {
     private:
         struct CompareEvents : public std::binary_function<TimingEvent*, TimingEvent*, bool> {
@@ -74,9 +77,14 @@ class ContentionSim : public GlobAlloc {
             uint32_t prio;
             uint64_t queuePrio;
 
+            //Work-stealing mode only
+            lock_t simLock; //held by whichever thread is simulating this domain
+            volatile bool finished; //no more events this phase
+
             PAD();
 
             ClockStat profTime;
+            Counter profStolen;
 
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
@@ -106,6 +114,7 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool workStealing;
 
         PAD();
 
@@ -117,6 +126,7 @@ class ContentionSim : public GlobAlloc {
 
         volatile uint32_t threadsDone;
         volatile uint32_t threadTicket; //used only at init
+        volatile uint32_t domainsDone; //work-stealing mode only
 
         volatile bool inCSim; //true when inside contention simulation
 
@@ -126,7 +136,7 @@ class ContentionSim : public GlobAlloc {
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing = false);
 
         void initStats(AggregateStat* parentStat);
 
@@ -162,6 +172,8 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void simulatePhaseThreadStealing(uint32_t thid);
+        bool simulateDomainBatch(uint32_t d, bool stolen);
 
         static void SimThreadTrampoline(void* arg);
 };
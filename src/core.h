@@ -29,6 +29,7 @@
 #include <stdint.h>
 #include "decoder.h"
 #include "g_std/g_string.h"
+#include "memory_hierarchy.h"
 #include "stats.h"
 
 struct BblInfo {
@@ -84,6 +85,11 @@ class Core : public GlobAlloc {
         virtual void leave() {}
         virtual void join() {}
 
+        //Functional warming hooks for sampled simulation. Called from fast-forward analysis routines while the thread is
+        //not scheduled on this core; should update microarchitectural state (caches, predictors) but not timing
+        virtual void warmDataAccess(Address addr, bool isWrite) {}
+        virtual void warmBranch(Address branchPc, bool taken) {}
+
         virtual InstrFuncPtrs GetFuncPtrs() = 0;
 };
 
@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 #include "bithacks.h"
+#include "checkpoint.h"
 #include "config.h"  // for Tokenize
 #include "contention_sim.h"
 #include "event_recorder.h"
@@ -238,6 +239,44 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     parentStat->append(memStats);
 }
 
+void DDRMemory::saveState(CheckpointWriter& cw) {
+    cw.pushScope(name.c_str());
+    cw.beginRecord("mem", "DDR");
+    cw.write(ranksPerChannel);
+    cw.write(banksPerRank);
+    for (auto& rankBanks : banks) {
+        for (Bank& bank : rankBanks) {
+            cw.write(bank.open);
+            cw.write(bank.openRow);
+        }
+    }
+    cw.endRecord();
+    cw.popScope();
+}
+
+void DDRMemory::restoreState(CheckpointReader& cr) {
+    cr.pushScope(name.c_str());
+    if (cr.contains("mem")) {
+        cr.beginRecord("mem", "DDR");
+        uint32_t savedRanks = cr.read<uint32_t>();
+        uint32_t savedBanks = cr.read<uint32_t>();
+        if (savedRanks != ranksPerChannel || savedBanks != banksPerRank) {
+            panic("%s: checkpoint has %d ranks x %d banks, controller has %d x %d", name.c_str(), savedRanks, savedBanks, ranksPerChannel, banksPerRank);
+        }
+        for (auto& rankBanks : banks) {
+            for (Bank& bank : rankBanks) {
+                bank.open = cr.read<bool>();
+                bank.openRow = cr.read<uint64_t>();
+                bank.curRowHits = 0;
+            }
+        }
+        cr.endRecord();
+    } else {
+        warn("[%s] Not in checkpoint, starting with closed rows", name.c_str());
+    }
+    cr.popScope();
+}
+
 /* Bound phase interface */
 
 uint64_t DDRMemory::access(MemReq& req) {
@@ -261,7 +300,7 @@ uint64_t DDRMemory::access(MemReq& req) {
     } else {
         bool isWrite = (req.type == PUTX);
         uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency);
-        if (zinfo->eventRecorders[req.srcId]) {
+        if (!req.is(MemReq::WARMUP) && zinfo->eventRecorders[req.srcId]) {
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
                     isWrite, req.lineAddr, domain, preDelay, isWrite? postDelayWr : postDelayRd);
             memEv->setMinStartCycle(req.cycle);
@@ -266,6 +266,10 @@ class DDRMemory : public MemObject {
         void initStats(AggregateStat* parentStat);
         const char* getName() {return name.c_str();}
 
+        // Checkpoints hold the open rows; timing constraints and queued requests are transient
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
+
         // Bound phase interface
         uint64_t access(MemReq& req);
 
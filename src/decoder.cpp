@@ -32,8 +32,10 @@
 #include <string>
 #include <vector>
 #include "core.h"
+#include "decoder_cache.h"
 #include "locks.h"
 #include "log.h"
+#include "zsim.h"
 
 extern "C" {
 #include "xed-interface.h"
@@ -1258,11 +1260,45 @@ static std::vector<uint32_t>* bblApproxOpcodes[MAX_BBLS];
 
 #endif
 
+/* Computes the decoded BBL cache key and check hashes (see decoder_cache.h), returns false if the code can't be read.
+ * Decoding depends only on the code bytes and, through the predecoder model, on the alignment within a 16-byte block.
+ */
+static bool BblCacheKey(BBL bbl, uint64_t* key, uint64_t* check) {
+    ADDRINT addr = BBL_Address(bbl);
+    uint32_t size = BBL_Size(bbl);
+    uint8_t buf[size];
+    if (PIN_SafeCopy(buf, (VOID*)addr, size) != size) return false;
+
+    uint64_t h1 = 0xcbf29ce484222325ul ^ (addr & 0xf);  // FNV-1a
+    uint64_t h2 = 0x9e3779b97f4a7c15ul + BBL_NumIns(bbl);  // multiply-xorshift, independent of h1
+    for (uint32_t i = 0; i < size; i++) {
+        h1 = (h1 ^ buf[i])*0x100000001b3ul;
+        h2 = (h2 ^ buf[i])*0xff51afd7ed558ccdul;
+        h2 ^= h2 >> 32;
+    }
+    *key = h1 ^ ((uint64_t)size << 48);
+    *check = h2 ^ (addr & 0xf);
+    return true;
+}
+
 BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     uint32_t instrs = BBL_NumIns(bbl);
     uint32_t bytes = BBL_Size(bbl);
     BblInfo* bblInfo;
 
+#ifndef BBL_PROFILING  // profiling needs per-BBL indexes, so it always decodes
+    DecodedBblCache* cache = oooDecoding? zinfo->bblCache : nullptr;
+    uint64_t cacheKey, cacheCheck;
+    if (cache) {
+        if (BblCacheKey(bbl, &cacheKey, &cacheCheck)) {
+            bblInfo = cache->lookup(cacheKey, cacheCheck, BBL_Address(bbl));
+            if (bblInfo) return bblInfo;
+        } else {
+            cache = nullptr;
+        }
+    }
+#endif
+
     if (oooDecoding) {
         //Decode BBL
         uint32_t approxInstrs = 0;
@@ -1447,6 +1483,10 @@ BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     bblInfo->instrs = instrs;
     bblInfo->bytes = bytes;
 
+#ifndef BBL_PROFILING
+    if (cache) cache->insert(cacheKey, cacheCheck, bblInfo);
+#endif
+
     return bblInfo;
 }
 
@@ -0,0 +1,242 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decoder_cache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+#define BBL_CACHE_MAGIC "ZBBLCCH"
+#define BBL_CACHE_VERSION 1  // bump on any change to the decoder's output
+
+struct BblCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t regLast;
+    uint32_t uopBytes;
+    uint32_t pad;
+    uint64_t numEntries;
+};
+
+// Followed by uops DynUops
+struct BblCacheRecord {
+    uint64_t key;
+    uint64_t check;
+    uint32_t instrs;
+    uint32_t bytes;
+    uint32_t uops;
+    uint32_t approxInstrs;
+};
+
+// Per-process descriptor of the cache file: -1 if not opened yet, -2 if unusable
+static int cacheFd = -1;
+
+DecodedBblCache::DecodedBblCache(const char* _fname) : fname(_fname), fileIno(0), fileSize(0), fileMtime(0), loaded(0), hits(0), misses(0) {
+    futex_init(&lock);
+    load();
+}
+
+uint32_t DecodedBblCache::bblInfoBytes(uint32_t uops) {
+    return offsetof(BblInfo, oooBbl) + DynBbl::bytes(uops);
+}
+
+BblInfo* DecodedBblCache::lookup(uint64_t key, uint64_t check, uint64_t addr) {
+    futex_lock(&lock);
+    g_unordered_map<uint64_t, Entry>::iterator it = entries.find(key);
+    if (it == entries.end() || it->second.check != check) {
+        misses++;
+        futex_unlock(&lock);
+        return nullptr;
+    }
+
+    Entry& e = it->second;
+    if (!e.bblInfo) {
+        // First hit on a loaded entry, read it under the lock so it's read once. It's handed out as is and
+        // becomes the template, since BblInfos are never modified or freed.
+        BblInfo* bblInfo = read(key, e);
+        if (bblInfo) {
+            hits++;
+            bblInfo->oooBbl[0].addr = addr;
+            e.bblInfo = bblInfo;
+        } else {
+            misses++;  // the caller decodes it and insert() fills the entry
+        }
+        futex_unlock(&lock);
+        return bblInfo;
+    }
+    hits++;
+    const BblInfo* tmpl = e.bblInfo;
+    futex_unlock(&lock);  // templates are never removed or modified
+
+    uint32_t objBytes = bblInfoBytes(tmpl->oooBbl[0].uops);
+    BblInfo* bblInfo = static_cast<BblInfo*>(gm_malloc(objBytes));
+    memcpy(bblInfo, tmpl, objBytes);
+    bblInfo->oooBbl[0].addr = addr;
+    return bblInfo;
+}
+
+void DecodedBblCache::insert(uint64_t key, uint64_t check, const BblInfo* bblInfo) {
+    // Decoded BblInfos are never modified or freed, so the caller's is the template, no copy needed
+    futex_lock(&lock);
+    Entry e = {check, const_cast<BblInfo*>(bblInfo), 0};
+    std::pair<g_unordered_map<uint64_t, Entry>::iterator, bool> res = entries.insert(std::make_pair(key, e));
+    if (!res.second && !res.first->second.bblInfo && res.first->second.check == check) {
+        res.first->second.bblInfo = e.bblInfo;  // loaded but unreadable in this process
+    }
+    futex_unlock(&lock);  // if another process decoded it first, keep its template
+}
+
+int DecodedBblCache::getFd() {
+    if (cacheFd == -1) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (uint64_t)st.st_ino == fileIno &&
+                (uint64_t)st.st_size == fileSize && (uint64_t)st.st_mtime == fileMtime) {
+            cacheFd = fd;
+        } else {
+            if (fd >= 0) close(fd);
+            warn("Decoded BBL cache %s changed since it was loaded, not reading it", fname.c_str());
+            cacheFd = -2;
+        }
+    }
+    return cacheFd;
+}
+
+BblInfo* DecodedBblCache::read(uint64_t key, const Entry& e) {
+    int fd = getFd();
+    if (fd < 0) return nullptr;
+
+    BblCacheRecord rec;
+    if (pread(fd, &rec, sizeof(rec), e.offset) != sizeof(rec) || rec.key != key || rec.check != e.check) {
+        warn("Decoded BBL cache %s: bad record at offset %ld", fname.c_str(), e.offset);
+        return nullptr;
+    }
+    BblInfo* bblInfo = static_cast<BblInfo*>(gm_malloc(bblInfoBytes(rec.uops)));
+    bblInfo->instrs = rec.instrs;
+    bblInfo->bytes = rec.bytes;
+    DynBbl& dynBbl = bblInfo->oooBbl[0];
+    dynBbl.addr = 0;
+    dynBbl.uops = rec.uops;
+    dynBbl.approxInstrs = rec.approxInstrs;
+    ssize_t uopBytes = rec.uops*sizeof(DynUop);
+    if (pread(fd, dynBbl.uop, uopBytes, e.offset + sizeof(rec)) != uopBytes) {
+        warn("Decoded BBL cache %s: bad record at offset %ld", fname.c_str(), e.offset);
+        gm_free(bblInfo);
+        return nullptr;
+    }
+    return bblInfo;
+}
+
+void DecodedBblCache::load() {
+    FILE* f = fopen(fname.c_str(), "r");
+    if (!f) {
+        info("Decoded BBL cache %s not found, will create it", fname.c_str());
+        return;
+    }
+
+    BblCacheHeader hdr;
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 ||
+            fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, BBL_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+            hdr.version != BBL_CACHE_VERSION || hdr.regLast != REG_LAST || hdr.uopBytes != sizeof(DynUop)) {
+        warn("Decoded BBL cache %s is stale or corrupted, ignoring it", fname.c_str());
+        fclose(f);
+        return;
+    }
+    fileIno = st.st_ino;
+    fileSize = st.st_size;
+    fileMtime = st.st_mtime;
+
+    // Only index records; uops are read on the first hit (see read())
+    uint64_t offset = sizeof(hdr);
+    for (uint64_t i = 0; i < hdr.numEntries; i++) {
+        BblCacheRecord rec;
+        if (fread(&rec, sizeof(rec), 1, f) != 1 || offset + sizeof(rec) + rec.uops*sizeof(DynUop) > fileSize ||
+                fseek(f, rec.uops*sizeof(DynUop), SEEK_CUR) != 0) {
+            warn("Decoded BBL cache %s is truncated, loaded %ld/%ld entries", fname.c_str(), i, hdr.numEntries);
+            break;
+        }
+        Entry e = {rec.check, nullptr, offset};
+        entries.insert(std::make_pair(rec.key, e));
+        offset += sizeof(rec) + rec.uops*sizeof(DynUop);
+    }
+    fclose(f);
+    loaded = entries.size();
+    info("Indexed %ld decoded BBLs from %s", loaded, fname.c_str());
+}
+
+void DecodedBblCache::save() {
+    futex_lock(&lock);
+    info("Decoded BBL cache: %ld hits, %ld misses", hits, misses);
+    if (entries.size() == loaded) {
+        futex_unlock(&lock);
+        return;  // nothing new
+    }
+
+    // Write to a temporary file and rename it, so concurrent simulations never see a partial cache
+    std::string tmpName = std::string(fname.c_str()) + ".tmp";
+    FILE* f = fopen(tmpName.c_str(), "w");
+    if (!f) {
+        warn("Could not write decoded BBL cache %s", tmpName.c_str());
+        futex_unlock(&lock);
+        return;
+    }
+
+    BblCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BBL_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = BBL_CACHE_VERSION;
+    hdr.regLast = REG_LAST;
+    hdr.uopBytes = sizeof(DynUop);
+    hdr.numEntries = 0;  // rewritten at the end, loaded entries that can't be read are dropped
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+    for (auto& kv : entries) {
+        // Entries not hit in this run are copied from the old file
+        BblInfo* bblInfo = kv.second.bblInfo? kv.second.bblInfo : read(kv.first, kv.second);
+        if (!bblInfo) continue;
+        const DynBbl& dynBbl = bblInfo->oooBbl[0];
+        BblCacheRecord rec = {kv.first, kv.second.check, bblInfo->instrs, bblInfo->bytes, dynBbl.uops, dynBbl.approxInstrs};
+        ok = ok && fwrite(&rec, sizeof(rec), 1, f) == 1;
+        ok = ok && fwrite(dynBbl.uop, sizeof(DynUop), dynBbl.uops, f) == dynBbl.uops;
+        if (!kv.second.bblInfo) gm_free(bblInfo);
+        hdr.numEntries++;
+    }
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && rename(tmpName.c_str(), fname.c_str()) == 0) {
+        info("Saved %ld decoded BBLs (%ld new) to %s", hdr.numEntries, entries.size() - loaded, fname.c_str());
+        loaded = entries.size();
+    } else {
+        warn("Could not write decoded BBL cache %s", fname.c_str());
+        unlink(tmpName.c_str());
+    }
+    futex_unlock(&lock);
+}
@@ -0,0 +1,90 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODER_CACHE_H_
+#define DECODER_CACHE_H_
+
+#include "core.h"
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "locks.h"
+
+/* Persistent cache of decoded (OOO) BBLs, so that repeat runs of the same
+ * binaries skip uop decoding, which dominates startup for large codes.
+ *
+ * Entries are keyed by a hash of the BBL's code bytes and its alignment within
+ * a 16-byte fetch block, which is all decoding depends on. This makes them
+ * independent of where images are loaded (ASLR, shared libraries in different
+ * processes) and covers JITed code too; a second, independent hash guards
+ * against key collisions. The cache lives in global memory, so all simulated
+ * processes share it, and is written back at the end of the simulation.
+ *
+ * Decoded uops hold Pin register numbers and depend on the decoder, so the
+ * file is tagged with a version, REG_LAST, and the DynUop size, and stale
+ * files are ignored.
+ *
+ * The file holds BBLs from every binary ever simulated with it, so loading
+ * only indexes it (key, check, and file offset per BBL); uops are read from
+ * the file on the first hit. Each process reads through its own descriptor,
+ * which is only used if the file is still the one that was indexed.
+ */
+class DecodedBblCache : public GlobAlloc {
+    private:
+        struct Entry {
+            uint64_t check;
+            BblInfo* bblInfo;  // first BblInfo handed out or inserted, copied with the address patched on lookups; nullptr if not read yet
+            uint64_t offset;  // of the record in the file, if bblInfo is nullptr
+        };
+
+        g_unordered_map<uint64_t, Entry> entries;
+        g_string fname;
+        lock_t lock;
+        uint64_t fileIno;  // identifies the indexed file, so processes don't read a file another simulation replaced
+        uint64_t fileSize;
+        uint64_t fileMtime;
+        uint64_t loaded;
+        uint64_t hits;
+        uint64_t misses;
+
+    public:
+        explicit DecodedBblCache(const char* _fname);
+
+        // Returns a new copy of the cached BblInfo for the BBL at addr, or nullptr if it's not cached
+        BblInfo* lookup(uint64_t key, uint64_t check, uint64_t addr);
+
+        void insert(uint64_t key, uint64_t check, const BblInfo* bblInfo);
+
+        // Writes the cache out, if it has new entries
+        void save();
+
+    private:
+        void load();
+        BblInfo* read(uint64_t key, const Entry& e);
+        int getFd();
+        static uint32_t bblInfoBytes(uint32_t uops);
+};
+
+#endif  // DECODER_CACHE_H_
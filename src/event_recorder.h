@@ -78,6 +78,10 @@ class EventRecorder : public GlobAlloc {
             return slabAlloc.alloc(sz);
         }
 
+        const slab::SlabAlloc& getSlabAlloc() const {
+            return slabAlloc;
+        }
+
         //Event recording interface
 
         void pushRecord(const TimingRecord& rec) {
@@ -39,6 +39,14 @@
  * holds the most recently used line in each set. Accesses check the filter array,
  * and then go through the normal access path. Because there is one line per set,
  * it is fine to do this without grabbing a lock.
+ *
+ * The filter array can hold several lines per set (filterWays, replaced FIFO),
+ * and lines displaced from it can go to a small fully-associative victim filter
+ * (filterVictims), so that a few hot lines aliasing in a set do not thrash
+ * through replace(). Hits in either are still lock-free, since only the owning
+ * core fills entries and invalidations only clear them. With more than one line
+ * per set, the L1 can evict a line that is still in the filter, so Cache
+ * notifies us of evictions and we drop those lines, just like invalidations.
  */
 
 class FilterCache : public Cache {
@@ -49,29 +57,46 @@ class FilterCache : public Cache {
             volatile uint64_t availCycle;
 
             void clear() {wrAddr = 0; rdAddr = 0; availCycle = 0;}
+            void inval() {wrAddr = -1L; rdAddr = -1L;}
+            bool isEmpty() const {return rdAddr == (Address)-1L || rdAddr == 0;}
         };
 
-        //Replicates the most accessed line of each set in the cache
+        //Replicates the most accessed lines of each set in the cache, filterWays per set
         FilterEntry* filterArray;
         Address setMask;
         uint32_t numSets;
+        uint32_t filterWays;
+        uint32_t* nextWay; //per set, FIFO replacement
+        FilterEntry* victims;
+        uint32_t numVictims;
+        uint32_t nextVictim;
         uint32_t srcId; //should match the core
         uint32_t reqFlags;
 
         lock_t filterLock;
         uint64_t fGETSHit, fGETXHit;
+        uint64_t fvGETSHit, fvGETXHit;
 
     public:
         FilterCache(uint32_t _numSets, uint32_t _numLines, CC* _cc, CacheArray* _array,
-                ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name)
+                ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name,
+                uint32_t _filterWays = 1, uint32_t _filterVictims = 0)
             : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name)
         {
             numSets = _numSets;
             setMask = numSets - 1;
-            filterArray = gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numSets);
-            for (uint32_t i = 0; i < numSets; i++) filterArray[i].clear();
+            filterWays = _filterWays;
+            assert(filterWays > 0);
+            filterArray = gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numSets*filterWays);
+            for (uint32_t i = 0; i < numSets*filterWays; i++) filterArray[i].clear();
+            nextWay = gm_calloc<uint32_t>(numSets);
+            numVictims = _filterVictims;
+            victims = numVictims? gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numVictims) : nullptr;
+            for (uint32_t i = 0; i < numVictims; i++) victims[i].clear();
+            nextVictim = 0;
             futex_init(&filterLock);
             fGETSHit = fGETXHit = 0;
+            fvGETSHit = fvGETXHit = 0;
             srcId = -1;
             reqFlags = 0;
         }
@@ -84,6 +109,15 @@ class FilterCache : public Cache {
             reqFlags = flags;
         }
 
+        //Filter entries are not checkpointed; we start with empty filters, which are trivially backed by the restored lines
+        void restoreState(CheckpointReader& cr) {
+            Cache::restoreState(cr);
+            for (uint32_t i = 0; i < numSets*filterWays; i++) filterArray[i].clear();
+            for (uint32_t i = 0; i < numSets; i++) nextWay[i] = 0;
+            for (uint32_t i = 0; i < numVictims; i++) victims[i].clear();
+            nextVictim = 0;
+        }
+
         void initStats(AggregateStat* parentStat) {
             AggregateStat* cacheStat = new AggregateStat();
             cacheStat->init(name.c_str(), "Filter cache stats");
@@ -95,6 +129,15 @@ class FilterCache : public Cache {
             cacheStat->append(fgetsStat);
             cacheStat->append(fgetxStat);
 
+            if (numVictims) {
+                ProxyStat* fvgetsStat = new ProxyStat();
+                fvgetsStat->init("fvhGETS", "Victim filter GETS hits", &fvGETSHit);
+                ProxyStat* fvgetxStat = new ProxyStat();
+                fvgetxStat->init("fvhGETX", "Victim filter GETX hits", &fvGETXHit);
+                cacheStat->append(fvgetsStat);
+                cacheStat->append(fvgetxStat);
+            }
+
             initCacheStats(cacheStat);
             parentStat->append(cacheStat);
         }
@@ -102,27 +145,45 @@ class FilterCache : public Cache {
         inline uint64_t load(Address vAddr, uint64_t curCycle) {
             Address vLineAddr = vAddr >> lineBits;
             uint32_t idx = vLineAddr & setMask;
-            uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
-            if (vLineAddr == filterArray[idx].rdAddr) {
-                fGETSHit++;
-                return MAX(curCycle, availCycle);
-            } else {
-                return replace(vLineAddr, idx, true, curCycle);
+            FilterEntry* set = &filterArray[idx*filterWays];
+            for (uint32_t w = 0; w < filterWays; w++) {
+                uint64_t availCycle = set[w].availCycle; //read before, careful with ordering to avoid timing races
+                if (vLineAddr == set[w].rdAddr) {
+                    fGETSHit++;
+                    return MAX(curCycle, availCycle);
+                }
             }
+            for (uint32_t v = 0; v < numVictims; v++) {
+                uint64_t availCycle = victims[v].availCycle;
+                if (vLineAddr == victims[v].rdAddr) {
+                    fvGETSHit++;
+                    return MAX(curCycle, availCycle);
+                }
+            }
+            return replace(vLineAddr, idx, true, curCycle);
         }
 
         inline uint64_t store(Address vAddr, uint64_t curCycle) {
             Address vLineAddr = vAddr >> lineBits;
             uint32_t idx = vLineAddr & setMask;
-            uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
-            if (vLineAddr == filterArray[idx].wrAddr) {
-                fGETXHit++;
-                //NOTE: Stores don't modify availCycle; we'll catch matches in the core
-                //filterArray[idx].availCycle = curCycle; //do optimistic store-load forwarding
-                return MAX(curCycle, availCycle);
-            } else {
-                return replace(vLineAddr, idx, false, curCycle);
+            FilterEntry* set = &filterArray[idx*filterWays];
+            for (uint32_t w = 0; w < filterWays; w++) {
+                uint64_t availCycle = set[w].availCycle; //read before, careful with ordering to avoid timing races
+                if (vLineAddr == set[w].wrAddr) {
+                    fGETXHit++;
+                    //NOTE: Stores don't modify availCycle; we'll catch matches in the core
+                    //filterArray[idx].availCycle = curCycle; //do optimistic store-load forwarding
+                    return MAX(curCycle, availCycle);
+                }
+            }
+            for (uint32_t v = 0; v < numVictims; v++) {
+                uint64_t availCycle = victims[v].availCycle;
+                if (vLineAddr == victims[v].wrAddr) {
+                    fvGETXHit++;
+                    return MAX(curCycle, availCycle);
+                }
             }
+            return replace(vLineAddr, idx, false, curCycle);
         }
 
         uint64_t replace(Address vLineAddr, uint32_t idx, bool isLoad, uint64_t curCycle) {
@@ -133,29 +194,56 @@ class FilterCache : public Cache {
             uint64_t respCycle  = access(req);
 
             //Due to the way we do the locking, at this point the old address might be invalidated, but we have the new address guaranteed until we release the lock
+            FilterEntry* e = fill(vLineAddr, idx);
 
             //Careful with this order
-            Address oldAddr = filterArray[idx].rdAddr;
-            filterArray[idx].wrAddr = isLoad? -1L : vLineAddr;
-            filterArray[idx].rdAddr = vLineAddr;
+            Address oldAddr = e->rdAddr;
+            e->wrAddr = isLoad? -1L : vLineAddr;
+            e->rdAddr = vLineAddr;
 
             //For LSU simulation purposes, loads bypass stores even to the same line if there is no conflict,
             //(e.g., st to x, ld from x+8) and we implement store-load forwarding at the core.
             //So if this is a load, it always sets availCycle; if it is a store hit, it doesn't
-            if (oldAddr != vLineAddr) filterArray[idx].availCycle = respCycle;
+            if (oldAddr != vLineAddr) e->availCycle = respCycle;
 
             futex_unlock(&filterLock);
             return respCycle;
         }
 
+        /* Functional warming (sampled simulation): brings the line into the
+         * filter array and the hierarchy below with a WARMUP access, which
+         * updates tags and coherence state but records no timing. Does not
+         * count towards the filter hit stats.
+         */
+        void warm(Address vAddr, bool isLoad, uint64_t curCycle) {
+            Address vLineAddr = vAddr >> lineBits;
+            uint32_t idx = vLineAddr & setMask;
+            FilterEntry* set = &filterArray[idx*filterWays];
+            for (uint32_t w = 0; w < filterWays; w++) {
+                if (vLineAddr == (isLoad? set[w].rdAddr : set[w].wrAddr)) return;
+            }
+            for (uint32_t v = 0; v < numVictims; v++) {
+                if (vLineAddr == (isLoad? victims[v].rdAddr : victims[v].wrAddr)) return;
+            }
+
+            Address pLineAddr = procMask | vLineAddr;
+            MESIState dummyState = MESIState::I;
+            futex_lock(&filterLock);
+            MemReq req = {pLineAddr, isLoad? GETS : GETX, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, reqFlags | MemReq::WARMUP};
+            access(req);
+
+            FilterEntry* e = fill(vLineAddr, idx);
+            Address oldAddr = e->rdAddr;
+            e->wrAddr = isLoad? -1L : vLineAddr;
+            e->rdAddr = vLineAddr;
+            if (oldAddr != vLineAddr) e->availCycle = 0; //no timing, line is available as soon as we go back to detailed mode
+            futex_unlock(&filterLock);
+        }
+
         uint64_t invalidate(const InvReq& req) {
-            Cache::startInvalidate();  // grabs cache's downLock
+            Cache::startInvalidate(req);  // grabs cache's downLock
             futex_lock(&filterLock);
-            uint32_t idx = req.lineAddr & setMask; //works because of how virtual<->physical is done...
-            if ((filterArray[idx].rdAddr | procMask) == req.lineAddr) { //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
-                filterArray[idx].wrAddr = -1L;
-                filterArray[idx].rdAddr = -1L;
-            }
+            dropLine(req.lineAddr);
             uint64_t respCycle = Cache::finishInvalidate(req); // releases cache's downLock
             futex_unlock(&filterLock);
             return respCycle;
@@ -163,9 +251,67 @@ class FilterCache : public Cache {
 
         void contextSwitch() {
             futex_lock(&filterLock);
-            for (uint32_t i = 0; i < numSets; i++) filterArray[i].clear();
+            for (uint32_t i = 0; i < numSets*filterWays; i++) filterArray[i].clear();
+            for (uint32_t i = 0; i < numVictims; i++) victims[i].clear();
+            futex_unlock(&filterLock);
+        }
+
+    protected:
+        // Called by Cache::access with our cc lock held (but not filterLock), same lock order as invalidations
+        void evicted(Address wbLineAddr) {
+            if (filterWays == 1 && !numVictims) return; //the evicting access will replace the single line in the set
+            futex_lock(&filterLock);
+            dropLine(wbLineAddr);
             futex_unlock(&filterLock);
         }
+
+    private:
+        // Clears all copies of a physical line. Must hold filterLock.
+        void dropLine(Address pLineAddr) {
+            uint32_t idx = pLineAddr & setMask; //works because of how virtual<->physical is done...
+            FilterEntry* set = &filterArray[idx*filterWays];
+            //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
+            for (uint32_t w = 0; w < filterWays; w++) {
+                if ((set[w].rdAddr | procMask) == pLineAddr) set[w].inval();
+            }
+            for (uint32_t v = 0; v < numVictims; v++) {
+                if ((victims[v].rdAddr | procMask) == pLineAddr) victims[v].inval();
+            }
+        }
+
+        /* Returns the entry that should hold vLineAddr: the one already holding it, or a new way in
+         * its set. The line displaced from that way, if any, moves to the victim filter. Must hold filterLock.
+         */
+        FilterEntry* fill(Address vLineAddr, uint32_t idx) {
+            FilterEntry* set = &filterArray[idx*filterWays];
+            if (filterWays == 1 && !numVictims) return &set[0];
+
+            uint32_t way = filterWays;
+            for (uint32_t w = 0; w < filterWays; w++) {
+                if (set[w].rdAddr == vLineAddr) return &set[w];
+                if (way == filterWays && set[w].isEmpty()) way = w;
+            }
+            //Not in the set; drop the victim filter copy (if any), the line moves back to the set
+            for (uint32_t v = 0; v < numVictims; v++) {
+                if (victims[v].rdAddr == vLineAddr) victims[v].inval();
+            }
+
+            if (way == filterWays) {
+                way = nextWay[idx];
+                nextWay[idx] = (way + 1 == filterWays)? 0 : way + 1;
+            }
+            FilterEntry* e = &set[way];
+            if (numVictims && !e->isEmpty()) {
+                FilterEntry* v = &victims[nextVictim];
+                nextVictim = (nextVictim + 1 == numVictims)? 0 : nextVictim + 1;
+                v->inval();
+                v->availCycle = e->availCycle;
+                v->wrAddr = e->wrAddr;
+                v->rdAddr = e->rdAddr;
+            }
+            e->inval();
+            return e;
+        }
 };
 
 #endif  // FILTER_CACHE_H_
@@ -24,6 +24,7 @@
  */
 
 #include "hash.h"
+#include <immintrin.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "log.h"
@@ -123,6 +124,57 @@ uint64_t H3HashFamily::hash(uint32_t id, uint64_t val) {
     return res;
 }
 
+H3TableHashFamily::H3TableHashFamily(uint32_t numFunctions, uint32_t outputBits, uint64_t randSeed) : numFuncs(numFunctions) {
+    H3HashFamily h3(numFunctions, outputBits, randSeed);
+    table = gm_calloc<uint64_t>(8*256*numFuncs);
+    for (uint32_t b = 0; b < 8; b++) {
+        for (uint32_t v = 0; v < 256; v++) {
+            for (uint32_t f = 0; f < numFuncs; f++) {
+                table[(b*256 + v)*numFuncs + f] = h3.hash(f, ((uint64_t)v) << (8*b));
+            }
+        }
+    }
+}
+
+H3TableHashFamily::~H3TableHashFamily() {
+    gm_free(table);
+}
+
+uint64_t H3TableHashFamily::hash(uint32_t id, uint64_t val) {
+    assert(id < numFuncs);
+    uint64_t res = 0;
+    for (uint32_t b = 0; b < 8; b++) {
+        res ^= table[(b*256 + ((val >> (8*b)) & 0xff))*numFuncs + id];
+    }
+    return res;
+}
+
+void H3TableHashFamily::hashAll(uint64_t val, uint32_t n, uint64_t* res) {
+    assert(n <= numFuncs);
+    const uint64_t* rows[8];
+    for (uint32_t b = 0; b < 8; b++) rows[b] = &table[(b*256 + ((val >> (8*b)) & 0xff))*numFuncs];
+
+    uint32_t f = 0;
+#if defined(__AVX2__)
+    for (; f + 4 <= n; f += 4) {
+        __m256i acc = _mm256_loadu_si256((const __m256i*)(rows[0] + f));
+        for (uint32_t b = 1; b < 8; b++) acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i*)(rows[b] + f)));
+        _mm256_storeu_si256((__m256i*)(res + f), acc);
+    }
+#elif defined(__SSE2__)
+    for (; f + 2 <= n; f += 2) {
+        __m128i acc = _mm_loadu_si128((const __m128i*)(rows[0] + f));
+        for (uint32_t b = 1; b < 8; b++) acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i*)(rows[b] + f)));
+        _mm_storeu_si128((__m128i*)(res + f), acc);
+    }
+#endif
+    for (; f < n; f++) {
+        uint64_t r = 0;
+        for (uint32_t b = 0; b < 8; b++) r ^= rows[b][f];
+        res[f] = r;
+    }
+}
+
 #if _WITH_POLARSSL_
 
 #include "polarssl/sha1.h"
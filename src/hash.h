@@ -35,6 +35,13 @@ class HashFamily : public GlobAlloc {
         virtual ~HashFamily() {}
 
         virtual uint64_t hash(uint32_t id, uint64_t val) = 0;
+
+        /* Computes functions 0..n-1 on the same value, res[i] = hash(i, val).
+         * Families that can share work across functions override this.
+         */
+        virtual void hashAll(uint64_t val, uint32_t n, uint64_t* res) {
+            for (uint32_t i = 0; i < n; i++) res[i] = hash(i, val);
+        }
 };
 
 class H3HashFamily : public HashFamily {
@@ -48,6 +55,25 @@ class H3HashFamily : public HashFamily {
         uint64_t hash(uint32_t id, uint64_t val);
 };
 
+/* Table-driven H3, producing the same hashes as H3HashFamily with the same
+ * parameters. H3 is linear over GF(2), so a hash is the XOR of the hashes of
+ * the value's 8 bytes, which are precomputed (16KB per function). Tables are
+ * laid out with all functions of a (byte, value) pair contiguous, so hashAll()
+ * computes every function with 8 vector loads+XORs per function group
+ * instead of 64 AND/rotate steps per function. Used for zcache walks, which
+ * hash each candidate with all ways' functions.
+ */
+class H3TableHashFamily : public HashFamily {
+    private:
+        const uint32_t numFuncs;
+        uint64_t* table;  // [byte][value][func]
+    public:
+        H3TableHashFamily(uint32_t numFunctions, uint32_t outputBits, uint64_t randSeed = 123132127);
+        virtual ~H3TableHashFamily();
+        uint64_t hash(uint32_t id, uint64_t val);
+        void hashAll(uint64_t val, uint32_t n, uint64_t* res);
+};
+
 class SHA1HashFamily : public HashFamily {
     private:
         int numFuncs;
@@ -5,107 +5,313 @@
 #ifndef HAWKEYE_REPL_H
 #define HAWKEYE_REPL_H
 
+#include "repl_policies.h"
+
+/* Hawkeye (Jain and Lin, ISCA 2016). OPTgen replays Belady's OPT on a few
+ * sampled sets and trains a predictor of cache-friendly vs cache-averse
+ * accesses; the predictor then drives an RRIP-style insertion/promotion policy.
+ *
+ * MemReq carries no PC in zsim, so the predictor is indexed by a signature of
+ * the requester and the line's memory region (as in SHiP-Mem) instead.
+ *
+ * Cost: non-sampled accesses are O(1). Sampled accesses do a hashed,
+ * bounded-associativity sampler lookup and scan at most one reuse interval
+ * of their set's circular occupancy vector (<= 8*ways slots). With the
+ * default 64 sampled sets, the per-access cost is O(1) amortized, independent
+ * of the size of the sampled history.
+ */
 class HawkeyeReplPolicy : public ReplPolicy {
     protected:
+        static const uint8_t RRPV_MAX = 7;
+        static const uint8_t PRED_MAX = 7; // 3-bit saturating counters
+        static const uint8_t PRED_FRIENDLY = 4; // counter >= this -> cache-friendly
+        static const uint32_t REGION_BITS = 6; // 4KB regions with 64B lines
+
+        // data structures for OPTgen
+        class OPTgen : public GlobAlloc {
+            private:
+                static const uint32_t SAMPLER_ASSOC = 8;
+
+                struct SamplerEntry {
+                    uint32_t tag;
+                    uint32_t time; // set-local time of last access
+                    uint16_t sig;
+                    bool valid;
+                };
+
+                uint32_t sets; // number of sampled sets
+                uint32_t ways; // OPT capacity of each set
+                uint32_t histLen; // occupancy vector length, a power of 2
+                uint32_t histMask;
+                uint32_t samplerBuckets; // per sampled set, a power of 2
+
+                // Per-set circular occupancy vectors, histLen entries each
+                uint8_t* occVec;
+                // Per-set local time, advances once per access to the set
+                uint32_t* curTime;
+                // Per-set sampled history, SAMPLER_ASSOC-way hashed buckets
+                SamplerEntry* sampler;
+
+            public:
+                OPTgen(uint32_t _sets, uint32_t _ways) : sets(_sets), ways(_ways) {
+                    assert(ways < 256);
+                    // 8x the associativity captures most of OPT's reuse (Jain and Lin)
+                    histLen = 1;
+                    while (histLen < 8*ways) histLen <<= 1;
+                    histMask = histLen - 1;
+                    // 2x the live lines in the history window, so overflows are rare
+                    samplerBuckets = MAX(2*histLen/SAMPLER_ASSOC, 1u);
+                    occVec = gm_calloc<uint8_t>(sets*histLen);
+                    curTime = gm_calloc<uint32_t>(sets);
+                    sampler = gm_calloc<SamplerEntry>(sets*samplerBuckets*SAMPLER_ASSOC);
+                }
+
+                ~OPTgen() {
+                    gm_free(occVec);
+                    gm_free(curTime);
+                    gm_free(sampler);
+                }
+
+                // Written/read as part of the enclosing policy's record
+                void saveState(CheckpointWriter& cw) {
+                    cw.writeArray(occVec, sets*histLen);
+                    cw.writeArray(curTime, sets);
+                    cw.writeArray(sampler, sets*samplerBuckets*SAMPLER_ASSOC);
+                }
+
+                void restoreState(CheckpointReader& cr) {
+                    cr.readArray(occVec, sets*histLen);
+                    cr.readArray(curTime, sets);
+                    cr.readArray(sampler, sets*samplerBuckets*SAMPLER_ASSOC);
+                }
+
+                /* Records an access to the sampled set and, if the line was seen
+                 * within the history window, returns whether OPT would have hit.
+                 * Returns through *trainSig the signature to train (the previous
+                 * access's), and true in *hasTrain if there was a decision.
+                 */
+                inline void access(uint32_t set, Address lineAddr, uint16_t sig, uint16_t* trainSig, bool* hasTrain, bool* optHit) {
+                    uint8_t* occ = &occVec[set*histLen];
+                    uint32_t now = curTime[set]++;
+                    occ[now & histMask] = 0; // slot is recycled from now - histLen
+
+                    uint32_t tag = (uint32_t)(lineAddr ^ (lineAddr >> 32));
+                    uint32_t bucket = ((tag * 0x9E3779B1u) >> 16) & (samplerBuckets - 1);
+                    SamplerEntry* b = &sampler[(set*samplerBuckets + bucket)*SAMPLER_ASSOC];
+
+                    SamplerEntry* e = nullptr;
+                    SamplerEntry* victim = &b[0];
+                    for (uint32_t w = 0; w < SAMPLER_ASSOC; w++) {
+                        if (b[w].valid && b[w].tag == tag) {
+                            e = &b[w];
+                            break;
+                        }
+                        // Prefer invalid entries, then the oldest one
+                        if (!b[w].valid) victim = &b[w];
+                        else if (victim->valid && (now - b[w].time) > (now - victim->time)) victim = &b[w];
+                    }
+
+                    *hasTrain = false;
+                    if (e) {
+                        uint32_t dist = now - e->time;
+                        *hasTrain = true;
+                        *trainSig = e->sig;
+                        if (dist < histLen) {
+                            // OPT hits iff the line fits in the set over its whole reuse interval
+                            bool fits = true;
+                            for (uint32_t t = e->time; t != now; t++) {
+                                if (occ[t & histMask] >= ways) {
+                                    fits = false;
+                                    break;
+                                }
+                            }
+                            if (fits) {
+                                for (uint32_t t = e->time; t != now; t++) occ[t & histMask]++;
+                            }
+                            *optHit = fits;
+                        } else {
+                            *optHit = false; // reused beyond the window, OPT would not have kept it
+                        }
+                    } else {
+                        // Evicting a line that was never reused within the window is an OPT miss for it
+                        if (victim->valid) {
+                            *hasTrain = true;
+                            *trainSig = victim->sig;
+                            *optHit = false;
+                        }
+                        e = victim;
+                        e->valid = true;
+                        e->tag = tag;
+                    }
+                    e->time = now;
+                    e->sig = sig;
+                }
+        };
+
         // hawkeye predictor
-        uint8_t *predictor;
+        uint8_t* predictor;
         // array for cache rrip value
-        uint8_t *array;
-        //
-        uint32_t ways;
+        uint8_t* array;
+        // signature of the last access to each line, to detrain on eviction
+        uint16_t* lineSigs;
+
+        OPTgen* optgen;
+
         uint32_t numLines;
+        uint32_t setMask;
+        uint32_t sampleShift; // log2(numSets/sampledSets)
+        uint32_t sampleMask;
         uint32_t predictorLen;
-        uint32_t pcMask;
+        uint32_t sigMask;
+        bool inserting; // set by replaced(), so the following update() knows it's a fill
+
+        Counter profOptHits, profOptMisses, profFriendlyFills, profAverseFills, profDetrains;
+
     public:
-        HawkeyeReplPolicy(uint32_t _ways, uint32_t _numLines, uint8_t _pcIndexLen) :
-        ways(_ways), numLines(_numLines) {
-            predictorLen = 1 << _pcIndexLen;
-            pcMask = ~0 >> (32-_pcIndexLen);
+        HawkeyeReplPolicy(uint32_t _ways, uint32_t _numLines, uint32_t _sigBits, uint32_t _sampledSets) :
+            numLines(_numLines), inserting(false)
+        {
+            uint32_t numSets = numLines/_ways;
+            assert(isPow2(numSets));
+            setMask = numSets - 1;
+            uint32_t sampledSets = MIN(_sampledSets, numSets);
+            if (!isPow2(sampledSets)) panic("Hawkeye needs a power of 2 sampled sets, %d given", sampledSets);
+            sampleShift = ilog2(numSets/sampledSets);
+            sampleMask = (1 << sampleShift) - 1;
+
+            assert(_sigBits > 0 && _sigBits <= 16);
+            predictorLen = 1 << _sigBits;
+            sigMask = predictorLen - 1;
+
             array = gm_calloc<uint8_t>(numLines);
+            for (uint32_t i = 0; i < numLines; i++) array[i] = RRPV_MAX;
+            lineSigs = gm_calloc<uint16_t>(numLines);
             predictor = gm_calloc<uint8_t>(predictorLen);
+            for (uint32_t i = 0; i < predictorLen; i++) predictor[i] = PRED_FRIENDLY; // weakly friendly
+            optgen = new OPTgen(sampledSets, _ways);
         }
 
         ~HawkeyeReplPolicy() {
             gm_free(array);
+            gm_free(lineSigs);
             gm_free(predictor);
+            delete optgen;
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* hawkeyeStat = new AggregateStat();
+            hawkeyeStat->init("hawkeye", "Hawkeye replacement stats");
+            profOptHits.init("optHits", "Sampled accesses that hit under OPT");
+            profOptMisses.init("optMisses", "Sampled accesses that miss under OPT");
+            profFriendlyFills.init("friendlyFills", "Fills predicted cache-friendly");
+            profAverseFills.init("averseFills", "Fills predicted cache-averse");
+            profDetrains.init("detrains", "Evictions of cache-friendly lines");
+            hawkeyeStat->append(&profOptHits);
+            hawkeyeStat->append(&profOptMisses);
+            hawkeyeStat->append(&profFriendlyFills);
+            hawkeyeStat->append(&profAverseFills);
+            hawkeyeStat->append(&profDetrains);
+            parentStat->append(hawkeyeStat);
         }
 
         // updates on cache hit/miss
         void update(uint32_t id, const MemReq* req) {
-            // TODO: 1. update hist and occuVec
-            //   2. update predictor
-            //   3. update rrip value, notice that cache hit and miss should be differentiated
+            uint16_t sig = signature(req);
+
+            // Set sampling uses the unhashed set bits; with hashed arrays this still
+            // gives OPTgen a uniform sample of the address stream
+            uint32_t set = req->lineAddr & setMask;
+            if ((set & sampleMask) == ((set >> sampleShift) & sampleMask)) {
+                uint16_t trainSig;
+                bool hasTrain, optHit;
+                optgen->access(set >> sampleShift, req->lineAddr, sig, &trainSig, &hasTrain, &optHit);
+                if (hasTrain) {
+                    train(trainSig, optHit);
+                    optHit? profOptHits.inc() : profOptMisses.inc();
+                }
+            }
+
+            bool friendly = isFriendly(sig);
+            if (inserting) {
+                friendly? profFriendlyFills.inc() : profAverseFills.inc();
+                inserting = false;
+            }
+            array[id] = friendly? 0 : RRPV_MAX;
+            lineSigs[id] = sig;
         }
+
         // replaces cache line
         virtual void replaced(uint32_t id) {
-            // TODO: 1. update 
+            inserting = true;
         }
 
-        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
-            // TODO: rank
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "Hawkeye");
+            cw.writeArray(array, numLines);
+            cw.writeArray(lineSigs, numLines);
+            cw.writeArray(predictor, predictorLen);
+            optgen->saveState(cw);
+            cw.endRecord();
         }
 
-        void train(uint32_t pc, bool hit) {
-
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "Hawkeye");
+            cr.readArray(array, numLines);
+            cr.readArray(lineSigs, numLines);
+            cr.readArray(predictor, predictorLen);
+            optgen->restoreState(cr);
+            cr.endRecord();
         }
 
-        DECL_RANK_BINDINGS;
-
-        // data structures for OPTgen
-        class OPTgen {
-            protected:
-                // sampled cache, use lru replacement policy
-                uint32_t *pc;
-                uint32_t *addr;
-                uint32_t *cycles;
-                uint32_t sampleCacheSize; // the size of the sample cache
-                uint32_t sets; // number of sets of the sampled cache
-                uint32_t lru; // point to the least recently used position
-                uint32_t mru; //
-                uint32_t mask;
-                // occupancy vector
-                // TODO: occupancy vector need to be a circular array
-                uint32_t *occVec;
-                uint32_t vecLen; // the length of the occupancy vector
-
-        public:
-                OPTgen(uint32_t _sets, uint32_t _ways, uint32_t _timeQuantum, float sampleRate) : sets(_sets) {
-                    mask = (~0) >> 16;
-                    lru = 0;
-                    mru = 0;
-                    sampleCacheSize = _sets * _ways * 8 * sampleRate;
-                    vecLen = _sets * _ways / _timeQuantum;
-                    pc = gm_calloc<uint32_t>(sampleCacheSize);
-                    addr = gm_calloc<uint32_t>(sampleCacheSize);
-                    cycles = gm_calloc<uint32_t>(sampleCacheSize);
-                    occVec = gm_calloc<uint32_t>(vecLen);
+        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
+            uint32_t bestCand = -1;
+            uint8_t bestRrpv = 0;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                if (!cc->isValid(*ci)) return *ci;
+                if (array[*ci] >= bestRrpv) {
+                    // >= picks the last max; doesn't matter for correctness, cheaper than a tiebreak
+                    bestCand = *ci;
+                    bestRrpv = array[*ci];
                 }
+            }
 
-                ~OPTgen() {
-                    gm_free(pc);
-                    gm_free(addr);
-                    gm_free(cycles);
-                    gm_free(occVec);
+            // No cache-averse candidate: we're evicting a friendly line, so its
+            // signature was too optimistic
+            if (bestRrpv < RRPV_MAX) {
+                train(lineSigs[bestCand], false);
+                profDetrains.inc();
+            }
+
+            // Friendly fills age the other friendly lines, so stale ones eventually go
+            if (isFriendly(signature(req))) {
+                for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                    if (array[*ci] < RRPV_MAX - 1) array[*ci]++;
                 }
+            }
+            return bestCand;
+        }
 
-                // predicts whether the given line will be a hit or a miss under OPT
-                // true for hit, false for miss
-                bool predict(uint32_t lineAddr, uint32_t pc, uint32_t cycle) {
-                    // find the most recent access history
-                    for(uint32_t i=0; i<sampleCacheSize; i++) {
-                        uint32_t idx = i<=mru? mru-i : sampleCacheSize + (mru-i) % sampleCacheSize;
-                        if((addr[idx] & mask) == (lineAddr & mask)) {
-                            for()
-                        }
-                    }
-                    // insert access history
-                    if(((mru-lru)==sampleCacheSize) || (mru==(lru-1))) {
+        void train(uint32_t sig, bool hit) {
+            uint8_t& ctr = predictor[sig & sigMask];
+            if (hit) {
+                if (ctr < PRED_MAX) ctr++;
+            } else {
+                if (ctr > 0) ctr--;
+            }
+        }
 
-                    } else {
+        DECL_RANK_BINDINGS;
 
-                    }
-                }
-        };
+    private:
+        inline uint16_t signature(const MemReq* req) const {
+            uint64_t region = req->lineAddr >> REGION_BITS;
+            uint64_t h = (region ^ ((uint64_t)req->srcId << 40)) * 0x9E3779B97F4A7C15ull;
+            return (uint16_t)(h >> 48) & sigMask;
+        }
+
+        inline bool isFriendly(uint16_t sig) const {
+            return predictor[sig] >= PRED_FRIENDLY;
+        }
 };
 
-#endif //INC_614HW4_HAWKEYE_REPL_H
+#endif // HAWKEYE_REPL_H
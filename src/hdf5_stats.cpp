@@ -23,21 +23,65 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <fstream>
 #include <hdf5.h>
 #include <hdf5_hl.h>
 #include <iostream>
+#include <time.h>
+#include <unistd.h>
 #include <vector>
+#include "bithacks.h"
 #include "galloc.h"
+#include "locks.h"
 #include "log.h"
+#include "pin.H"
 #include "stats.h"
 #include "zsim.h"
 
 /** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
  * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
  * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+ *
+ * Async backends (used for periodic stats) keep a ring of record buffers in the global heap. dump() only copies
+ * stats into the current buffer; full buffers are written by a writer thread spawned in the process that creates
+ * the backend. If the ring fills up (or that process is gone), dump() writes the oldest buffer itself, and
+ * unbuffered dumps drain the ring synchronously, so the file is always complete at the end of the simulation.
  */
+
+//The HDF5 library is not thread-safe, so all backends serialize their file accesses on this lock (in the global heap)
+static lock_t* h5IoLock = nullptr;
+
+/* h5IoLock holds the pid of the process that owns it, or 0 if free. It is held across HDF5 calls, which may block on
+ * I/O, so waiters sleep on the futex rather than spin, and wake up periodically to check that the owner is alive. If
+ * a process dies while writing, the next waiter takes the lock over (with a warning, as that file may be left
+ * incomplete) instead of hanging every other process on its next dump.
+ */
+static void ioLockAcquire(lock_t* lock) {
+    uint32_t self = getpid();
+    while (true) {
+        uint32_t owner = *lock;
+        if (owner == 0) {
+            if (__sync_bool_compare_and_swap(lock, 0, self)) return;
+        } else if (syscall(SYS_kill, owner, 0) != 0 && errno == ESRCH) { //<signal.h> clashes with pin.H
+            if (__sync_bool_compare_and_swap(lock, owner, self)) {
+                warn("HDF5 backend: process %d died while writing stats, taking over its lock; stats files may be incomplete", owner);
+                return;
+            }
+        } else {
+            const struct timespec timeout = {0, 10*1000*1000}; //10 ms between owner checks
+            syscall(SYS_futex, lock, FUTEX_WAIT, owner, &timeout, nullptr, 0);
+        }
+    }
+}
+
+static void ioLockRelease(lock_t* lock) {
+    assert(*lock == (uint32_t)getpid());
+    *lock = 0;
+    __sync_synchronize();
+    syscall(SYS_futex, lock, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
 class HDF5BackendImpl : public GlobAlloc {
     private:
         const char* filename;
@@ -45,12 +89,22 @@ class HDF5BackendImpl : public GlobAlloc {
         bool skipVectors;
         bool sumRegularAggregates;
 
-        uint64_t* dataBuf; //buffered record data
+        uint64_t* dataBuf; //buffered record data, numBufs buffers of bufSize bytes
         uint64_t* curPtr; //points to next element to write in dump
         uint64_t recordSize; // in bytes
         uint32_t recordsPerWrite; //how many records to buffer; determines chunk size as well
+        size_t bufSize;
+
+        uint32_t bufferedRecords; //number of records buffered (dumped w/o being written) in the current buffer, <= recordsPerWrite
 
-        uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
+        // Ring of full buffers, [ringHead, ringHead + pendingBufs) (mod numBufs). The current buffer is ringTail.
+        uint32_t numBufs; //1 means synchronous writes
+        uint32_t* bufRecords; //records in each pending buffer
+        volatile uint32_t ringHead;
+        volatile uint32_t pendingBufs; //includes the buffer being written, if any
+        uint32_t ringTail;
+        lock_t ringLock;
+        lock_t* ioLock;
 
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
@@ -187,10 +241,52 @@ class HDF5BackendImpl : public GlobAlloc {
             return deduplicateH5Type(res);
         }
 
+        uint64_t* getBuf(uint32_t idx) const {
+            return dataBuf + idx*bufSize/sizeof(uint64_t);
+        }
+
+        void append(hid_t fileID, uint64_t* buf, uint32_t records) {
+            size_t fieldOffsets[] = {0};
+            size_t fieldSizes[] = {recordSize};
+            H5TBappend_records(fileID, "stats", records, recordSize, fieldOffsets, fieldSizes, buf);
+        }
+
+        // Moves the current buffer to the ring and switches to the next one, writing out old buffers if the ring is full
+        void enqueueCurrent() {
+            futex_lock(&ringLock);
+            bufRecords[ringTail] = bufferedRecords;
+            pendingBufs++;
+            futex_unlock(&ringLock);
+            syscall(SYS_futex, &pendingBufs, FUTEX_WAKE, 1, nullptr, nullptr, 0); //wake up the writer thread
+            ringTail = (ringTail + 1) % numBufs;
+            while (pendingBufs == numBufs) writePending(); //writer thread is falling behind (or dead), help out
+
+            bufferedRecords = 0;
+            curPtr = getBuf(ringTail);
+        }
+
+        static void writerThreadTrampoline(void* arg) {
+            static_cast<HDF5BackendImpl*>(arg)->writerLoop();
+        }
+
+        //Sleeps on pendingBufs (a futex word) while there is nothing to write
+        void writerLoop() {
+            while (true) {
+                if (!writePending()) syscall(SYS_futex, &pendingBufs, FUTEX_WAIT, 0, nullptr, nullptr, 0);
+            }
+        }
+
     public:
-        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates) :
-            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates, uint32_t _numBufs) :
+            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates), numBufs(_numBufs)
         {
+            assert(numBufs > 0);
+            if (!h5IoLock) {
+                h5IoLock = gm_calloc<lock_t>();
+                futex_init(h5IoLock);
+            }
+            ioLock = h5IoLock;
+
             // Create stats file
             info("HDF5 backend: Opening %s", filename);
             hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
@@ -212,45 +308,82 @@ class HDF5BackendImpl : public GlobAlloc {
                     nullptr, 9 /*compression*/, nullptr);
             assert(hErrVal == 0);
 
-            size_t bufSize = recordsPerWrite*recordSize;
+            bufSize = recordsPerWrite*recordSize;
             if (sumRegularAggregates) bufSize += recordSize; //conservatively add space for a record. See dumpWalk(), we bleed into the buffer a bit when dumping a regular aggregate.
-            dataBuf = static_cast<uint64_t*>(gm_malloc(bufSize));
+            bufSize = (bufSize + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+            dataBuf = static_cast<uint64_t*>(gm_malloc(numBufs*bufSize));
             curPtr = dataBuf;
 
             bufferedRecords = 0;
 
-            info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
+            bufRecords = gm_calloc<uint32_t>(numBufs);
+            ringHead = ringTail = 0;
+            pendingBufs = 0;
+            futex_init(&ringLock);
+
+            info("HDF5 backend: Created table, %ld bytes/record, %d records/write, %d buffers", recordSize, recordsPerWrite, numBufs);
             H5Fclose(fileID);
+
+            if (numBufs > 1) PIN_SpawnInternalThread(writerThreadTrampoline, this, 64*1024, nullptr);
         }
 
         ~HDF5BackendImpl() {}
 
         void dump(bool buffered) {
             // Copy stats to data buffer
+            uint64_t* buf = getBuf(ringTail);
             dumpWalk(rootStat);
             bufferedRecords++;
 
-            assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
+            assert_msg(buf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, buf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
 
             // Write to table if needed
-            if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+            if (numBufs == 1) {
+                if (bufferedRecords == recordsPerWrite || !buffered) {
+                    ioLockAcquire(ioLock);
+                    hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+                    append(fileID, buf, bufferedRecords);
+                    H5Fclose(fileID);
+                    ioLockRelease(ioLock);
 
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
-                H5Fclose(fileID);
+                    //Rewind
+                    bufferedRecords = 0;
+                    curPtr = dataBuf;
+                }
+            } else {
+                if (bufferedRecords == recordsPerWrite || !buffered) enqueueCurrent();
+                if (!buffered) while (writePending()) {} //drain, the file must be complete after an unbuffered dump
+            }
+        }
 
-                //Rewind
-                bufferedRecords = 0;
-                curPtr = dataBuf;
+        // Writes all currently pending buffers with a single open/close, returns false if there were none. Called by
+        // the writer thread, and by dump() when it must not wait. Holding ioLock through the write keeps buffers in order.
+        bool writePending() {
+            ioLockAcquire(ioLock);
+            uint32_t n = pendingBufs; //more may be enqueued meanwhile, we'll get them next time
+            if (!n) {
+                ioLockRelease(ioLock);
+                return false;
+            }
+            hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t idx = (ringHead + i) % numBufs;
+                append(fileID, getBuf(idx), bufRecords[idx]);
             }
+            H5Fclose(fileID);
+
+            futex_lock(&ringLock);
+            ringHead = (ringHead + n) % numBufs;
+            pendingBufs -= n;
+            futex_unlock(&ringLock);
+            ioLockRelease(ioLock);
+            return true;
         }
 };
 
 
-HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates) {
-    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates);
+HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates, uint32_t asyncBuffers) {
+    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates, MAX(asyncBuffers, 1u));
 }
 
 void HDF5Backend::dump(bool buffered) {
@@ -171,6 +171,7 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
                 rpStat->append(partStat);
             }
             parentStat->append(rpStat);
+            monitor->initStats(parentStat);
         }
 
         void setPartitionSizes(const uint32_t* sizes) {
@@ -33,19 +33,23 @@
 #include <vector>
 #include "cache.h"
 #include "cache_arrays.h"
+#include "checkpoint.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
+#include "decoder_cache.h"
 #include "detailed_mem.h"
 #include "detailed_mem_params.h"
 #include "ddr_mem.h"
 #include "debug_zsim.h"
 #include "dramsim_mem_ctrl.h"
+#include "event_recorder.h"
 #include "event_queue.h"
 #include "filter_cache.h"
 #include "galloc.h"
 #include "hash.h"
+#include "hawkeye_repl.h"
 #include "ideal_arrays.h"
 #include "locks.h"
 #include "log.h"
@@ -55,6 +59,7 @@
 #include "ooo_core.h"
 #include "part_repl_policies.h"
 #include "rrip_repl.h"
+#include "sampling.h"
 #include "pin_cmd.h"
 #include "prefetcher.h"
 #include "proc_stats.h"
@@ -135,6 +140,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
             //info("%s -> %lx", prefix.c_str(), seed);
             hf = new H3HashFamily(numHashes, setBits, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        } else if (hashType == "H3Table") {
+            //Same hashes as H3 (so results match), but table-driven; faster on zcache walks, uses 16KB/hash function
+            size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
+            hf = new H3TableHashFamily(numHashes, setBits, 0xCAC7EAFFA1 + seed);
         } else if (hashType == "SHA1") {
             hf = new SHA1HashFamily(numHashes);
         } else {
@@ -171,6 +180,12 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         assert(isPow2(rpvMax + 1));
         // add your SRRIP construction code here
         rp = new SRRIPReplPolicy(numLines, rpvMax);
+    } else if (replType == "Hawkeye") {
+        // predictor is indexed by a sigBits-wide signature; OPTgen runs on sampledSets sets
+        uint32_t sigBits = config.get<uint32_t>(prefix + "repl.sigBits", 11);
+        uint32_t sampledSets = config.get<uint32_t>(prefix + "repl.sampledSets", 64);
+        if (arrayType != "SetAssoc" && arrayType != "Z") panic("%s: Hawkeye replacement requires a SetAssoc or Z array", name.c_str());
+        rp = new HawkeyeReplPolicy(ways, numLines, sigBits, sampledSets);
     } else if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") {
         if (replType == "WayPart" && arrayType != "SetAssoc") panic("WayPart replacement requires SetAssoc array");
 
@@ -195,8 +210,6 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         }
 
         // Partition monitor
-        uint32_t umonLines = config.get<uint32_t>(prefix + "repl.umonLines", 256);
-        uint32_t umonWays = config.get<uint32_t>(prefix + "repl.umonWays", ways);
         uint32_t buckets;
         if (replType == "WayPart") {
             buckets = ways; //not an option with WayPart
@@ -204,7 +217,21 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             buckets = config.get<uint32_t>(prefix + "repl.buckets", 256);
         }
 
-        PartitionMonitor* mon = new UMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets);
+        string monType = config.get<const char*>(prefix + "repl.monitor", "UMon");
+        PartitionMonitor* mon = nullptr;
+        if (monType == "UMon") {
+            uint32_t umonLines = config.get<uint32_t>(prefix + "repl.umonLines", 256);
+            uint32_t umonWays = config.get<uint32_t>(prefix + "repl.umonWays", ways);
+            mon = new UMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets);
+        } else if (monType == "Shards") {
+            uint32_t sampling = config.get<uint32_t>(prefix + "repl.shardsSampling", 64); //sample 1 in this many lines
+            uint32_t curveScale = config.get<uint32_t>(prefix + "repl.shardsCurveScale", 2); //curves (and stats) span this many times the bank size
+            if (!isPow2(sampling)) panic("%s: repl.shardsSampling must be a power of two (%d)", name.c_str(), sampling);
+            if (!curveScale) panic("%s: repl.shardsCurveScale must be > 0", name.c_str());
+            mon = new ShardsMonitor(numLines, curveScale, ilog2(sampling), pm->getNumPartitions(), buckets);
+        } else {
+            panic("%s: Invalid repl.monitor %s", name.c_str(), monType.c_str());
+        }
 
         //Finally, instantiate the repl policy
         PartReplPolicy* prp;
@@ -266,13 +293,29 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     bool nonInclusiveHack = config.get<bool>(prefix + "nonInclusiveHack", false);
     if (nonInclusiveHack) assert(type == "Simple" && !isTerminal);
 
+    // Lock striping: by default, all accesses to a bank serialize on a single lock
+    uint32_t lockStripes = config.get<uint32_t>(prefix + "lockStripes", 1);
+    if (lockStripes > 1) {
+        // Stripes map whole sets to locks, so everything an access touches must be per-set state
+        if (isTerminal || type != "Simple") panic("%s: lockStripes requires a non-terminal Simple cache", name.c_str());
+        if (arrayType != "SetAssoc") panic("%s: lockStripes requires a SetAssoc array", name.c_str());
+        if (hashType != "None" && hashType != "H3") panic("%s: lockStripes requires a stateless hash (None or H3)", name.c_str());
+        if (replType != "LRU" && replType != "LRUNoSh" && replType != "SRRIP") {
+            panic("%s: lockStripes requires a replacement policy with per-set state (LRU, LRUNoSh or SRRIP), %s given", name.c_str(), replType.c_str());
+        }
+        if (!isPow2(lockStripes)) panic("%s: lockStripes must be a power of 2, %d given", name.c_str(), lockStripes);
+        lockStripes = MIN(lockStripes, numSets);
+    }
+
     // Finally, build the cache
     Cache* cache;
     CC* cc;
     if (isTerminal) {
         cc = new MESITerminalCC(numLines, name);
     } else {
-        cc = new MESICC(numLines, nonInclusiveHack, name);
+        MESICC* mcc = new MESICC(numLines, nonInclusiveHack, name);
+        if (lockStripes > 1) mcc->setLockStripes(hf, numSets, lockStripes);
+        cc = mcc;
     }
     rp->setCC(cc);
     if (!isTerminal) {
@@ -294,7 +337,11 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         //Filter cache optimization
         if (type != "Simple") panic("Terminal cache %s can only have type == Simple", name.c_str());
         if (arrayType != "SetAssoc" || hashType != "None" || replType != "LRU") panic("Invalid FilterCache config %s", name.c_str());
-        cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
+        //Lines per set in the filter array, and entries in its fully-associative victim filter
+        uint32_t filterWays = config.get<uint32_t>(prefix + "filterWays", 1);
+        uint32_t filterVictims = config.get<uint32_t>(prefix + "filterVictims", 0);
+        if (filterWays == 0 || filterWays > ways) panic("%s: filterWays must be between 1 and the cache's ways (%d), %d given", name.c_str(), ways, filterWays);
+        cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name, filterWays, filterVictims);
     }
 
 #if 0
@@ -349,6 +396,15 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
 
         mem = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
+    } else if (type == "RowMD1") {
+        // MD1 plus open-row tracking; latency is the row-hit latency, the rest are in system cycles
+        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
+        uint32_t ranksPerChannel = config.get<uint32_t>("sys.mem.ranksPerChannel", 4);
+        uint32_t banksPerRank = config.get<uint32_t>("sys.mem.banksPerRank", 8);
+        uint32_t pageSize = config.get<uint32_t>("sys.mem.pageSize", 8*1024);
+        uint32_t actLatency = config.get<uint32_t>("sys.mem.actLatency", 30);  // tRCD
+        uint32_t preLatency = config.get<uint32_t>("sys.mem.preLatency", 30);  // tRP
+        mem = new RowMD1Memory(lineSize, frequency, bandwidth, latency, ranksPerChannel, banksPerRank, pageSize, actLatency, preLatency, name);
     } else if (type == "WeaveMD1") {
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
         uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
@@ -378,11 +434,11 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
 
 typedef vector<vector<BaseCache*>> CacheGroup;
 
-CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal) {
+CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal, const string& groupPrefix = "sys.caches.") {
     CacheGroup* cgp = new CacheGroup;
     CacheGroup& cg = *cgp;
 
-    string prefix = "sys.caches." + name + ".";
+    string prefix = groupPrefix + name + ".";
 
     bool isPrefetcher = config.get<bool>(prefix + "isPrefetcher", false);
     if (isPrefetcher) { //build a prefetcher group
@@ -481,129 +537,142 @@ static void InitSystem(Config& config) {
         return childMap[group].size() == 0;
     };
 
-    // Build each of the groups, starting with the LLC
-    unordered_map<string, CacheGroup*> cMap;
-    list<string> fringe;  // FIFO
-    fringe.push_back(llc);
-    while (!fringe.empty()) {
-        string group = fringe.front();
-        fringe.pop_front();
-        if (cMap.count(group)) panic("The cache 'tree' has a loop at %s", group.c_str());
-        cMap[group] = BuildCacheGroup(config, group, isTerminal(group));
-        for (auto& childVec : childMap[group]) fringe.insert(fringe.end(), childVec.begin(), childVec.end());
-    }
-
-    //Check single LLC
-    if (cMap[llc]->size() != 1) panic("Last-level cache %s must have caches = 1, but %ld were specified", llc.c_str(), cMap[llc]->size());
+    bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
 
-    /* Since we have checked for no loops, parent is mandatory, and all parents are checked valid,
-     * it follows that we have a fully connected tree finishing at the LLC.
+    /* Builds and connects the cache groups and memory controllers. Configuration sweeps call this once per
+     * variant, with sweepPrefix pointing to the variant's cache group definitions (empty for the main system)
      */
+    auto buildHierarchy = [&](const string& sweepPrefix, unordered_map<string, CacheGroup*>& cMap, g_vector<MemObject*>& mems) {
+        // Build each of the groups, starting with the LLC
+        list<string> fringe;  // FIFO
+        fringe.push_back(llc);
+        while (!fringe.empty()) {
+            string group = fringe.front();
+            fringe.pop_front();
+            if (cMap.count(group)) panic("The cache 'tree' has a loop at %s", group.c_str());
+            //Sweep variants may redefine any non-terminal group; the rest comes from sys.caches
+            string groupPrefix = (!isTerminal(group) && sweepPrefix != "" && config.exists(sweepPrefix + group))? sweepPrefix : "sys.caches.";
+            cMap[group] = BuildCacheGroup(config, group, isTerminal(group), groupPrefix);
+            for (auto& childVec : childMap[group]) fringe.insert(fringe.end(), childVec.begin(), childVec.end());
+        }
 
-    //Build the memory controllers
-    uint32_t memControllers = config.get<uint32_t>("sys.mem.controllers", 1);
-    assert(memControllers > 0);
+        //Check single LLC
+        if (cMap[llc]->size() != 1) panic("Last-level cache %s must have caches = 1, but %ld were specified", llc.c_str(), cMap[llc]->size());
 
-    g_vector<MemObject*> mems;
-    mems.resize(memControllers);
-
-    for (uint32_t i = 0; i < memControllers; i++) {
-        stringstream ss;
-        ss << "mem-" << i;
-        g_string name(ss.str().c_str());
-        //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
-        uint32_t domain = i*zinfo->numDomains/memControllers;
-        mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
-    }
+        /* Since we have checked for no loops, parent is mandatory, and all parents are checked valid,
+         * it follows that we have a fully connected tree finishing at the LLC.
+         */
 
-    if (memControllers > 1) {
-        bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
-        if (splitAddrs) {
-            MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter");
-            mems.resize(1);
-            mems[0] = splitter;
+        //Build the memory controllers
+        uint32_t memControllers = config.get<uint32_t>("sys.mem.controllers", 1);
+        assert(memControllers > 0);
+        if (zinfo->numMemDomains > memControllers) {
+            panic("sim.memDomains (%d) exceeds the number of memory controllers (%d), some domains would be empty", zinfo->numMemDomains, memControllers);
         }
-    }
 
-    //Connect everything
-    bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
+        mems.resize(memControllers);
 
-    // mem to llc is a bit special, only one llc
-    uint32_t childId = 0;
-    for (BaseCache* llcBank : (*cMap[llc])[0]) {
-        llcBank->setParents(childId++, mems, network);
-    }
+        for (uint32_t i = 0; i < memControllers; i++) {
+            stringstream ss;
+            ss << "mem-" << i;
+            g_string name(ss.str().c_str());
+            //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
+            uint32_t domain = zinfo->numMemDomains? zinfo->numDomains + i*zinfo->numMemDomains/memControllers : i*zinfo->numDomains/memControllers;
+            mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
+            if (sweepPrefix == "") zinfo->checkpointObjs->push_back(mems[i]); //the controllers, not the splitter, hold the state
+        }
 
-    // Rest of caches
-    for (const char* grp : cacheGroupNames) {
-        if (isTerminal(grp)) continue; //skip terminal caches
+        if (memControllers > 1) {
+            bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
+            if (splitAddrs) {
+                MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter");
+                mems.resize(1);
+                mems[0] = splitter;
+            }
+        }
 
-        CacheGroup& parentCaches = *cMap[grp];
-        uint32_t parents = parentCaches.size();
-        assert(parents);
+        //Connect everything
+        // mem to llc is a bit special, only one llc
+        uint32_t childId = 0;
+        for (BaseCache* llcBank : (*cMap[llc])[0]) {
+            llcBank->setParents(childId++, mems, network);
+        }
 
-        // Linearize concatenated / interleaved caches from childMap cacheGroups
-        CacheGroup childCaches;
+        // Rest of caches
+        for (const char* grp : cacheGroupNames) {
+            if (isTerminal(grp)) continue; //skip terminal caches
 
-        for (auto childVec : childMap[grp]) {
-            if (!childVec.size()) continue;
-            size_t vecSize = cMap[childVec[0]]->size();
-            for (string child : childVec) {
-                if (cMap[child]->size() != vecSize) {
-                    panic("In interleaved group %s, %s has a different number of caches", Str(childVec).c_str(), child.c_str());
+            CacheGroup& parentCaches = *cMap[grp];
+            uint32_t parents = parentCaches.size();
+            assert(parents);
+
+            // Linearize concatenated / interleaved caches from childMap cacheGroups
+            CacheGroup childCaches;
+
+            for (auto childVec : childMap[grp]) {
+                if (!childVec.size()) continue;
+                size_t vecSize = cMap[childVec[0]]->size();
+                for (string child : childVec) {
+                    if (cMap[child]->size() != vecSize) {
+                        panic("In interleaved group %s, %s has a different number of caches", Str(childVec).c_str(), child.c_str());
+                    }
                 }
-            }
 
-            CacheGroup interleavedGroup;
-            for (uint32_t i = 0; i < vecSize; i++) {
-                for (uint32_t j = 0; j < childVec.size(); j++) {
-                    interleavedGroup.push_back(cMap[childVec[j]]->at(i));
+                CacheGroup interleavedGroup;
+                for (uint32_t i = 0; i < vecSize; i++) {
+                    for (uint32_t j = 0; j < childVec.size(); j++) {
+                        interleavedGroup.push_back(cMap[childVec[j]]->at(i));
+                    }
                 }
-            }
 
-            childCaches.insert(childCaches.end(), interleavedGroup.begin(), interleavedGroup.end());
-        }
+                childCaches.insert(childCaches.end(), interleavedGroup.begin(), interleavedGroup.end());
+            }
 
-        uint32_t children = childCaches.size();
-        assert(children);
+            uint32_t children = childCaches.size();
+            assert(children);
 
-        uint32_t childrenPerParent = children/parents;
-        if (children % parents != 0) {
-            panic("%s has %d caches and %d children, they are non-divisible. "
-                  "Use multiple groups for non-homogeneous children per parent!", grp, parents, children);
-        }
+            uint32_t childrenPerParent = children/parents;
+            if (children % parents != 0) {
+                panic("%s has %d caches and %d children, they are non-divisible. "
+                      "Use multiple groups for non-homogeneous children per parent!", grp, parents, children);
+            }
 
-        for (uint32_t p = 0; p < parents; p++) {
-            g_vector<MemObject*> parentsVec;
-            parentsVec.insert(parentsVec.end(), parentCaches[p].begin(), parentCaches[p].end()); //BaseCache* to MemObject* is a safe cast
+            for (uint32_t p = 0; p < parents; p++) {
+                g_vector<MemObject*> parentsVec;
+                parentsVec.insert(parentsVec.end(), parentCaches[p].begin(), parentCaches[p].end()); //BaseCache* to MemObject* is a safe cast
 
-            uint32_t childId = 0;
-            g_vector<BaseCache*> childrenVec;
-            for (uint32_t c = p*childrenPerParent; c < (p+1)*childrenPerParent; c++) {
-                for (BaseCache* bank : childCaches[c]) {
-                    bank->setParents(childId++, parentsVec, network);
-                    childrenVec.push_back(bank);
+                uint32_t childId = 0;
+                g_vector<BaseCache*> childrenVec;
+                for (uint32_t c = p*childrenPerParent; c < (p+1)*childrenPerParent; c++) {
+                    for (BaseCache* bank : childCaches[c]) {
+                        bank->setParents(childId++, parentsVec, network);
+                        childrenVec.push_back(bank);
+                    }
                 }
-            }
 
-            if (printHierarchy) {
-                vector<string> cacheNames;
-                std::transform(childrenVec.begin(), childrenVec.end(), std::back_inserter(cacheNames),
-                        [](BaseCache* c) -> string { string s = c->getName(); return s; });
+                if (printHierarchy) {
+                    vector<string> cacheNames;
+                    std::transform(childrenVec.begin(), childrenVec.end(), std::back_inserter(cacheNames),
+                            [](BaseCache* c) -> string { string s = c->getName(); return s; });
 
-                string parentName = parentCaches[p][0]->getName();
-                if (parentCaches[p].size() > 1) {
-                    parentName += "..";
-                    parentName += parentCaches[p][parentCaches[p].size()-1]->getName();
+                    string parentName = parentCaches[p][0]->getName();
+                    if (parentCaches[p].size() > 1) {
+                        parentName += "..";
+                        parentName += parentCaches[p][parentCaches[p].size()-1]->getName();
+                    }
+                    info("Hierarchy: %s -> %s", Str(cacheNames).c_str(), parentName.c_str());
                 }
-                info("Hierarchy: %s -> %s", Str(cacheNames).c_str(), parentName.c_str());
-            }
 
-            for (BaseCache* bank : parentCaches[p]) {
-                bank->setChildren(childrenVec, network);
+                for (BaseCache* bank : parentCaches[p]) {
+                    bank->setChildren(childrenVec, network);
+                }
             }
         }
-    }
+    };
+
+    unordered_map<string, CacheGroup*> cMap;
+    g_vector<MemObject*> mems;
+    buildHierarchy("", cMap, mems);
 
     //Check that all the terminal caches have a single bank
     for (const char* grp : cacheGroupNames) {
@@ -634,6 +703,41 @@ static void InitSystem(Config& config) {
             string type = config.get<const char*>(prefix + "type", "Simple");
             string automaton = config.get<const char*>(prefix + "automaton", "A2");
 
+            //Branch predictor (OOO cores only): "PAg" (the default 2-level predictor, uses automaton) or "TAGE" (TAGE-SC-L)
+            string bpType = (type == "OOO")? config.get<const char*>(prefix + "branchPredictor", "PAg") : "PAg";
+            uint32_t tageTables = 0, tageLogEntries = 0, tageMinHist = 0, tageMaxHist = 0;
+            bool tageLoop = false, tageSC = false;
+            if (bpType == "TAGE") {
+                tageTables = config.get<uint32_t>(prefix + "tage.tables", 7);
+                tageLogEntries = config.get<uint32_t>(prefix + "tage.logEntries", 10);
+                tageMinHist = config.get<uint32_t>(prefix + "tage.minHist", 4);
+                tageMaxHist = config.get<uint32_t>(prefix + "tage.maxHist", 200);
+                tageLoop = config.get<bool>(prefix + "tage.loop", true);
+                tageSC = config.get<bool>(prefix + "tage.sc", true);
+            } else if (bpType != "PAg") {
+                panic("%s: Invalid branch predictor %s", group, bpType.c_str());
+            }
+
+            //OOO core widths and structure sizes (defaults are Westmere's, see OOOCoreParams)
+            OOOCoreParams oooParams;
+            if (type == "OOO") {
+                oooParams.robSize = config.get<uint32_t>(prefix + "robSize", oooParams.robSize);
+                oooParams.commitWidth = config.get<uint32_t>(prefix + "commitWidth", oooParams.commitWidth);
+                oooParams.loadQueueSize = config.get<uint32_t>(prefix + "loadQueueSize", oooParams.loadQueueSize);
+                oooParams.storeQueueSize = config.get<uint32_t>(prefix + "storeQueueSize", oooParams.storeQueueSize);
+                oooParams.uopQueueSize = config.get<uint32_t>(prefix + "uopQueueSize", oooParams.uopQueueSize);
+                oooParams.windowSize = config.get<uint32_t>(prefix + "windowSize", oooParams.windowSize);
+                oooParams.issueWidth = config.get<uint32_t>(prefix + "issueWidth", oooParams.issueWidth);
+                oooParams.rfReadsPerCycle = config.get<uint32_t>(prefix + "rfReadsPerCycle", oooParams.rfReadsPerCycle);
+                oooParams.fwdEntries = config.get<uint32_t>(prefix + "fwdEntries", oooParams.fwdEntries);
+
+                if (!oooParams.robSize || !oooParams.commitWidth || !oooParams.loadQueueSize || !oooParams.storeQueueSize ||
+                        !oooParams.uopQueueSize || !oooParams.windowSize || !oooParams.issueWidth || !oooParams.rfReadsPerCycle) {
+                    panic("%s: OOO core structure sizes and widths must be non-zero", group);
+                }
+                if (!oooParams.fwdEntries || !isPow2(oooParams.fwdEntries)) panic("%s: fwdEntries must be a power of 2, is %d", group, oooParams.fwdEntries);
+            }
+
             //Build the core group
             union {
                 SimpleCore* simpleCores;
@@ -699,11 +803,13 @@ static void InitSystem(Config& config) {
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        BranchPredictor* bp;
+                        if (bpType == "TAGE") bp = new TAGEPredictor(tageTables, tageLogEntries, tageMinHist, tageMaxHist, tageLoop, tageSC);
+                        else bp = new BranchPredictorPAg<11, 18, 14>(automaton == "A3");
+                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, bp, oooParams, name);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
-                        if (automaton == "A3") ocore->useA3forBranchPred();
                     }
                     coreMap[group].push_back(core);
                     coreIdx++;
@@ -742,33 +848,91 @@ static void InitSystem(Config& config) {
             zinfo->rootStat->append(groupStat);
         }
     } else {  // trace-driven: create trace driver and proxy caches
-        vector<TraceDriverProxyCache*> proxies;
-        for (const char* grp : cacheGroupNames) {
-            if (isTerminal(grp)) {
-                for (vector<BaseCache*> cv : *cMap[grp]) {
-                    assert(cv.size() == 1);
-                    TraceDriverProxyCache* proxy = dynamic_cast<TraceDriverProxyCache*>(cv[0]);
-                    assert(proxy);
-                    proxies.push_back(proxy);
+        auto getProxies = [&](unordered_map<string, CacheGroup*>& groups) {
+            vector<TraceDriverProxyCache*> proxies;
+            for (const char* grp : cacheGroupNames) {
+                if (isTerminal(grp)) {
+                    for (vector<BaseCache*> cv : *groups[grp]) {
+                        assert(cv.size() == 1);
+                        TraceDriverProxyCache* proxy = dynamic_cast<TraceDriverProxyCache*>(cv[0]);
+                        assert(proxy);
+                        proxies.push_back(proxy);
+                    }
                 }
             }
-        }
+            return proxies;
+        };
+        vector<TraceDriverProxyCache*> proxies = getProxies(cMap);
 
         //FIXME: For now, we assume we are driving a single-bank LLC
         string traceFile = config.get<const char*>("sim.traceFile");
         string retraceFile = config.get<const char*>("sim.retraceFile", ""); //leave empty to not retrace
-        zinfo->traceDriver = new TraceDriver(traceFile, retraceFile, proxies,
-                config.get<bool>("sim.useSkews", true), // incorporate skews in to playback and simulator results, not only the output trace
-                config.get<bool>("sim.playPuts", true),
-                config.get<bool>("sim.playAllGets", true));
+        bool useSkews = config.get<bool>("sim.useSkews", true); // incorporate skews in to playback and simulator results, not only the output trace
+        bool playPuts = config.get<bool>("sim.playPuts", true);
+        bool playAllGets = config.get<bool>("sim.playAllGets", true);
+        uint32_t replayThreads = config.get<uint32_t>("sim.traceReplayThreads", 1); // >1 replays children in parallel
+
+        /* Configuration sweep: each subgroup of sim.sweep.variants is an extra hierarchy that redefines some of
+         * the non-terminal cache groups (e.g., sim.sweep.variants.srrip.l3 = {...}) and replays the same trace,
+         * decoded once and shared through a ring of blocks, on its own host thread
+         */
+        vector<const char*> sweepVariants;
+        if (config.exists("sim.sweep.variants")) config.subgroups("sim.sweep.variants", sweepVariants);
+        TraceBlockRing* ring = nullptr;
+        if (!sweepVariants.empty()) {
+            //Skews shift each variant's phase boundaries differently, so variants could need trace blocks too far apart
+            if (useSkews) panic("Configuration sweeps need sim.useSkews = false");
+            uint32_t ringBlocks = config.get<uint32_t>("sim.sweep.ringBlocks", 64);
+            uint32_t blockRecords = config.get<uint32_t>("sim.sweep.blockRecords", 4096);
+            ring = new TraceBlockRing(traceFile, ringBlocks, blockRecords);
+        }
+
+        zinfo->traceDriver = new TraceDriver(traceFile, retraceFile, proxies, useSkews, playPuts, playAllGets, replayThreads, ring);
         zinfo->traceDriver->initStats(zinfo->rootStat);
+
+        if (ring) {
+            vector<TraceDriver*> drivers = {zinfo->traceDriver};
+            AggregateStat* sweepStat = new AggregateStat(false);
+            sweepStat->init("sweep", "Configuration sweep stats");
+            for (const char* variant : sweepVariants) {
+                unordered_map<string, CacheGroup*> vMap;
+                g_vector<MemObject*> vMems;
+                buildHierarchy(string("sim.sweep.variants.") + variant + ".", vMap, vMems);
+                vector<TraceDriverProxyCache*> vProxies = getProxies(vMap);
+                TraceDriver* drv = new TraceDriver(traceFile, "", vProxies, useSkews, playPuts, playAllGets, replayThreads, ring);
+
+                AggregateStat* vStat = new AggregateStat(false);
+                vStat->init(gm_strdup(variant), "Sweep variant stats");
+                drv->initStats(vStat);
+                for (const char* group : cacheGroupNames) {
+                    AggregateStat* groupStat = new AggregateStat(true);
+                    groupStat->init(gm_strdup(group), "Cache stats");
+                    for (vector<BaseCache*>& banks : *vMap[group]) for (BaseCache* bank : banks) bank->initStats(groupStat);
+                    vStat->append(groupStat);
+                }
+                AggregateStat* memStat = new AggregateStat(true);
+                memStat->init("mem", "Memory controller stats");
+                for (auto mem : vMems) mem->initStats(memStat);
+                vStat->append(memStat);
+                sweepStat->append(vStat);
+
+                drivers.push_back(drv);
+                for (pair<string, CacheGroup*> kv : vMap) delete kv.second;
+            }
+            zinfo->rootStat->append(sweepStat);
+            zinfo->traceSweep = new TraceSweep(ring, drivers);
+            info("Sweeping %ld configurations over a single pass of %s", drivers.size(), traceFile.c_str());
+        }
     }
 
     //Init stats: caches, mem
     for (const char* group : cacheGroupNames) {
         AggregateStat* groupStat = new AggregateStat(true);
         groupStat->init(gm_strdup(group), "Cache stats");
-        for (vector<BaseCache*>& banks : *cMap[group]) for (BaseCache* bank : banks) bank->initStats(groupStat);
+        for (vector<BaseCache*>& banks : *cMap[group]) for (BaseCache* bank : banks) {
+            bank->initStats(groupStat);
+            zinfo->checkpointObjs->push_back(bank);
+        }
         zinfo->rootStat->append(groupStat);
     }
 
@@ -801,6 +965,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
 
     // Absolute paths for stats files. Note these must be in the global heap.
     const char* pStatsFile = gm_strdup((pathStr + "zsim.h5").c_str());
+    const char* pColStatsFile = gm_strdup((pathStr + "zsim.zcs").c_str());
     const char* evStatsFile = gm_strdup((pathStr + "zsim-ev.h5").c_str());
     const char* cmpStatsFile = gm_strdup((pathStr + "zsim-cmp.h5").c_str());
     const char* statsFile = gm_strdup((pathStr + "zsim.out").c_str());
@@ -809,7 +974,17 @@ static void PostInitStats(bool perProcessDir, Config& config) {
         const char* periodicStatsFilter = config.get<const char*>("sim.periodicStatsFilter", "");
         AggregateStat* prStat = (!strlen(periodicStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, periodicStatsFilter);
         if (!prStat) panic("No stats match sim.periodicStatsFilter regex (%s)! Set interval to 0 to avoid periodic stats", periodicStatsFilter);
-        zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        //hdf5 (zsim.h5) or columnar (zsim.zcs, see misc/zcs.py), which is cheaper to write and to query one stat over time
+        string periodicStatsFormat = config.get<const char*>("sim.periodicStatsFormat", "hdf5");
+        if (periodicStatsFormat == "columnar") {
+            zinfo->periodicStatsBackend = new ColumnarBackend(pColStatsFile, prStat, (1 << 23) /* 8MB blocks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        } else if (periodicStatsFormat == "hdf5") {
+            //Periodic dumps can be very frequent; by default, write them out from a background thread so they don't stall the weave phase
+            uint32_t periodicStatsBuffers = config.get<uint32_t>("sim.periodicStatsBuffers", 4);
+            zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats, periodicStatsBuffers);
+        } else {
+            panic("Invalid sim.periodicStatsFormat %s, must be hdf5 or columnar", periodicStatsFormat.c_str());
+        }
         zinfo->periodicStatsBackend->dump(true); //must have a first sample
 
         class PeriodicStatsDumpEvent : public Event {
@@ -910,8 +1085,27 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     }
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
-    uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    //If set, memory controllers (channels) get their own domains, numbered after the core/cache ones, so they are
+    //simulated concurrently with each other and with the rest of the system instead of sharing core domains
+    zinfo->numMemDomains = config.get<uint32_t>("sim.memDomains", 0);
+    uint32_t totalDomains = zinfo->numDomains + zinfo->numMemDomains;
+    //Each weave thread simulates the same number of domains. By default, use the largest divisor of totalDomains
+    //that gives each thread at least two domains (gives a bit of parallelism, TODO tune)
+    uint32_t defSimThreads = 1;
+    for (uint32_t t = totalDomains/2; t > 1; t--) {
+        if (totalDomains % t == 0) {
+            defSimThreads = t;
+            break;
+        }
+    }
+    uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", defSimThreads);
+    if (numSimThreads == 0 || totalDomains % numSimThreads != 0) {
+        panic("sim.contentionThreads (%d) must divide the number of domains (%d sim.domains + %d sim.memDomains)",
+                numSimThreads, zinfo->numDomains, zinfo->numMemDomains);
+    }
+    //Let idle weave threads simulate other threads' domains
+    bool weaveWorkStealing = config.get<bool>("sim.weaveWorkStealing", false);
+    zinfo->contentionSim = new ContentionSim(totalDomains, numSimThreads, weaveWorkStealing);
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
@@ -942,6 +1136,33 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->ignoreHooks = config.get<bool>("sim.ignoreHooks", false);
     zinfo->ffReinstrument = config.get<bool>("sim.ffReinstrument", false);
     if (zinfo->ffReinstrument) warn("sim.ffReinstrument = true, switching fast-forwarding on a multi-threaded process may be unstable");
+    zinfo->batchMemOps = config.get<bool>("sim.batchMemOps", false);
+
+    //Sampled simulation, off unless sim.sampling.detailedInstrs is set
+    zinfo->samplingFFInstrs = config.get<uint64_t>("sim.sampling.ffInstrs", 10*1000*1000);
+    zinfo->samplingWarmupInstrs = config.get<uint64_t>("sim.sampling.warmupInstrs", 100*1000);
+    zinfo->samplingDetailedInstrs = config.get<uint64_t>("sim.sampling.detailedInstrs", 0);
+    zinfo->sampling = zinfo->samplingDetailedInstrs > 0;
+    if (zinfo->sampling) {
+        if (zinfo->ffReinstrument) panic("Sampling and reinstrumenting on FF switches are incompatible");
+        if (!zinfo->samplingFFInstrs) panic("sim.sampling.ffInstrs must be > 0");
+        info("Sampling: %ld FF (warming), %ld detailed warmup, %ld detailed measured instrs per period",
+                zinfo->samplingFFInstrs, zinfo->samplingWarmupInstrs, zinfo->samplingDetailedInstrs);
+    }
+
+    //Checkpointing of the memory hierarchy, off unless a save or restore file is given
+    const char* ckptSaveFile = config.get<const char*>("sim.checkpoint.saveFile", "");
+    zinfo->checkpointFile = ckptSaveFile[0] ? gm_strdup(ckptSaveFile) : nullptr;
+    zinfo->checkpointPhase = config.get<uint64_t>("sim.checkpoint.savePhase", 0);
+    zinfo->checkpointPending = false;
+    string ckptRestoreFile = config.get<const char*>("sim.checkpoint.restoreFile", "");
+    bool ckptRestoreStats = config.get<bool>("sim.checkpoint.restoreStats", false);
+    if (zinfo->checkpointPhase && !zinfo->checkpointFile) panic("sim.checkpoint.savePhase requires sim.checkpoint.saveFile");
+    if (zinfo->sampling && (zinfo->checkpointFile || !ckptRestoreFile.empty())) {
+        //Functional warming touches caches outside of the phase barrier, so there is no quiescent point to save at
+        panic("Sampling and checkpointing are incompatible");
+    }
+    zinfo->checkpointObjs = new g_vector<MemObject*>();
 
     zinfo->registerThreads = config.get<bool>("sim.registerThreads", false);
     zinfo->globalPauseFlag = config.get<bool>("sim.startInGlobalPause", false);
@@ -973,6 +1194,35 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     allCoreStats->init("core", "Core stats");
     zinfo->rootStat->append(allCoreStats);
 
+    //Timing event allocator stats, summed over all cores with event recorders (filled in when cores are built)
+    AggregateStat* slabStat = new AggregateStat();
+    slabStat->init("slab", "Timing event allocator stats");
+    auto sumSlabs = [](uint64_t (slab::SlabAlloc::*f)() const) {
+        return makeLambdaStat([f]() {
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i < zinfo->numCores; i++) {
+                if (zinfo->eventRecorders[i]) sum += (zinfo->eventRecorders[i]->getSlabAlloc().*f)();
+            }
+            return sum;
+        });
+    };
+    auto slabBytesStat = sumSlabs(&slab::SlabAlloc::getSlabBytes);
+    slabBytesStat->init("slabBytes", "Bytes in live slabs");
+    slabStat->append(slabBytesStat);
+    auto carvedBytesStat = sumSlabs(&slab::SlabAlloc::getCarvedBytes);
+    carvedBytesStat->init("carvedBytes", "Bytes carved out of slabs");
+    slabStat->append(carvedBytesStat);
+    auto pooledBytesStat = sumSlabs(&slab::SlabAlloc::getPooledBytes);
+    pooledBytesStat->init("pooledBytes", "Bytes in per-size-class free lists");
+    slabStat->append(pooledBytesStat);
+    auto slabAllocsStat = sumSlabs(&slab::SlabAlloc::getSlabAllocs);
+    slabAllocsStat->init("slabAllocs", "Allocations carved out of slabs");
+    slabStat->append(slabAllocsStat);
+    auto poolAllocsStat = sumSlabs(&slab::SlabAlloc::getPoolAllocs);
+    poolAllocsStat->init("poolAllocs", "Allocations reused from free lists");
+    slabStat->append(poolAllocsStat);
+    zinfo->rootStat->append(slabStat);
+
     //Process tree needs this initialized, even though it is part of the memory hierarchy
     zinfo->lineSize = config.get<uint32_t>("sys.lineSize", 64);
     assert(zinfo->lineSize > 0);
@@ -990,10 +1240,15 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     //Caches, cores, memory controllers
     InitSystem(config);
 
+    //Decoded BBL cache, only useful with OOO decoding (set by InitSystem)
+    const char* bblCacheFile = config.get<const char*>("sim.bblCacheFile", "");
+    zinfo->bblCache = (zinfo->oooDecode && strlen(bblCacheFile))? new DecodedBblCache(bblCacheFile) : nullptr;
+
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
 
     zinfo->processStats = new ProcessStats(zinfo->rootStat);
+    zinfo->samplingStats = zinfo->sampling? new SamplingStats(zinfo->rootStat) : nullptr;
 
     const char* procStatsFilter = config.get<const char*>("sim.procStatsFilter", "");
     if (strlen(procStatsFilter)) {
@@ -1010,6 +1265,9 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     bool perProcessDir = config.get<bool>("sim.perProcessDir", false);
     PostInitStats(perProcessDir, config);
 
+    //Restore after stats are registered, so restoreStats can find the counters
+    if (!ckptRestoreFile.empty()) RestoreCheckpoint(ckptRestoreFile.c_str(), ckptRestoreStats);
+
     zinfo->perProcessCpuEnum = config.get<bool>("sim.perProcessCpuEnum", false);
 
     //Odds and ends
@@ -26,6 +26,8 @@
 //#include "timing_event.h"
 //#include "event_recorder.h"
 #include "mem_ctrls.h"
+#include "bithacks.h"
+#include "checkpoint.h"
 #include "zsim.h"
 
 uint64_t SimpleMemory::access(MemReq& req) {
@@ -116,27 +118,35 @@ uint64_t MD1Memory::access(MemReq& req) {
         futex_unlock(&updateLock);
     }
 
+    //Functional warming (WARMUP) only sets the requester's state; it adds no load and is not profiled
+    bool warmup = req.is(MemReq::WARMUP);
     switch (req.type) {
         case PUTX:
             //Dirty wback
-            profWrites.atomicInc();
-            profTotalWrLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            if (!warmup) {
+                profWrites.atomicInc();
+                profTotalWrLat.atomicInc(curLatency);
+                __sync_fetch_and_add(&curPhaseAccesses, 1);
+            }
             //Note no break
         case PUTS:
             //Not a real access -- memory must treat clean wbacks as if they never happened.
             *req.state = I;
             break;
         case GETS:
-            profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            if (!warmup) {
+                profReads.atomicInc();
+                profTotalRdLat.atomicInc(curLatency);
+                __sync_fetch_and_add(&curPhaseAccesses, 1);
+            }
             *req.state = req.is(MemReq::NOEXCL)? S : E;
             break;
         case GETX:
-            profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            if (!warmup) {
+                profReads.atomicInc();
+                profTotalRdLat.atomicInc(curLatency);
+                __sync_fetch_and_add(&curPhaseAccesses, 1);
+            }
             *req.state = M;
             break;
 
@@ -145,3 +155,94 @@ uint64_t MD1Memory::access(MemReq& req) {
     return req.cycle + ((req.type == PUTS)? 0 /*PUTS is not a real access*/ : curLatency);
 }
 
+void MD1Memory::saveState(CheckpointWriter& cw) {
+    cw.pushScope(name.c_str());
+    cw.beginRecord("mem", "MD1");
+    cw.write(smoothedPhaseAccesses);
+    cw.write(curLatency);
+    cw.endRecord();
+    cw.popScope();
+}
+
+void MD1Memory::restoreState(CheckpointReader& cr) {
+    cr.pushScope(name.c_str());
+    if (cr.contains("mem")) {
+        cr.beginRecord("mem", "MD1");
+        smoothedPhaseAccesses = cr.read<double>();
+        curLatency = cr.read<uint32_t>();
+        cr.endRecord();
+        curPhaseAccesses = 0;
+        lastPhase = zinfo->numPhases;
+    } else {
+        warn("[%s] Not in checkpoint, starting at zero-load latency", name.c_str());
+    }
+    cr.popScope();
+}
+
+
+RowMD1Memory::RowMD1Memory(uint32_t lineSize, uint32_t megacyclesPerSecond, uint32_t megabytesPerSecond, uint32_t _rowHitLatency,
+        uint32_t ranks, uint32_t banksPerRank, uint32_t pageSize, uint32_t _actLatency, uint32_t _preLatency, g_string& _name)
+    : MD1Memory(lineSize, megacyclesPerSecond, megabytesPerSecond, _rowHitLatency, _name), actLatency(_actLatency), preLatency(_preLatency)
+{
+    numBanks = ranks*banksPerRank;
+    uint32_t rowLines = pageSize/lineSize;
+    if (!isPow2(numBanks)) panic("%s: ranks*banksPerRank must be a power of two (%d)", name.c_str(), numBanks);
+    if (!rowLines || !isPow2(rowLines)) panic("%s: pageSize must be a power-of-two multiple of the line size (%d bytes)", name.c_str(), pageSize);
+    colBits = ilog2(rowLines);
+    bankBits = ilog2(numBanks);
+
+    openRows = gm_malloc<uint64_t>(numBanks);
+    for (uint32_t b = 0; b < numBanks; b++) openRows[b] = CLOSED_ROW;
+
+    info("%s: %d banks, %d lines/row, latency %d hit / +%d closed / +%d conflict",
+            name.c_str(), numBanks, rowLines, zeroLoadLatency, actLatency, preLatency + actLatency);
+}
+
+uint64_t RowMD1Memory::access(MemReq& req) {
+    uint64_t respCycle = MD1Memory::access(req);
+    if (req.type == PUTS) return respCycle;  //not a real access
+
+    uint32_t bank = (req.lineAddr >> colBits) & (numBanks - 1);
+    uint64_t row = req.lineAddr >> (colBits + bankBits);
+    //Concurrent accesses from the bound phase race on the bank; the exchange gives each one a consistent outcome
+    uint64_t prevRow = __sync_lock_test_and_set(&openRows[bank], row);
+    if (req.is(MemReq::WARMUP)) return respCycle;  //warming opens rows, but is not profiled
+
+    uint32_t rowLatency;
+    if (prevRow == row) {
+        profRowHits.atomicInc();
+        rowLatency = 0;
+    } else if (prevRow == CLOSED_ROW) {
+        profRowMisses.atomicInc();
+        rowLatency = actLatency;
+    } else {
+        profRowConflicts.atomicInc();
+        rowLatency = preLatency + actLatency;
+    }
+
+    if (req.type == PUTX) profTotalWrLat.atomicInc(rowLatency);
+    else profTotalRdLat.atomicInc(rowLatency);
+    return respCycle + rowLatency;
+}
+
+void RowMD1Memory::saveState(CheckpointWriter& cw) {
+    MD1Memory::saveState(cw);
+    cw.pushScope(name.c_str());
+    cw.beginRecord("rows", "RowMD1");
+    cw.writeArray(openRows, numBanks);
+    cw.endRecord();
+    cw.popScope();
+}
+
+void RowMD1Memory::restoreState(CheckpointReader& cr) {
+    MD1Memory::restoreState(cr);
+    cr.pushScope(name.c_str());
+    if (cr.contains("rows")) {
+        cr.beginRecord("rows", "RowMD1");
+        cr.readArray(openRows, numBanks);
+        cr.endRecord();
+    } else {
+        warn("[%s] Not in checkpoint, starting with closed rows", name.c_str());
+    }
+    cr.popScope();
+}
@@ -50,7 +50,7 @@ class SimpleMemory : public MemObject {
  * using an M/D/1 queueing model.
  */
 class MD1Memory : public MemObject {
-    private:
+    protected:
         uint64_t lastPhase;
         double maxRequestsPerCycle;
         double smoothedPhaseAccesses;
@@ -85,6 +85,7 @@ class MD1Memory : public MemObject {
             profLoad.init("load", "Sum of load factors (0-100) per update"); memStats->append(&profLoad);
             profUpdates.init("ups", "Number of latency updates"); memStats->append(&profUpdates);
             profClampedLoads.init("clampedLoads", "Number of updates where the load was clamped to 95%"); memStats->append(&profClampedLoads);
+            initExtraStats(memStats);
             parentStat->append(memStats);
         }
 
@@ -93,8 +94,58 @@ class MD1Memory : public MemObject {
 
         const char* getName() {return name.c_str();}
 
+        //Checkpoints hold the load estimate, so the latency does not start from zero-load
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
+
+    protected:
+        virtual void initExtraStats(AggregateStat* memStats) {}
+
     private:
         void updateLatency();
 };
 
+
+/* MD1 controller (one channel) that also tracks the open row of each bank, as
+ * an open-page policy would leave it, and adds closed-form DRAM timing to the
+ * queueing latency: nothing on a row hit, activation (tRCD) if the bank is
+ * closed, and precharge plus activation (tRP + tRCD) on a row conflict. The
+ * base latency is thus that of a row hit. Everything happens in the bound
+ * phase, so it costs little more than MD1Memory but captures row locality.
+ *
+ * Line addresses (after channel interleaving) map as row:rank:bank:col, so
+ * consecutive lines share a row.
+ */
+class RowMD1Memory : public MD1Memory {
+    private:
+        uint64_t* openRows; //one per bank (ranks*banksPerRank), CLOSED_ROW if closed
+        uint32_t numBanks;
+        uint32_t colBits;
+        uint32_t bankBits;
+        uint32_t actLatency;
+        uint32_t preLatency;
+
+        Counter profRowHits;
+        Counter profRowMisses;
+        Counter profRowConflicts;
+
+        static const uint64_t CLOSED_ROW = -1uL;
+
+    public:
+        RowMD1Memory(uint32_t lineSize, uint32_t megacyclesPerSecond, uint32_t megabytesPerSecond, uint32_t _rowHitLatency,
+                uint32_t ranks, uint32_t banksPerRank, uint32_t pageSize, uint32_t _actLatency, uint32_t _preLatency, g_string& _name);
+
+        uint64_t access(MemReq& req);
+
+        void saveState(CheckpointWriter& cw);
+        void restoreState(CheckpointReader& cr);
+
+    protected:
+        void initExtraStats(AggregateStat* memStats) {
+            profRowHits.init("rowHits", "Accesses to the open row"); memStats->append(&profRowHits);
+            profRowMisses.init("rowMisses", "Accesses to a closed bank"); memStats->append(&profRowMisses);
+            profRowConflicts.init("rowConflicts", "Accesses to a bank with a different open row"); memStats->append(&profRowConflicts);
+        }
+};
+
 #endif  // MEM_CTRLS_H_
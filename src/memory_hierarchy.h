@@ -89,7 +89,7 @@ struct MemReq {
     //Requester id --- used for contention simulation
     uint32_t srcId;
 
-    //Flags propagate across levels, though not to evictions
+    //Flags propagate across levels, though not to evictions (except WARMUP, see below)
     //Some other things that can be indicated here: Demand vs prefetch accesses, TLB accesses, etc.
     enum Flag {
         IFETCH        = (1<<1), //For instruction fetches. Purely informative for now, does not imply NOEXCL (but ifetches should be marked NOEXCL)
@@ -97,6 +97,7 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        WARMUP        = (1<<6), //Functional warming access (sampled simulation). Updates tags and coherence state, but produces no timing records. Also set on the evictions it causes
     };
     uint32_t flags;
 
@@ -112,11 +113,14 @@ struct InvReq {
     bool* writeback;
     uint64_t cycle;
     uint32_t srcId;
+    uint32_t flags; //only MemReq::WARMUP, from the access that caused the invalidation
 };
 
 /** INTERFACES **/
 
 class AggregateStat;
+class CheckpointReader;
+class CheckpointWriter;
 class Network;
 
 /* Base class for all memory objects (caches and memories) */
@@ -126,6 +130,10 @@ class MemObject : public GlobAlloc {
         virtual uint64_t access(MemReq& req) = 0;
         virtual void initStats(AggregateStat* parentStat) {}
         virtual const char* getName() = 0;
+
+        //Checkpointing of functional state (see checkpoint.h); objects without such state need not override these
+        virtual void saveState(CheckpointWriter& cw) {}
+        virtual void restoreState(CheckpointReader& cr) {}
 };
 
 /* Base class for all cache objects */
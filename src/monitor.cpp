@@ -23,6 +23,7 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sstream>
 #include "partitioner.h"
 
 // UMon
@@ -133,3 +134,84 @@ void UMonMonitor::reset() {
     }
     missCacheValid = false;
 }
+
+// SHARDS
+
+ShardsMonitor::ShardsMonitor(uint32_t _numLines, uint32_t _curveScale, uint32_t _sampleBits, uint32_t _numPartitions, uint32_t _buckets)
+        : PartitionMonitor(_buckets)
+        , curveScale(_curveScale)
+        , missCacheValid(false)
+        , monitors(_numPartitions, nullptr) {
+    assert(_numPartitions > 0);
+    assert(curveScale > 0);
+
+    curveBuf = gm_calloc<uint64_t>(curveScale*buckets + 1);
+    missCache = gm_calloc<uint32_t>((buckets + 1) * _numPartitions);
+
+    for (auto& monitor : monitors) {
+        monitor = new ShardsMon(curveScale*_numLines, _sampleBits, curveScale*buckets);
+    }
+}
+
+ShardsMonitor::~ShardsMonitor() {
+    for (auto monitor : monitors) {
+        delete monitor;
+    }
+    gm_free(curveBuf);
+    gm_free(missCache);
+    monitors.clear();
+}
+
+void ShardsMonitor::initStats(AggregateStat* parentStat) {
+    AggregateStat* monStat = new AggregateStat();
+    monStat->init("mon", "SHARDS partition monitor stats");
+    for (uint32_t p = 0; p < monitors.size(); p++) {
+        std::stringstream pss;
+        pss << "part-" << p;
+        AggregateStat* partStat = new AggregateStat();
+        partStat->init(gm_strdup(pss.str().c_str()), "Partition monitor stats");
+        monitors[p]->initStats(partStat);
+        monStat->append(partStat);
+    }
+    parentStat->append(monStat);
+}
+
+void ShardsMonitor::access(uint32_t partition, Address lineAddr) {
+    assert(partition < monitors.size());
+    monitors[partition]->access(lineAddr);
+    missCacheValid = false;
+}
+
+uint32_t ShardsMonitor::getNumAccesses(uint32_t partition) const {
+    assert(partition < monitors.size());
+    return monitors[partition]->getNumAccesses();
+}
+
+uint32_t ShardsMonitor::get(uint32_t partition, uint32_t bucket) const {
+    assert(partition < monitors.size());
+    assert(bucket <= buckets);
+
+    if (!missCacheValid) {
+        getMissCurves();
+        missCacheValid = true;
+    }
+
+    return missCache[partition*(buckets+1) + bucket];
+}
+
+void ShardsMonitor::getMissCurves() const {
+    for (uint32_t partition = 0; partition < getNumPartitions(); partition++) {
+        // Curve bins are already bucket-sized, so the partitioner's curve is just its prefix
+        monitors[partition]->getMisses(curveBuf);
+        for (uint32_t b = 0; b <= buckets; b++) {
+            missCache[partition*(buckets+1) + b] = curveBuf[b];
+        }
+    }
+}
+
+void ShardsMonitor::reset() {
+    for (auto monitor : monitors) {
+        monitor->startNextInterval();
+    }
+    missCacheValid = false;
+}
@@ -52,10 +52,14 @@
 
 #define L1D_LAT 4  // fixed, and FilterCache does not include L1 delay
 #define FETCH_BYTES_PER_CYCLE 16
-#define ISSUES_PER_CYCLE 4
-#define RF_READS_PER_CYCLE 3
-
-OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
+OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, BranchPredictor* _branchPred, const OOOCoreParams& params, g_string& _name)
+    : Core(_name), l1i(_l1i), l1d(_l1d),
+      loadQueue(params.loadQueueSize, params.commitWidth), storeQueue(params.storeQueueSize, params.commitWidth),
+      insWindow(1024, params.windowSize), rob(params.robSize, params.commitWidth),
+      issueWidth(params.issueWidth), rfReadsPerCycle(params.rfReadsPerCycle),
+      branchPred(_branchPred), uopQueue(params.uopQueueSize), fwdMask(params.fwdEntries - 1), cRec(0, _name)
+{
+    assert(params.fwdEntries && isPow2(params.fwdEntries));
     decodeCycle = DECODE_STAGE;  // allow subtracting from it
     curCycle = 0;
     phaseEndCycle = zinfo->phaseLength;
@@ -73,7 +77,8 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
 
     instrs = uops = bbls = approxInstrs = mispredBranches = condBranches = 0;
 
-    for (uint32_t i = 0; i < FWD_ENTRIES; i++) fwdArray[i].set((Address)(-1L), 0);
+    fwdArray = gm_calloc<FwdEntry>(params.fwdEntries);
+    for (uint32_t i = 0; i < params.fwdEntries; i++) fwdArray[i].set((Address)(-1L), 0);
 }
 
 void OOOCore::initStats(AggregateStat* parentStat) {
@@ -110,6 +115,8 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     coreStat->append(mispredBranchesStat);
     coreStat->append(condBranchesStat);
 
+    branchPred->initStats(coreStat);
+
 #ifdef OOO_STALL_STATS
     profFetchStalls.init("fetchStalls",  "Fetch stalls");  coreStat->append(&profFetchStalls);
     profDecodeStalls.init("decodeStalls", "Decode stalls"); coreStat->append(&profDecodeStalls);
@@ -200,7 +207,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         uopQueue.markLeave(curCycle);
 
         // Implement issue width limit --- we can only issue 4 uops/cycle
-        if (curCycleIssuedUops >= ISSUES_PER_CYCLE) {
+        if (curCycleIssuedUops >= issueWidth) {
 #ifdef OOO_STALL_STATS
             profIssueStalls.inc();
 #endif
@@ -221,8 +228,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         // RF read stalls
         // if srcs are not available at issue time, we have to go thru the RF
         curCycleRFReads += ((c0 < curCycle)? 1 : 0) + ((c1 < curCycle)? 1 : 0);
-        if (curCycleRFReads > RF_READS_PER_CYCLE) {
-            curCycleRFReads -= RF_READS_PER_CYCLE;
+        if (curCycleRFReads > rfReadsPerCycle) {
+            curCycleRFReads -= rfReadsPerCycle;
             curCycleIssuedUops = 0;  // or 1? that's probably a 2nd-order detail
             insWindow.advancePos(curCycle);
         }
@@ -276,7 +283,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     }
 
                     // Enforce st-ld forwarding
-                    uint32_t fwdIdx = (addr>>2) & (FWD_ENTRIES-1);
+                    uint32_t fwdIdx = (addr>>2) & fwdMask;
                     if (fwdArray[fwdIdx].addr == addr) {
                         // info("0x%lx FWD %ld %ld", addr, reqSatisfiedCycle, fwdArray[fwdIdx].storeCycle);
                         /* Take the MAX (see FilterCache's code) Our fwdArray
@@ -312,7 +319,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
 
                     // Fill the forwarding table
-                    fwdArray[(addr>>2) & (FWD_ENTRIES-1)].set(addr, reqSatisfiedCycle);
+                    fwdArray[(addr>>2) & fwdMask].set(addr, reqSatisfiedCycle);
 
                     commitCycle = reqSatisfiedCycle;
                     lastStoreCommitCycle = MAX(lastStoreCommitCycle, reqSatisfiedCycle);
@@ -378,7 +385,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 
     // Simulate branch prediction
     if (branchPc) condBranches++;
-    if (branchPc && !branchPred.predict(branchPc, branchTaken)) {
+    if (branchPc && !branchPred->predict(branchPc, branchTaken)) {
         mispredBranches++;
 
         /* Simulate wrong-path fetches
@@ -461,6 +468,10 @@ void OOOCore::leave() {
     cRec.notifyLeave(curCycle);
 }
 
+void OOOCore::warmDataAccess(Address addr, bool isWrite) {
+    l1d->warm(addr, !isWrite, curCycle);
+}
+
 void OOOCore::cSimStart() {
     uint64_t targetCycle = cRec.cSimStart(curCycle);
     assert(targetCycle >= curCycle);
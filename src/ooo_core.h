@@ -28,9 +28,13 @@
 
 #include <algorithm>
 #include <queue>
+#include <string.h>
 #include <string>
+#include "bithacks.h"
+#include "branch_pred.h"
 #include "core.h"
 #include "g_std/g_multimap.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 #include "ooo_core_recorder.h"
 #include "pad.h"
@@ -40,77 +44,6 @@
 
 class FilterCache;
 
-/* 2-level branch predictor:
- *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
- *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
- *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
- */
-template<uint32_t NB, uint32_t HB, uint32_t LB>
-class BranchPredictorPAg {
-    private:
-        uint32_t bhsr[1 << NB];
-        uint8_t pht[1 << LB];
-        bool useA2; // Ture: use A2, else use A3
-
-    public:
-        BranchPredictorPAg() {
-            useA2 = true;
-            uint32_t numBhsrs = 1 << NB;
-            uint32_t phtSize = 1 << LB;
-
-            for (uint32_t i = 0; i < numBhsrs; i++) {
-                bhsr[i] = 0;
-            }
-            for (uint32_t i = 0; i < phtSize; i++) {
-                pht[i] = 1;  // weak non-taken
-            }
-
-            static_assert(LB <= HB, "Too many PHT entries");
-            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
-        }
-
-        // Predicts and updates; returns false if mispredicted
-        inline bool predict(Address branchPc, bool taken) {
-            uint32_t bhsrMask = (1 << NB) - 1;
-            uint32_t histMask = (1 << HB) - 1;
-            uint32_t phtMask  = (1 << LB) - 1;
-
-            // Predict
-            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
-            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
-            uint32_t phtIdx = bhsr[bhsrIdx];
-
-            // Shift-XOR-mask to fit in PHT
-            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
-            phtIdx &= phtMask;
-
-            // If uncommented, behaves like a global history predictor
-            // bhsrIdx = 0;
-            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
-
-            bool pred = pht[phtIdx] > 1;
-
-            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
-
-            // Update
-            if (useA2) {
-                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
-            } else {
-                // Please implement Automaton 3 for update
-                pht[phtIdx] = taken? (pht[phtIdx]==0? 1 : 3) : (pht[phtIdx]==3? 2: 0);
-            }
-            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
-
-            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
-            return (taken == pred);
-        }
-
-        // Set to use Automaton 3
-        inline void useA3() {useA2 = false;}
-};
-
-
-template<uint32_t H, uint32_t WSZ>
 class WindowStructure {
     private:
         // NOTE: Nehalem has POPCNT, but we want this to run reasonably fast on Core2's, so let's keep track of both count and mask.
@@ -122,8 +55,20 @@ class WindowStructure {
 
         WinCycle* curWin;
         WinCycle* nextWin;
+
+        /* Cycles past nextWin go to a calendar of H-cycle buckets, aligned to
+         * absolute multiples of H, covering buckets [farLow, farLow+FAR_BUCKETS).
+         * Buckets are recycled through farFree, so once warmed up this never
+         * allocates. Cycles beyond the calendar (rare, needs delays of tens of
+         * thousands of cycles) overflow to ubWin, and are moved into the
+         * calendar as it advances.
+         */
+        static const uint32_t FAR_BUCKETS = 64;  // power of 2
+        WinCycle* farWin[FAR_BUCKETS];
+        uint64_t farLow;  // absolute index (cycle >> hBits) of the first bucket
+        g_vector<WinCycle*> farFree;
+
         typedef g_map<uint64_t, WinCycle> UBWin;
-        typedef typename UBWin::iterator UBWinIterator;
         UBWin ubWin;
         uint32_t occupancy;  // elements scheduled in the future
 
@@ -131,10 +76,17 @@ class WindowStructure {
 
         uint8_t lastPort;
 
+        const uint32_t H;  // horizon of curWin and nextWin, in cycles
+        const uint32_t hBits;
+        const uint32_t WSZ;  // window size, in uops
+
     public:
-        WindowStructure() {
+        WindowStructure(uint32_t horizon, uint32_t size) : H(horizon), hBits(ilog2(horizon)), WSZ(size) {
+            assert(isPow2(H));
             curWin = gm_calloc<WinCycle>(H);
             nextWin = gm_calloc<WinCycle>(H);
+            for (uint32_t i = 0; i < FAR_BUCKETS; i++) farWin[i] = nullptr;
+            farLow = 0;
             curPos = 0;
             occupancy = 0;
         }
@@ -168,19 +120,7 @@ class WindowStructure {
                 // info("[%ld] Rebasing, curCycle=%ld", curCycle/H, curCycle);
                 std::swap(curWin, nextWin);
                 curPos = 0;
-                uint64_t nextWinHorizon = curCycle + 2*H;  // first cycle out of range
-
-                if (!ubWin.empty()) {
-                    UBWinIterator it = ubWin.begin();
-                    while (it != ubWin.end() && it->first < nextWinHorizon) {
-                        uint32_t nextWinPos = it->first - H - curCycle;
-                        assert_msg(nextWinPos < H, "WindowStructure: ubWin elem exceeds limit cycle=%ld curCycle=%ld nextWinPos=%d", it->first, curCycle, nextWinPos);
-                        nextWin[nextWinPos] = it->second;
-                        // info("Moved %d events from unbounded window, cycle %ld (%d cycles away)", it->second, it->first, it->first - curCycle);
-                        it++;
-                    }
-                    ubWin.erase(ubWin.begin(), it);
-                }
+                refillNextWin(curCycle + H);
             }
         }
 
@@ -245,34 +185,90 @@ class WindowStructure {
                 }
                 if (nextWinPos >= H) {
                     schedCycle = curCycle + (nextWinPos + H - curPos);
-                    UBWinIterator it = ubWin.lower_bound(schedCycle);
                     while (true) {
-                        if (it == ubWin.end()) {
-                            WinCycle wc = {0, 0};
-                            bool success = trySchedule<touchOccupancy, recordPort>(wc, portMask);
-                            assert(success);
-                            ubWin.insert(std::pair<uint64_t, WinCycle>(schedCycle, wc));
-                        } else if (it->first != schedCycle) {
-                            WinCycle wc = {0, 0};
-                            bool success = trySchedule<touchOccupancy, recordPort>(wc, portMask);
-                            assert(success);
-                            ubWin.insert(it /*hint, makes insert faster*/, std::pair<uint64_t, WinCycle>(schedCycle, wc));
-                        } else {
-                            if (!trySchedule<touchOccupancy, recordPort>(it->second, portMask)) {
-                                // Try next cycle
-                                it++;
-                                schedCycle++;
-                                continue;
-                            }  // else scheduled correctly
+                        uint64_t bucket = schedCycle >> hBits;
+                        assert(bucket >= farLow);
+                        if (unlikely(bucket - farLow >= FAR_BUCKETS)) {
+                            scheduleUnbounded<touchOccupancy, recordPort>(schedCycle, portMask);
+                            break;
                         }
-                        break;
+                        WinCycle*& win = farWin[bucket & (FAR_BUCKETS-1)];
+                        if (unlikely(!win)) win = allocFarBucket();
+                        if (trySchedule<touchOccupancy, recordPort>(win[schedCycle & (H-1)], portMask)) break;
+                        schedCycle++;  // try next cycle
                     }
-                    // info("Scheduled event in unbounded window, cycle %ld", schedCycle);
+                    // info("Scheduled event in far window, cycle %ld", schedCycle);
                 }
             }
             if (touchOccupancy) occupancy++;
         }
 
+        template <bool touchOccupancy, bool recordPort>
+        void scheduleUnbounded(uint64_t& schedCycle, uint8_t portMask) {
+            typename UBWin::iterator it = ubWin.lower_bound(schedCycle);
+            while (true) {
+                if (it == ubWin.end() || it->first != schedCycle) {
+                    WinCycle wc = {0, 0};
+                    bool success = trySchedule<touchOccupancy, recordPort>(wc, portMask);
+                    assert(success);
+                    ubWin.insert(it /*hint, makes insert faster*/, std::pair<uint64_t, WinCycle>(schedCycle, wc));
+                } else if (!trySchedule<touchOccupancy, recordPort>(it->second, portMask)) {
+                    // Try next cycle
+                    it++;
+                    schedCycle++;
+                    continue;
+                }  // else scheduled correctly
+                break;
+            }
+        }
+
+        WinCycle* allocFarBucket() {
+            if (farFree.empty()) return gm_calloc<WinCycle>(H);
+            WinCycle* win = farFree.back();
+            farFree.pop_back();
+            return win;
+        }
+
+        void freeFarBucket(WinCycle*& win) {
+            memset(win, 0, H*sizeof(WinCycle));
+            farFree.push_back(win);
+            win = nullptr;
+        }
+
+        // Called on rebase: fills nextWin, which now covers [nextWinStart, nextWinStart+H), from the far window
+        void refillNextWin(uint64_t nextWinStart) {
+            uint64_t nextWinEnd = nextWinStart + H;  // first cycle out of range
+            uint64_t newFarLow = nextWinEnd >> hBits;
+
+            // Copy the (at most two) buckets nextWin overlaps, and recycle the ones we're done with. Buckets
+            // before nextWinStart are only left behind when longAdvance() skips cycles; they're in the past.
+            uint64_t lastBucket = std::min((nextWinEnd - 1) >> hBits, farLow + FAR_BUCKETS - 1);
+            for (uint64_t b = farLow; b <= lastBucket; b++) {
+                WinCycle*& win = farWin[b & (FAR_BUCKETS-1)];
+                if (!win) continue;
+                uint64_t start = std::max(b << hBits, nextWinStart);
+                uint64_t end = std::min((b + 1) << hBits, nextWinEnd);
+                if (start < end) {
+                    memcpy(&nextWin[start - nextWinStart], &win[start & (H-1)], (end - start)*sizeof(WinCycle));
+                }
+                if (b < newFarLow) freeFarBucket(win);
+            }
+            farLow = newFarLow;
+
+            // Pull overflowed cycles that are now within range
+            while (!ubWin.empty() && (ubWin.begin()->first >> hBits) < farLow + FAR_BUCKETS) {
+                uint64_t cycle = ubWin.begin()->first;
+                if (cycle >= nextWinEnd) {
+                    WinCycle*& win = farWin[(cycle >> hBits) & (FAR_BUCKETS-1)];
+                    if (!win) win = allocFarBucket();
+                    win[cycle & (H-1)] = ubWin.begin()->second;
+                } else if (cycle >= nextWinStart) {
+                    nextWin[cycle - nextWinStart] = ubWin.begin()->second;
+                }
+                ubWin.erase(ubWin.begin());
+            }
+        }
+
         template <bool touchOccupancy, bool recordPort>
         inline uint8_t trySchedule(WinCycle& wc, uint8_t portMask) {
             static_assert(!(recordPort && !touchOccupancy), "Can't have recordPort and !touchOccupancy");
@@ -298,16 +294,18 @@ class WindowStructure {
         }
 };
 
-template<uint32_t SZ, uint32_t W>
 class ReorderBuffer {
     private:
-        uint64_t buf[SZ];
+        uint64_t* buf;
         uint64_t curRetireCycle;
         uint32_t curCycleRetires;
         uint32_t idx;
+        const uint32_t SZ;  // entries
+        const uint32_t W;  // retires/cycle
 
     public:
-        ReorderBuffer() {
+        ReorderBuffer(uint32_t size, uint32_t width) : SZ(size), W(width) {
+            buf = gm_calloc<uint64_t>(SZ);
             for (uint32_t i = 0; i < SZ; i++) buf[i] = 0;
             idx = 0;
             curRetireCycle = 0;
@@ -343,14 +341,15 @@ class ReorderBuffer {
 };
 
 // Similar to ReorderBuffer, but must have in-order allocations and retires (--> faster)
-template<uint32_t SZ>
 class CycleQueue {
     private:
-        uint64_t buf[SZ];
+        uint64_t* buf;
         uint32_t idx;
+        const uint32_t SZ;
 
     public:
-        CycleQueue() {
+        explicit CycleQueue(uint32_t size) : SZ(size) {
+            buf = gm_calloc<uint64_t>(SZ);
             for (uint32_t i = 0; i < SZ; i++) buf[i] = 0;
             idx = 0;
         }
@@ -368,6 +367,27 @@ class CycleQueue {
 
 struct BblInfo;
 
+/* Microarchitectural parameters, set from the core group's config (see
+ * init.cpp). Defaults match the Westmere-like core this model was built for.
+ * These used to be template parameters; replaying bbl()'s dispatch loop with
+ * both versions shows runtime sizes cost nothing measurable, so there are no
+ * specializations for the default sizes.
+ */
+struct OOOCoreParams {
+    uint32_t robSize;
+    uint32_t commitWidth;  // retires/cycle from the ROB and load/store queues
+    uint32_t loadQueueSize;
+    uint32_t storeQueueSize;
+    uint32_t uopQueueSize;
+    uint32_t windowSize;  // instruction window (RS) entries
+    uint32_t issueWidth;
+    uint32_t rfReadsPerCycle;
+    uint32_t fwdEntries;  // store-load forwarding entries, power of 2
+
+    OOOCoreParams() : robSize(128), commitWidth(4), loadQueueSize(32), storeQueueSize(32), uopQueueSize(28),
+        windowSize(36), issueWidth(4), rfReadsPerCycle(3), fwdEntries(32) {}
+};
+
 class OOOCore : public Core {
     private:
         FilterCache* l1i;
@@ -394,18 +414,19 @@ class OOOCore : public Core {
         //buffers, but we split the associative component from the limited-size modeling.
         //NOTE: We do not model the 10-entry fill buffer here; the weave model should take care
         //to not overlap more than 10 misses.
-        ReorderBuffer<32, 4> loadQueue;
-        ReorderBuffer<32, 4> storeQueue;
+        ReorderBuffer loadQueue;
+        ReorderBuffer storeQueue;
 
         uint32_t curCycleRFReads; //for RF read stalls
         uint32_t curCycleIssuedUops; //for uop issue limits
 
-        //This would be something like the Atom... (but careful, the iw probably does not allow 2-wide when configured with 1 slot)
-        //WindowStructure<1024, 1 /*size*/, 2 /*width*/> insWindow; //this would be something like an Atom, except all the instruction pairing business...
+        //Sizes default to Nehalem's (see OOOCoreParams). An Atom would have a 1-entry, 2-wide window,
+        //except for all the instruction pairing business...
+        WindowStructure insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
+        ReorderBuffer rob;
 
-        //Nehalem
-        WindowStructure<1024, 36 /*size*/> insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
-        ReorderBuffer<128, 4> rob;
+        const uint32_t issueWidth;
+        const uint32_t rfReadsPerCycle;
 
         // Agner's guide says it's a 2-level pred and BHSR is 18 bits, so this is the config that makes sense;
         // in practice, this is probably closer to the Pentium M's branch predictor, (see Uzelac and Milenkovic,
@@ -413,7 +434,8 @@ class OOOCore : public Core {
         // where a few of the 2-level history bits are in the tag.
         // Since this is close enough, we'll leave it as is for now. Feel free to reverse-engineer the real thing...
         // UPDATE: Now pht index is XOR-folded BSHR. This has 6656 bytes total -- not negligible, but not ridiculous.
-        BranchPredictorPAg<11, 18, 14> branchPred;
+        // This is still the default (BranchPredictorPAg<11, 18, 14>), but the predictor is configurable (see branch_pred.h)
+        BranchPredictor* branchPred;
 
         Address branchPc;  //0 if last bbl was not a conditional branch
         bool branchTaken;
@@ -421,7 +443,7 @@ class OOOCore : public Core {
         Address branchNotTakenNpc;
 
         uint64_t decodeCycle;
-        CycleQueue<28> uopQueue;  // models issue queue
+        CycleQueue uopQueue;  // models issue queue
 
         uint64_t instrs, uops, bbls, approxInstrs, mispredBranches, condBranches;
 
@@ -431,20 +453,20 @@ class OOOCore : public Core {
 
         // Load-store forwarding
         // Just a direct-mapped array of last store cycles to 4B-wide blocks
-        // (i.e., indexed by (addr >> 2) & (FWD_ENTRIES-1))
+        // (i.e., indexed by (addr >> 2) & fwdMask)
         struct FwdEntry {
             Address addr;
             uint64_t storeCycle;
             void set(Address a, uint64_t c) {addr = a; storeCycle = c;}
         };
 
-        #define FWD_ENTRIES 32  // 2 lines, 16 4B entries/line
-        FwdEntry fwdArray[FWD_ENTRIES];
+        FwdEntry* fwdArray;  // defaults to 32 entries: 2 lines, 16 4B entries/line
+        const uint32_t fwdMask;
 
         OOOCoreRecorder cRec;
 
     public:
-        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name);
+        OOOCore(FilterCache* _l1i, FilterCache* _l1d, BranchPredictor* _branchPred, const OOOCoreParams& params, g_string& _name);
 
         void initStats(AggregateStat* parentStat);
 
@@ -457,6 +479,9 @@ class OOOCore : public Core {
         virtual void join();
         virtual void leave();
 
+        void warmDataAccess(Address addr, bool isWrite);
+        void warmBranch(Address branchPc, bool taken) {branchPred->warm(branchPc, taken);}
+
         InstrFuncPtrs GetFuncPtrs();
 
         // Contention simulation interface
@@ -464,9 +489,6 @@ class OOOCore : public Core {
         void cSimStart();
         void cSimEnd();
 
-        // Set Automaton 3 for branch predictor update
-        inline void useA3forBranchPred() {branchPred.useA3();}
-
     private:
         inline void load(Address addr);
         inline void store(Address addr);
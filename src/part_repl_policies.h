@@ -146,6 +146,7 @@ class WayPartReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
                 partsStat->append(partStat);
             }
             parentStat->append(partsStat);
+            monitor->initStats(parentStat);
         }
 
         void update(uint32_t id, const MemReq* req) {
@@ -216,6 +217,33 @@ class WayPartReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
             //info("0x%lx", incomingLineAddr);
         }
 
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "WayPart");
+            cw.write(timestamp);
+            cw.writeArray(array, totalSize);
+            cw.writeArray(wayPartIndex, ways);
+            cw.write(partitions);
+            for (uint32_t p = 0; p < partitions; p++) {
+                cw.write(partInfo[p].size);
+                cw.write(partInfo[p].targetSize);
+            }
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "WayPart");
+            timestamp = cr.read<uint64_t>();
+            cr.readArray(array, totalSize);
+            cr.readArray(wayPartIndex, ways);
+            uint32_t savedPartitions = cr.read<uint32_t>();
+            if (savedPartitions != partitions) panic("%s: checkpoint has %d partitions, policy has %d", cr.scope().c_str(), savedPartitions, partitions);
+            for (uint32_t p = 0; p < partitions; p++) {
+                partInfo[p].size = cr.read<uint64_t>();
+                partInfo[p].targetSize = cr.read<uint64_t>();
+            }
+            cr.endRecord();
+        }
+
     private:
         void setPartitionSizes(const uint32_t* waysPart) {
             uint32_t curWay = 0;
@@ -391,6 +419,7 @@ class VantageReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
                 rpStat->append(partStat);
             }
             parentStat->append(rpStat);
+            monitor->initStats(parentStat);
         }
 
         void update(uint32_t id, const MemReq* req) {
@@ -587,6 +616,53 @@ class VantageReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
             e->addr = incomingLineAddr;
         }
 
+        //Saves the per-line and per-partition (including the unmanaged region) state; VantagePartInfo also has counters, so we go field by field
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "Vantage");
+            cw.write(timestamp);
+            cw.writeArray(array, totalSize);
+            cw.write(partitions);
+            for (uint32_t p = 0; p <= partitions; p++) {
+                VantagePartInfo& pi = partInfo[p];
+                cw.write(pi.size);
+                cw.write(pi.targetSize);
+                cw.write(pi.longTermTargetSize);
+                cw.write(pi.extendedSize);
+                cw.write(pi.curBts);
+                cw.write(pi.curBtsHits);
+                cw.write(pi.setpointBts);
+                cw.write(pi.setpointAdjs);
+                cw.write(pi.curIntervalIns);
+                cw.write(pi.curIntervalDems);
+                cw.write(pi.curIntervalCands);
+            }
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "Vantage");
+            timestamp = cr.read<uint64_t>();
+            cr.readArray(array, totalSize);
+            uint32_t savedPartitions = cr.read<uint32_t>();
+            if (savedPartitions != partitions) panic("%s: checkpoint has %d partitions, policy has %d", cr.scope().c_str(), savedPartitions, partitions);
+            for (uint32_t p = 0; p <= partitions; p++) {
+                VantagePartInfo& pi = partInfo[p];
+                pi.size = cr.read<uint64_t>();
+                pi.targetSize = cr.read<uint64_t>();
+                pi.longTermTargetSize = cr.read<uint64_t>();
+                pi.extendedSize = cr.read<uint64_t>();
+                pi.curBts = cr.read<uint64_t>();
+                pi.curBtsHits = cr.read<uint32_t>();
+                pi.setpointBts = cr.read<uint64_t>();
+                pi.setpointAdjs = cr.read<uint64_t>();
+                pi.curIntervalIns = cr.read<uint32_t>();
+                pi.curIntervalDems = cr.read<uint32_t>();
+                pi.curIntervalCands = cr.read<uint32_t>();
+            }
+            lastUpdateCycle = zinfo->globPhaseCycles;
+            cr.endRecord();
+        }
+
     private:
         void setPartitionSizes(const uint32_t* sizes) {
             uint32_t s[partitions];
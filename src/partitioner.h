@@ -98,6 +98,8 @@ class PartitionMonitor : public GlobAlloc {
 
         uint32_t getBuckets() const { return buckets; }
 
+        virtual void initStats(AggregateStat* parentStat) {}
+
     protected:
         uint32_t buckets;
 };
@@ -124,4 +126,29 @@ class UMonMonitor : public PartitionMonitor {
         g_vector<UMon*> monitors;       // individual monitors per partition
 };
 
+// Per-partition miss curves from SHARDS-style sampled reuse distances (see ShardsMon).
+// The curves span curveScale times the bank's size, and the partitioner uses the first buckets points.
+class ShardsMonitor : public PartitionMonitor {
+    public:
+        ShardsMonitor(uint32_t _numLines, uint32_t _curveScale, uint32_t _sampleBits, uint32_t _numPartitions, uint32_t _buckets);
+        ~ShardsMonitor();
+
+        uint32_t getNumPartitions() const { return monitors.size(); }
+        void access(uint32_t partition, Address lineAddr);
+        uint32_t get(uint32_t partition, uint32_t bucket) const;
+        uint32_t getNumAccesses(uint32_t partition) const;
+        void reset();
+
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        void getMissCurves() const;
+
+        uint32_t curveScale;
+        mutable uint64_t* curveBuf;     // one full curve, curveScale*buckets+1 points
+        mutable uint32_t* missCache;    // buckets+1 points per partition
+        mutable bool missCacheValid;
+        g_vector<ShardsMon*> monitors;  // individual monitors per partition
+};
+
 #endif  // PARTITIONER_H_
@@ -0,0 +1,127 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Replays an event queue operation stream recorded with PQ_RECORD_STREAMS
+ * (see prio_queue.h) against PrioQueue, checking that every dequeue returns
+ * the recorded cycle, and reports the queue's throughput. Use it to evaluate
+ * queue changes on real weave-phase workloads without running zsim.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "log.h"
+#include "prio_queue.h"
+
+using namespace std;
+
+struct BenchEvent {
+    BenchEvent* next;
+    uint64_t privCycle;
+};
+
+//Same geometry as ContentionSim's domain queues
+typedef PrioQueue<BenchEvent, 1024> BenchQueue;
+
+static uint64_t getNs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000000ul + tv.tv_usec*1000ul;
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc < 2 || argc > 3) {
+        info("Replays a recorded event queue stream and reports its throughput");
+        info("Usage: %s <stream> [repetitions]", argv[0]);
+        exit(1);
+    }
+    uint32_t reps = (argc == 3)? atoi(argv[2]) : 10;
+
+    FILE* f = fopen(argv[1], "r");
+    if (!f) panic("Could not open %s", argv[1]);
+    vector<uint64_t> ops;
+    uint64_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, sizeof(uint64_t), 4096, f)) > 0) ops.insert(ops.end(), buf, buf + n);
+    fclose(f);
+
+    //Size the event pool to the maximum queue occupancy, so the replay loop does not allocate
+    uint64_t maxElems = 0, curElems = 0, numEnqs = 0;
+    for (uint64_t op : ops) {
+        if (op & PQ_RECORD_DEQUEUE_BIT) {
+            if (!curElems) panic("Malformed stream: dequeue from an empty queue");
+            curElems--;
+        } else {
+            curElems++;
+            numEnqs++;
+            maxElems = MAX(maxElems, curElems);
+        }
+    }
+    info("%ld ops (%ld enqueues), max %ld queued events", ops.size(), numEnqs, maxElems);
+
+    vector<BenchEvent> pool(maxElems);
+    uint64_t bestNs = -1L;
+    uint64_t farEnqs = 0, ovfEnqs = 0;
+    for (uint32_t r = 0; r < reps; r++) {
+        BenchQueue* pq = new BenchQueue();
+        BenchEvent* freeList = nullptr;
+        for (BenchEvent& ev : pool) {
+            ev.next = freeList;
+            freeList = &ev;
+        }
+
+        uint64_t startNs = getNs();
+        for (uint64_t op : ops) {
+            if (op & PQ_RECORD_DEQUEUE_BIT) {
+                uint64_t cycle;
+                BenchEvent* ev = pq->dequeue(cycle);
+                if (cycle != (op & ~PQ_RECORD_DEQUEUE_BIT)) {
+                    panic("Dequeued cycle %ld, recorded %ld", cycle, op & ~PQ_RECORD_DEQUEUE_BIT);
+                }
+                ev->next = freeList;
+                freeList = ev;
+            } else {
+                BenchEvent* ev = freeList;
+                freeList = ev->next;
+                ev->next = nullptr;
+                ev->privCycle = op;
+                pq->enqueue(ev, op);
+            }
+        }
+        bestNs = MIN(bestNs, getNs() - startNs);
+
+        farEnqs = pq->profFarEnqueues;
+        ovfEnqs = pq->profOverflowEnqueues;
+        delete pq;
+    }
+
+    info("Best of %d: %.3f ms, %.2f Mops/s", reps, bestNs/1e6, ops.size()*1e3/MAX(bestNs, 1ul));
+    info("Far enqueues: %ld (%.2f%%), overflow enqueues: %ld", farEnqs, farEnqs*100.0/MAX(numEnqs, 1ul), ovfEnqs);
+    return 0;
+}
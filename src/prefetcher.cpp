@@ -62,7 +62,9 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
 
     if (req.type != GETS) return parent->access(req); //other reqs ignored, including stores
 
-    profAccesses.inc();
+    //Functional warming (WARMUP) trains the streams and warms the prefetched lines, but is not profiled
+    bool warmup = req.is(MemReq::WARMUP);
+    if (!warmup) profAccesses.inc();
 
     uint64_t reqCycle = req.cycle;
     uint64_t respCycle = parent->access(req);
@@ -104,7 +106,7 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
         }
         DBG("%s: MISS alloc idx %d", name.c_str(), idx);
     } else {  // entry hit
-        profPageHits.inc();
+        if (!warmup) profPageHits.inc();
         Entry& e = array[idx];
         array[idx].ts = timestamp++;
         DBG("%s: PAGE HIT idx %d", name.c_str(), idx);
@@ -117,8 +119,8 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
             e.valid[pos] = false;  // close, will help with long-lived transactions
             respCycle = MAX(pfRespCycle, respCycle);
             e.lastCycle = MAX(respCycle, e.lastCycle);
-            profHits.inc();
-            if (shortPrefetch) profShortHits.inc();
+            if (!warmup) profHits.inc();
+            if (shortPrefetch && !warmup) profShortHits.inc();
             DBG("%s: pos %d prefetched on %ld, pf resp %ld, demand resp %ld, short %d", name.c_str(), pos, e.times[pos].startCycle, pfRespCycle, respCycle, shortPrefetch);
         }
 
@@ -138,11 +140,11 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
 
                 if (prefetchPos < 64 && !e.valid[prefetchPos]) {
                     MESIState state = I;
-                    MemReq pfReq = {req.lineAddr + prefetchPos - pos, GETS, req.childId, &state, reqCycle, req.childLock, state, req.srcId, MemReq::PREFETCH};
+                    MemReq pfReq = {req.lineAddr + prefetchPos - pos, GETS, req.childId, &state, reqCycle, req.childLock, state, req.srcId, MemReq::PREFETCH | (req.flags & MemReq::WARMUP)};
                     uint64_t pfRespCycle = parent->access(pfReq);  // FIXME, might segfault
                     e.valid[prefetchPos] = true;
                     e.times[prefetchPos].fill(reqCycle, pfRespCycle);
-                    profPrefetches.inc();
+                    if (!warmup) profPrefetches.inc();
 
                     if (shortPrefetch && fetchDepth < 8 && prefetchPos + stride < 64 && !e.valid[prefetchPos + stride]) {
                         prefetchPos += stride;
@@ -150,14 +152,16 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
                         pfRespCycle = parent->access(pfReq);
                         e.valid[prefetchPos] = true;
                         e.times[prefetchPos].fill(reqCycle, pfRespCycle);
-                        profPrefetches.inc();
-                        profDoublePrefetches.inc();
+                        if (!warmup) {
+                            profPrefetches.inc();
+                            profDoublePrefetches.inc();
+                        }
                     }
                     e.lastPrefetchPos = prefetchPos;
                     assert(state == I);  // prefetch access should not give us any permissions
                 }
             } else {
-                profLowConfAccs.inc();
+                if (!warmup) profLowConfAccs.inc();
             }
         } else {
             e.conf.dec();
@@ -168,7 +172,7 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
                 if (stride && stride != e.stride && stride == lastStride) {
                     e.conf.reset();
                     e.stride = stride;
-                    profStrideSwitches.inc();
+                    if (!warmup) profStrideSwitches.inc();
                 }
             }
             e.lastPrefetchPos = pos;
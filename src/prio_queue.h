@@ -26,10 +26,35 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
+#include <stdint.h>
+#include <stdio.h>
+#include "bithacks.h"
+#include "log.h"
 
+//Set to 1 to record the sequence of operations on each queue (see setRecordFile()), which pqbench can replay
+#define PQ_RECORD_STREAMS 0
+//#define PQ_RECORD_STREAMS 1
+
+//Recorded streams are sequences of uint64_t: enqueues are the cycle, dequeues the cycle with this bit set
+#define PQ_RECORD_DEQUEUE_BIT (1ul << 63)
+
+/* Calendar queue of intrusive elements. T must have a T* next pointer, and a
+ * uint64_t privCycle that holds the cycle the element is enqueued at (the
+ * caller sets it; we need it to move far elements to their final bucket).
+ *
+ * Near elements (less than B blocks of 64 cycles ahead) go in per-cycle
+ * buckets. Far elements go in a second-level wheel of B buckets, each covering
+ * H = B/2 blocks (a superblock); every H blocks, the superblock that enters
+ * the near window is moved to the per-cycle buckets. Elements beyond the
+ * second-level wheel (B*H*64 cycles ahead, rare) go in an unsorted overflow
+ * list that is redistributed as the wheel advances. All levels are
+ * singly-linked lists through next, so nothing is ever allocated.
+ */
 template <typename T, uint32_t B>
 class PrioQueue {
+    static_assert(B >= 2 && (B % 2) == 0, "PrioQueue needs an even number of blocks");
+    static const uint32_t H = B/2; //blocks per superblock
+
     struct PQBlock {
         T* array[64];
         uint64_t occ; // bit i is 1 if array[i] is populated
@@ -60,25 +85,60 @@ class PrioQueue {
         }
     };
 
+    struct FarBucket {
+        T* head;
+        uint64_t minCycle;
+    };
+
     PQBlock blocks[B];
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
+    //Superblock sb lives in farBuckets[sb % B] while curBlock/H + 2 <= sb <= curBlock/H + B + 1
+    FarBucket farBuckets[B];
+    uint64_t farElems; //in farBuckets
 
-    FEMap feMap;
+    T* overflow;
+    uint64_t overflowMin;
 
     uint64_t curBlock;
     uint64_t elems;
 
+#if PQ_RECORD_STREAMS
+    FILE* recordFile;
+#endif
+
     public:
+        //Stats, read through ProxyStats
+        uint64_t profFarEnqueues; //enqueues beyond the near window
+        uint64_t profOverflowEnqueues; //enqueues beyond the second-level wheel
+
         PrioQueue() {
+            for (uint32_t i = 0; i < B; i++) {
+                farBuckets[i].head = nullptr;
+                farBuckets[i].minCycle = -1L;
+            }
+            farElems = 0;
+            overflow = nullptr;
+            overflowMin = -1L;
             curBlock = 0;
             elems = 0;
+            profFarEnqueues = 0;
+            profOverflowEnqueues = 0;
+#if PQ_RECORD_STREAMS
+            recordFile = nullptr;
+#endif
         }
 
+#if PQ_RECORD_STREAMS
+        void setRecordFile(FILE* f) {recordFile = f;}
+#endif
+
         void enqueue(T* obj, uint64_t cycle) {
             uint64_t absBlock = cycle/64;
             assert(absBlock >= curBlock);
+            assert(obj->privCycle == cycle);
+#if PQ_RECORD_STREAMS
+            if (recordFile) fwrite(&cycle, sizeof(uint64_t), 1, recordFile);
+#endif
 
             if (absBlock < curBlock + B) {
                 uint32_t i = absBlock % B;
@@ -86,7 +146,8 @@ class PrioQueue {
                 blocks[i].enqueue(obj, offset);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                farEnqueue(obj, cycle);
+                profFarEnqueues++;
             }
             elems++;
         }
@@ -95,24 +156,7 @@ class PrioQueue {
             assert(elems);
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % H) == 0) advanceFar();
             }
 
             //We're now at the first populated block
@@ -121,6 +165,12 @@ class PrioQueue {
             elems--;
 
             deqCycle = curBlock*64 + offset;
+#if PQ_RECORD_STREAMS
+            if (recordFile) {
+                uint64_t rec = deqCycle | PQ_RECORD_DEQUEUE_BIT;
+                fwrite(&rec, sizeof(uint64_t), 1, recordFile);
+            }
+#endif
             return obj;
         }
 
@@ -130,25 +180,96 @@ class PrioQueue {
 
         inline uint64_t firstCycle() const {
             assert(elems);
-            for (uint32_t i = 0; i < B/2; i++) {
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
+            //Near blocks before the first far superblock come before any far element
+            uint64_t farStart = (curBlock/H + 2)*H;
+            for (uint64_t b = curBlock; b < farStart; b++) {
+                uint64_t occ = blocks[b % B].occ;
+                if (occ) return b*64 + __builtin_ctzl(occ);
+            }
+
+            //Beyond, a far element may come earlier
+            uint64_t res = -1L;
+            for (uint64_t b = farStart; b < curBlock + B; b++) {
+                uint64_t occ = blocks[b % B].occ;
                 if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    return (curBlock + i)*64 + pos;
+                    res = b*64 + __builtin_ctzl(occ);
+                    break;
                 }
             }
-            for (uint32_t i = B/2; i < B; i++) { //beyond B/2 blocks, there may be a far element that comes earlier
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
-                if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+            if (farElems) {
+                //Only the earliest non-empty superblock matters
+                uint64_t firstSb = curBlock/H + 2;
+                for (uint32_t i = 0; i < B; i++) {
+                    const FarBucket& fb = farBuckets[(firstSb + i) % B];
+                    if (fb.head) {
+                        res = MIN(res, fb.minCycle);
+                        break;
+                    }
                 }
             }
+            if (overflow) res = MIN(res, overflowMin);
+            assert(res != (uint64_t)-1L);
+            return res;
+        }
 
-            return feMap.begin()->first;
+    private:
+        inline void farEnqueue(T* obj, uint64_t cycle) {
+            uint64_t sb = cycle/64/H;
+            uint64_t curSb = curBlock/H;
+            assert(sb >= curSb + 2);
+            if (sb <= curSb + B + 1) {
+                FarBucket& fb = farBuckets[sb % B];
+                obj->next = fb.head;
+                fb.head = obj;
+                fb.minCycle = MIN(fb.minCycle, cycle);
+                farElems++;
+            } else {
+                obj->next = overflow;
+                overflow = obj;
+                overflowMin = MIN(overflowMin, cycle);
+                profOverflowEnqueues++;
+            }
+        }
+
+        //Called when curBlock enters a new superblock: the next superblock is now within the near window
+        void advanceFar() {
+            uint64_t curSb = curBlock/H;
+            FarBucket& fb = farBuckets[(curSb + 1) % B];
+            T* obj = fb.head;
+            while (obj) {
+                T* next = obj->next;
+                obj->next = nullptr;
+                uint64_t cycle = obj->privCycle;
+                uint64_t absBlock = cycle/64;
+                assert(absBlock/H == curSb + 1);
+                assert(absBlock >= curBlock && absBlock < curBlock + B);
+                blocks[absBlock % B].enqueue(obj, cycle % 64);
+                farElems--;
+                obj = next;
+            }
+            fb.head = nullptr;
+            fb.minCycle = -1L;
+
+            //The wheel now reaches one more superblock; pull overflow elements that fit
+            if (overflow && overflowMin/64/H <= curSb + B + 1) {
+                T* list = overflow;
+                overflow = nullptr;
+                overflowMin = -1L;
+                while (list) {
+                    T* next = list->next;
+                    list->next = nullptr;
+                    uint64_t cycle = list->privCycle;
+                    if (cycle/64/H <= curSb + B + 1) {
+                        farEnqueue(list, cycle);
+                    } else {
+                        list->next = overflow;
+                        overflow = list;
+                        overflowMin = MIN(overflowMin, cycle);
+                    }
+                    list = next;
+                }
+            }
         }
 };
 
 #endif  // PRIO_QUEUE_H_
-
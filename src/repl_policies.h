@@ -29,6 +29,7 @@
 #include <functional>
 #include "bithacks.h"
 #include "cache_arrays.h"
+#include "checkpoint.h"
 #include "coherence_ctrls.h"
 #include "memory_hierarchy.h"
 #include "mtrand.h"
@@ -54,6 +55,17 @@ class ReplPolicy : public GlobAlloc {
         virtual uint32_t rankCands(const MemReq* req, ZCands cands) = 0;
 
         virtual void initStats(AggregateStat* parent) {}
+
+        /* Checkpointing (see checkpoint.h). Policies that support it save
+         * their per-line state in a "repl" record; by default, we panic.
+         */
+        virtual void saveState(CheckpointWriter& cw) {
+            panic("%s: replacement policy does not support checkpoints", cw.scope().c_str());
+        }
+
+        virtual void restoreState(CheckpointReader& cr) {
+            panic("%s: replacement policy does not support checkpoints", cr.scope().c_str());
+        }
 };
 
 /* Add DECL_RANK_BINDINGS to each class that implements the new interface,
@@ -118,6 +130,20 @@ class LRUReplPolicy : public ReplPolicy {
             array[id] = 0;
         }
 
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "LRU");
+            cw.write(timestamp);
+            cw.writeArray(array, numLines);
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "LRU");
+            timestamp = cr.read<uint64_t>();
+            cr.readArray(array, numLines);
+            cr.endRecord();
+        }
+
         template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
             uint32_t bestCand = -1;
             uint64_t bestScore = (uint64_t)-1L;
@@ -249,6 +275,20 @@ class NRUReplPolicy : public LegacyReplPolicy {
             candIdx = 0;
             array[id] = 0;
         }
+
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "NRU");
+            cw.write(youngLines);
+            cw.writeArray(array, numLines);
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "NRU");
+            youngLines = cr.read<uint32_t>();
+            cr.readArray(array, numLines);
+            cr.endRecord();
+        }
 };
 
 class RandReplPolicy : public LegacyReplPolicy {
@@ -286,6 +326,17 @@ class RandReplPolicy : public LegacyReplPolicy {
         void replaced(uint32_t id) {
             candIdx = 0;
         }
+
+        //Stateless (besides the RNG, which we don't checkpoint)
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "Rand");
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "Rand");
+            cr.endRecord();
+        }
 };
 
 class LFUReplPolicy : public LegacyReplPolicy {
@@ -370,6 +421,20 @@ class LFUReplPolicy : public LegacyReplPolicy {
             bestRank.reset();
             array[id].acc = 0;
         }
+
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "LFU");
+            cw.write(timestamp);
+            cw.writeArray(array, numLines);
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "LFU");
+            timestamp = cr.read<uint64_t>();
+            cr.readArray(array, numLines);
+            cr.endRecord();
+        }
 };
 
 //Extends a given replacement policy to profile access ordering violations
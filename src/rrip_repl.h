@@ -1,20 +1,26 @@
 #ifndef RRIP_REPL_H_
 #define RRIP_REPL_H_
 
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "repl_policies.h"
 
 // Static RRIP
 class SRRIPReplPolicy : public ReplPolicy {
     protected:
         // add class member variables here
-        uint32_t *array;
+        // RRPVs are bytes so a whole set fits in one or two vector registers
+        uint8_t *array;
         uint32_t numLines;
-        uint64_t rpvMax;
+        uint8_t rpvMax;
 
     public:
         // add member methods here, refer to repl_policies.h
         SRRIPReplPolicy(uint32_t _numLines, uint32_t _rpvMax) : numLines(_numLines), rpvMax(_rpvMax) {
-            array = gm_calloc<uint32_t>(numLines);
+            assert(_rpvMax < 255);
+            array = gm_calloc<uint8_t>(numLines);
             for(uint32_t i = 0; i < numLines; i++) {
                 array[i] = rpvMax+1;
             }
@@ -32,22 +38,111 @@ class SRRIPReplPolicy : public ReplPolicy {
             array[id] = rpvMax+1;
         }
 
+        void saveState(CheckpointWriter& cw) {
+            cw.beginRecord("repl", "SRRIP");
+            cw.write(rpvMax);
+            cw.writeArray(array, numLines);
+            cw.endRecord();
+        }
+
+        void restoreState(CheckpointReader& cr) {
+            cr.beginRecord("repl", "SRRIP");
+            uint8_t savedRpvMax = cr.read<uint8_t>();
+            if (savedRpvMax != rpvMax) panic("%s: checkpoint has rpvMax %d, policy has %d", cr.scope().c_str(), savedRpvMax, rpvMax);
+            cr.readArray(array, numLines);
+            cr.endRecord();
+        }
+
+        /* Repeatedly aging the set until some line reaches rpvMax is the same as
+         * aging it once by (rpvMax - max RRPV), so we do that in closed form and
+         * then pick the first line at rpvMax.
+         */
         template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
-            while(true) {
-                for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
-                    if(array[*ci] >= rpvMax) {
-                        return *ci;
-                    }
-                }
+            uint8_t maxRpv = 0;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                maxRpv = MAX(maxRpv, array[*ci]);
+            }
+            if (maxRpv < rpvMax) {
+                uint8_t delta = rpvMax - maxRpv;
                 for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
-                    if(array[*ci] < rpvMax) {
-                        array[*ci]++;
-                    }
+                    array[*ci] += delta;
                 }
             }
-            return maxId;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                if (array[*ci] >= rpvMax) return *ci;
+            }
+            panic("SRRIP: no candidate at rpvMax after aging");
+        }
+
+        // Set-associative arrays keep a set's lines contiguous, so the same
+        // algorithm becomes a couple of vector reductions over array[b..e)
+        inline uint32_t rank(const MemReq* req, SetAssocCands cands) {
+            uint8_t* set = &array[cands.b];
+            uint32_t n = cands.numCands();
+            uint8_t maxRpv = vecMax(set, n);
+            if (maxRpv < rpvMax) vecAdd(set, n, rpvMax - maxRpv);
+            uint32_t first = vecFirstGE(set, n, rpvMax);
+            assert(first < n);
+            return cands.b + first;
         }
 
         DECL_RANK_BINDINGS;
+
+    private:
+        /* Byte-vector kernels. SSE2 is always there on x86-64 (and in our
+         * -march=core2 builds); AVX2 handles 32 ways at a time if enabled.
+         * Leftover ways (n not a multiple of 16) go through the scalar tail.
+         */
+        static inline uint8_t vecMax(const uint8_t* v, uint32_t n) {
+            uint32_t i = 0;
+#ifdef __AVX2__
+            __m256i m = _mm256_setzero_si256();
+            for (; i + 32 <= n; i += 32) m = _mm256_max_epu8(m, _mm256_loadu_si256((const __m256i*)&v[i]));
+            __m128i m16 = _mm_max_epu8(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+#else
+            __m128i m16 = _mm_setzero_si128();
+#endif
+            for (; i + 16 <= n; i += 16) m16 = _mm_max_epu8(m16, _mm_loadu_si128((const __m128i*)&v[i]));
+            m16 = _mm_max_epu8(m16, _mm_srli_si128(m16, 8));
+            m16 = _mm_max_epu8(m16, _mm_srli_si128(m16, 4));
+            m16 = _mm_max_epu8(m16, _mm_srli_si128(m16, 2));
+            m16 = _mm_max_epu8(m16, _mm_srli_si128(m16, 1));
+            uint8_t res = _mm_cvtsi128_si32(m16) & 0xff;
+            for (; i < n; i++) res = MAX(res, v[i]);
+            return res;
+        }
+
+        static inline void vecAdd(uint8_t* v, uint32_t n, uint8_t delta) {
+            uint32_t i = 0;
+            __m128i d = _mm_set1_epi8(delta);
+            for (; i + 16 <= n; i += 16) {
+                __m128i* p = (__m128i*)&v[i];
+                _mm_storeu_si128(p, _mm_adds_epu8(_mm_loadu_si128(p), d));
+            }
+            for (; i < n; i++) v[i] += delta;
+        }
+
+        // Index of the first element >= thr, or n if there is none
+        static inline uint32_t vecFirstGE(const uint8_t* v, uint32_t n, uint8_t thr) {
+            uint32_t i = 0;
+#ifdef __AVX2__
+            __m256i t32 = _mm256_set1_epi8(thr);
+            for (; i + 32 <= n; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i*)&v[i]);
+                uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(x, t32), x));
+                if (mask) return i + __builtin_ctz(mask);
+            }
+#endif
+            __m128i t = _mm_set1_epi8(thr);
+            for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i*)&v[i]);
+                uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, t), x));
+                if (mask) return i + __builtin_ctz(mask);
+            }
+            for (; i < n; i++) {
+                if (v[i] >= thr) return i;
+            }
+            return n;
+        }
 };
-#endif // RRIP_REPL_H_
\ No newline at end of file
+#endif // RRIP_REPL_H_
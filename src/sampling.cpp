@@ -0,0 +1,101 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sampling.h"
+#include <math.h>
+#include "process_stats.h"
+#include "zsim.h"
+
+SamplingStats::SamplingStats(AggregateStat* parentStat) {
+    uint32_t maxProcs = zinfo->lineSize; //same bound as ProcessStats
+    winStartInstrs.resize(maxProcs, 0);
+    winStartCycles.resize(maxProcs, 0);
+    inWindow.resize(maxProcs, false);
+    samples = totalInstrs = totalCycles = 0;
+    cpiSum = cpiSqSum = 0.0;
+
+    AggregateStat* samplingStat = new AggregateStat();
+    samplingStat->init("sampling", "Sampled simulation stats");
+
+    auto samplesStat = makeLambdaStat([this]() { return samples; });
+    samplesStat->init("samples", "Measurement windows completed");
+    auto instrsStat = makeLambdaStat([this]() { return totalInstrs; });
+    instrsStat->init("instrs", "Instructions in measurement windows");
+    auto cyclesStat = makeLambdaStat([this]() { return totalCycles; });
+    cyclesStat->init("cycles", "Cycles in measurement windows");
+    // Stats are integers, so report CPI in thousandths
+    auto cpiStat = makeLambdaStat([this]() { return (uint64_t)(1000.0*meanCPI() + 0.5); });
+    cpiStat->init("cpi", "Mean per-window CPI x1000");
+    auto ciStat = makeLambdaStat([this]() { return (uint64_t)(1000.0*confidenceInterval() + 0.5); });
+    ciStat->init("cpiCI95", "95% confidence interval half-width on mean CPI x1000");
+
+    samplingStat->append(samplesStat);
+    samplingStat->append(instrsStat);
+    samplingStat->append(cyclesStat);
+    samplingStat->append(cpiStat);
+    samplingStat->append(ciStat);
+    parentStat->append(samplingStat);
+}
+
+void SamplingStats::startWindow(uint32_t p) {
+    assert(p < inWindow.size());
+    winStartInstrs[p] = zinfo->processStats->getProcessInstrs(p);
+    winStartCycles[p] = zinfo->processStats->getProcessCycles(p);
+    inWindow[p] = true;
+}
+
+void SamplingStats::endWindow(uint32_t p) {
+    assert(p < inWindow.size());
+    if (!inWindow[p]) return; //detailed interval too short to open a window
+    inWindow[p] = false;
+    uint64_t instrs = zinfo->processStats->getProcessInstrs(p) - winStartInstrs[p];
+    uint64_t cycles = zinfo->processStats->getProcessCycles(p) - winStartCycles[p];
+    if (!instrs) return;
+
+    double cpi = ((double)cycles)/instrs;
+    samples++;
+    totalInstrs += instrs;
+    totalCycles += cycles;
+    cpiSum += cpi;
+    cpiSqSum += cpi*cpi;
+}
+
+double SamplingStats::meanCPI() const {
+    return samples? cpiSum/samples : 0.0;
+}
+
+double SamplingStats::confidenceInterval() const {
+    if (samples < 2) return 0.0;
+    // Two-sided 95% Student's t values for 1..30 degrees of freedom; normal approximation beyond
+    static const double tVals[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    uint64_t dof = samples - 1;
+    double t = (dof <= 30)? tVals[dof - 1] : 1.960;
+    double mean = meanCPI();
+    double var = (cpiSqSum - samples*mean*mean)/dof;
+    if (var < 0.0) var = 0.0; //rounding
+    return t*sqrt(var/samples);
+}
@@ -0,0 +1,63 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLING_H_
+#define SAMPLING_H_
+
+#include "galloc.h"
+#include "stats.h"
+
+/* Sampled (SMARTS-style) simulation statistics.
+ *
+ * In sampling mode, processes alternate between fast-forwarding with
+ * functional warming and short detailed intervals. Each detailed interval is
+ * split into a detailed warmup, which is not measured, and a measurement
+ * window. This class accumulates the per-window CPIs and reports their mean
+ * and a 95% confidence interval on it.
+ *
+ * startWindow/endWindow are called from adaptive events (i.e., at phase
+ * ends, serialized), so no locking is needed.
+ */
+class SamplingStats : public GlobAlloc {
+    private:
+        g_vector<uint64_t> winStartInstrs, winStartCycles; //per process
+        g_vector<bool> inWindow;
+
+        uint64_t samples;
+        uint64_t totalInstrs, totalCycles;
+        double cpiSum, cpiSqSum;
+
+    public:
+        explicit SamplingStats(AggregateStat* parentStat); //includes initStats
+
+        void startWindow(uint32_t p);
+        void endWindow(uint32_t p);
+
+    private:
+        double meanCPI() const;
+        double confidenceInterval() const; //95% CI half-width on meanCPI
+};
+
+#endif  // SAMPLING_H_
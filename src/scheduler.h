@@ -551,6 +551,9 @@ class Scheduler : public GlobAlloc, public Callee {
 
         uint32_t getScheduledPid(uint32_t cid) const { return (contexts[cid].state == USED)? getPid(contexts[cid].curThread->gid) : (uint32_t)-1; }
 
+        //Unlocked, so only a hint; used to pick cores to functionally warm during fast-forward
+        bool isContextFree(uint32_t cid) const { return contexts[cid].state != USED; }
+
     private:
         void schedule(ThreadInfo* th, ContextInfo* ctx) {
             assert(th->state == STARTED || th->state == BLOCKED || th->state == QUEUED);
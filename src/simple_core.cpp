@@ -85,6 +85,10 @@ void SimpleCore::join() {
     //info("[%s] Joined, curCycle %ld phaseEnd %ld haltedCycles %ld", name.c_str(), curCycle, phaseEndCycle, haltedCycles);
 }
 
+void SimpleCore::warmDataAccess(Address addr, bool isWrite) {
+    l1d->warm(addr, !isWrite, curCycle);
+}
+
 
 //Static class functions: Function pointers and trampolines
 
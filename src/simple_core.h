@@ -55,6 +55,8 @@ class SimpleCore : public Core {
         void contextSwitch(int32_t gid);
         virtual void join();
 
+        void warmDataAccess(Address addr, bool isWrite);
+
         InstrFuncPtrs GetFuncPtrs();
 
     protected:
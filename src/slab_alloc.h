@@ -33,6 +33,14 @@
  * are garbage-collected once all their events are done. To do this without space
  * overheads, slabs are carefully aligned, so that objects inside the slab can
  * derive the pointer of their slab.
+ *
+ * Because a single long-lived event pins its whole slab, freed elements of up
+ * to SLAB_POOL_MAX_BYTES are not returned to their slab, but to a free list per
+ * size class (i.e., per event type in practice), and reused in place by later
+ * allocations of the same size. Each element carries an 8-byte header with its
+ * size class. Frees may come from any weave thread and push onto a lock-free
+ * stack; the allocating thread (only one at a time per allocator) grabs the
+ * whole stack with a single exchange, so there's no ABA problem.
  */
 
 #include <deque>
@@ -45,6 +53,11 @@
 #define SLAB_SIZE (1<<16)  // 64KB; must be a power of two
 #define SLAB_MASK (~(SLAB_SIZE - 1))
 
+#define SLAB_ELEM_HEADER 8  // keeps elems 8-byte aligned
+#define SLAB_POOL_CLASSES 64  // 8-byte size classes
+#define SLAB_POOL_MAX_BYTES (8*SLAB_POOL_CLASSES)
+#define SLAB_NO_POOL ((uint32_t)-1)  // header value for elems returned to their slab
+
 // Uncomment to immediately scrub slabs (to 0) and freed elems (to -1).
 // This makes use-after-free errors obvious.
 //#define DEBUG_SLAB_ALLOC
@@ -91,6 +104,10 @@ struct Slab {  // POD type (no constructor)
     inline void freeElem();
 };
 
+struct FreeElem {
+    FreeElem* next;
+};
+
 class SlabAlloc {
     private:
         Slab* curSlab;
@@ -98,25 +115,77 @@ class SlabAlloc {
         uint32_t liveSlabs;
         mutex freeLock;  // used because slab frees may be concurrent
 
+        FreeElem* poolLocal[SLAB_POOL_CLASSES];  // only used by the allocating thread
+        FreeElem* volatile poolIncoming[SLAB_POOL_CLASSES];  // concurrent frees push here
+
+        // Stats (all bytes include headers)
+        uint64_t carvedBytes;  // total ever carved out of slabs
+        volatile uint64_t pooledFreeBytes;  // total ever freed to pools
+        uint64_t pooledReuseBytes;  // total ever reused from pools
+        uint64_t slabAllocs;
+        uint64_t poolAllocs;
+
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
+        SlabAlloc() : curSlab(nullptr), liveSlabs(0), carvedBytes(0), pooledFreeBytes(0), pooledReuseBytes(0), slabAllocs(0), poolAllocs(0) {
+            for (uint32_t c = 0; c < SLAB_POOL_CLASSES; c++) {
+                poolLocal[c] = nullptr;
+                poolIncoming[c] = nullptr;
+            }
             allocSlab();
         }
 
         void* alloc(size_t sz) {
-            assert(sz < SLAB_SIZE);
-            void* ptr = curSlab->alloc(sz);
+            assert(sz + SLAB_ELEM_HEADER < SLAB_SIZE);
+            sz = (sz + 7) & ~7uL;  // objs should already be a multiple of 8 bytes
+            uint32_t sizeClass = (sz <= SLAB_POOL_MAX_BYTES)? (sz >> 3) - 1 : SLAB_NO_POOL;
+
+            if (likely(sizeClass != SLAB_NO_POOL)) {
+                FreeElem* fe = poolLocal[sizeClass];
+                if (!fe && poolIncoming[sizeClass]) {
+                    fe = __sync_lock_test_and_set(&poolIncoming[sizeClass], nullptr);
+                }
+                if (fe) {
+                    poolLocal[sizeClass] = fe->next;
+                    poolAllocs++;
+                    pooledReuseBytes += sz + SLAB_ELEM_HEADER;
+                    return fe;
+                }
+            }
+
+            uint32_t bytes = sz + SLAB_ELEM_HEADER;
+            char* ptr = (char*)curSlab->alloc(bytes);
             if (unlikely(!ptr)) {
                 allocSlab();
-                ptr = curSlab->alloc(sz);
+                ptr = (char*)curSlab->alloc(bytes);
                 assert(ptr);
             }
-            assert((((uintptr_t)ptr) & SLAB_MASK) == (uintptr_t)curSlab)
-            return ptr;
+            assert((((uintptr_t)ptr) & SLAB_MASK) == (uintptr_t)curSlab);
+            *(uint32_t*)ptr = sizeClass;
+            slabAllocs++;
+            carvedBytes += bytes;
+            return ptr + SLAB_ELEM_HEADER;
         }
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
+        // Called on frees, from any thread
+        void poolFree(void* elem, uint32_t sizeClass) {
+            FreeElem* fe = (FreeElem*)elem;
+            FreeElem* head;
+            do {
+                head = poolIncoming[sizeClass];
+                fe->next = head;
+            } while (!__sync_bool_compare_and_swap(&poolIncoming[sizeClass], head, fe));
+            __sync_fetch_and_add(&pooledFreeBytes, (sizeClass + 1)*8 + SLAB_ELEM_HEADER);
+        }
+
+        // Stats
+        uint64_t getSlabBytes() const { return ((uint64_t)liveSlabs)*SLAB_SIZE; }
+        uint64_t getCarvedBytes() const { return carvedBytes; }
+        uint64_t getPooledBytes() const { return pooledFreeBytes - pooledReuseBytes; }  // freed elems awaiting reuse
+        uint64_t getSlabAllocs() const { return slabAllocs; }
+        uint64_t getPoolAllocs() const { return poolAllocs; }
+
     private:
         void allocSlab() {
             scoped_mutex sm(freeLock);
@@ -164,8 +233,15 @@ inline void freeElem(void* elem, size_t minSz) {
 #ifdef DEBUG_SLAB_ALLOC
     memset(elem, 0, minSz);
 #endif
-    Slab* s = (Slab*)(((uintptr_t)elem) & SLAB_MASK);
-    s->freeElem();
+    char* header = ((char*)elem) - SLAB_ELEM_HEADER;
+    Slab* s = (Slab*)(((uintptr_t)header) & SLAB_MASK);
+    uint32_t sizeClass = *(uint32_t*)header;
+    if (likely(sizeClass != SLAB_NO_POOL)) {
+        assert(sizeClass < SLAB_POOL_CLASSES);
+        s->allocator->poolFree(elem, sizeClass);  // pooled elems stay live in their slab
+    } else {
+        s->freeElem();
+    }
 }
 
 };  // namespace slab
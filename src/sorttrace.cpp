@@ -23,95 +23,496 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to sort a trace. It reads in the trace sequntially until it
- * has seen at least one access from every thread, then dumps the sorted trace
- * out. This may consume large amounts of memory if traces are largely
- * imbalanced. A simple way to fix this would be to dump N separate traces,
- * then join them together --- that's more I/O though.
+/* Sorts an access trace by request cycle, with an external merge sort, so
+ * traces much larger than memory can be sorted:
+ *  1. Run formation: the input is read sequentially into run buffers. While
+ *     the main thread fills one, all threads sort the previous one (with a
+ *     parallel bottom-up merge sort that uses an explicit scratch buffer) and
+ *     write it out as a run file. Two run buffers plus the scratch buffer fit
+ *     in the memory budget, so run size does not depend on the thread count.
+ *  2. Merge: runs are merged MAX_RUNS at a time, in as many passes as needed.
+ *     Each merge is split by cycle ranges into chunks, using a sparse index of
+ *     every run's cycles; threads merge chunks independently, and the main
+ *     thread writes them out in order, so merging and output (compression)
+ *     overlap.
+ * Runs are sorted stably and ties between runs go to the earlier run, so the
+ * per-child order of accesses with the same cycle is preserved.
  */
 
-#include <deque>
-#include <queue>
+#include <algorithm>
+#include <condition_variable>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "access_tracing.h"
+#include "bithacks.h"
 #include "galloc.h"
 
 using namespace std;
 
-void printProgress(uint64_t read, uint64_t written, uint64_t total) {
-    printf("Read %3ld%% / Written %3ld%%\r", read*100/total, written*100/total);
+#define MERGE_BLOCK_RECORDS (64*1024u)  // minimum merge chunk size
+#define MIN_READER_RECORDS 1024u
+#define MAX_RUNS 1000  // runs merged at once, stay below the usual fd limit
+#define SORT_BLOCK 32  // insertion-sorted before merging
+#define INDEX_STRIDE 512  // records per run index entry
+
+static double getTime() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+static void printProgress(const char* phase, uint64_t done, uint64_t total, double startTime) {
+    double elapsed = getTime() - startTime;
+    printf("%s %3ld%% (%.2f Mrec/s)\r", phase, total? done*100/total : 100, done/MAX(elapsed, 1e-6)/1e6);
     fflush(stdout);
 }
 
-int main(int argc, const char* argv[]) {
-    InitLog(""); //no log header
-    if (argc != 3) {
-        info("Sorts an access trace");
-        info("Usage: %s <input_trace> <output_trace>", argv[0]);
-        exit(1);
+static inline PackedAccessRecord pack(const AccessRecord& acc) {
+    PackedAccessRecord pr = {acc.lineAddr, acc.reqCycle, acc.latency, (uint16_t) acc.childId, (uint16_t) acc.type};
+    return pr;
+}
+
+static inline AccessRecord unpack(const PackedAccessRecord& pr) {
+    AccessRecord acc = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+    return acc;
+}
+
+static inline bool cycleLess(const PackedAccessRecord& a, const PackedAccessRecord& b) {
+    return a.reqCycle < b.reqCycle;
+}
+
+template <typename F> static void onThreads(uint32_t numThreads, F f) {
+    vector<thread> threads;
+    for (uint32_t t = 0; t < numThreads; t++) threads.emplace_back(f, t);
+    for (thread& th : threads) th.join();
+}
+
+/* Run files */
+
+// A sorted run, in a temporary file. Files are unlinked as soon as they are
+// created, so they go away even if we die; the fd keeps them alive.
+struct Run {
+    int fd;
+    uint64_t records;
+    vector<uint64_t> index;  // reqCycle of every INDEX_STRIDE-th record
+
+    Run(const string& tmpDir, uint32_t id) : records(0) {
+        char name[1024];
+        snprintf(name, sizeof(name), "%s/sorttrace-%d-run-%d.tmp", tmpDir.c_str(), getpid(), id);
+        fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) panic("Could not create run file %s", name);
+        unlink(name);
     }
 
-    gm_init(32<<20 /*32 MB --- should be enough*/);
+    ~Run() {close(fd);}
 
-    AccessTraceReader* tr = new AccessTraceReader(argv[1]);
-    uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
-
-    deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
-    for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
-    priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
-    uint64_t readRecords  = 0;
-    uint64_t writtenRecords  = 0;
-    uint64_t totalRecords  = tr->getNumRecords();
-    info("Sorting %ld records", totalRecords);
-
-    while (!tr->empty() || heads.size() > 0) {
-        if (!tr->empty() && heads.size() < numChildren) { //Read trace until all heads are filled
-            for (uint32_t i = 0; i < 1024; i++) { //For performance, read at least a few accesses
-                AccessRecord acc = tr->read();
-                readRecords++;
-                if ((readRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-                if (!accs[acc.childId]) {
-                    accs[acc.childId] = new deque<AccessRecord>();
-                    heads.push(make_pair(-acc.reqCycle, acc.childId));
-                }
-                accs[acc.childId]->push_back(acc);
-                if (tr->empty()) break;
+    void append(const PackedAccessRecord* recs, uint64_t n) {
+        for (uint64_t i = (INDEX_STRIDE - records % INDEX_STRIDE) % INDEX_STRIDE; i < n; i += INDEX_STRIDE) {
+            index.push_back(recs[i].reqCycle);
+        }
+        const char* p = (const char*) recs;
+        size_t left = n*sizeof(PackedAccessRecord);
+        while (left) {
+            ssize_t w = write(fd, p, left);
+            if (w <= 0) panic("Could not write run file");
+            p += w;
+            left -= w;
+        }
+        records += n;
+    }
+};
+
+/* Run formation */
+
+// Number of elements of a among the first k elements of the stable merge of a and b (ties go to a)
+static uint64_t coRank(const PackedAccessRecord* a, uint64_t na, const PackedAccessRecord* b, uint64_t nb, uint64_t k) {
+    uint64_t lo = (k > nb)? k - nb : 0;
+    uint64_t hi = MIN(k, na);
+    while (lo < hi) {
+        uint64_t i = (lo + hi)/2;
+        if (a[i].reqCycle <= b[k - i - 1].reqCycle) lo = i + 1;
+        else hi = i;
+    }
+    return lo;
+}
+
+// Merges adjacent sorted blocks of width records from src into dst. Threads
+// split the output evenly, so the last passes, with few long merges, still
+// use all of them.
+static void mergePass(const PackedAccessRecord* src, PackedAccessRecord* dst, uint64_t n, uint64_t width, uint32_t numThreads) {
+    onThreads(numThreads, [=](uint32_t t) {
+        uint64_t s = n*t/numThreads;
+        uint64_t e = n*(t + 1)/numThreads;
+        while (s < e) {
+            uint64_t lo = s/(2*width)*(2*width);
+            uint64_t mid = MIN(lo + width, n);
+            uint64_t hi = MIN(lo + 2*width, n);
+            uint64_t segEnd = MIN(e, hi);
+            const PackedAccessRecord* a = src + lo;
+            const PackedAccessRecord* b = src + mid;
+            uint64_t ia = coRank(a, mid - lo, b, hi - mid, s - lo);
+            uint64_t ja = coRank(a, mid - lo, b, hi - mid, segEnd - lo);
+            std::merge(a + ia, a + ja, b + (s - lo - ia), b + (segEnd - lo - ja), dst + s, cycleLess);
+            s = segEnd;
+        }
+    });
+}
+
+// Stable sort of buf using tmp (of the same size) as scratch space; returns whichever holds the sorted records
+static PackedAccessRecord* parallelSort(PackedAccessRecord* buf, PackedAccessRecord* tmp, uint64_t n, uint32_t numThreads) {
+    uint64_t numBlocks = (n + SORT_BLOCK - 1)/SORT_BLOCK;
+    onThreads(numThreads, [=](uint32_t t) {
+        for (uint64_t b = numBlocks*t/numThreads; b < numBlocks*(t + 1)/numThreads; b++) {
+            PackedAccessRecord* first = buf + b*SORT_BLOCK;
+            PackedAccessRecord* last = buf + MIN((b + 1)*SORT_BLOCK, n);
+            for (PackedAccessRecord* i = first + 1; i < last; i++) {
+                PackedAccessRecord x = *i;
+                PackedAccessRecord* j = i;
+                for (; j > first && x.reqCycle < (j - 1)->reqCycle; j--) *j = *(j - 1);
+                *j = x;
             }
         }
+    });
 
-        assert(heads.size() <= numChildren);
+    PackedAccessRecord* src = buf;
+    PackedAccessRecord* dst = tmp;
+    for (uint64_t width = SORT_BLOCK; width < n; width *= 2) {
+        mergePass(src, dst, n, width, numThreads);
+        swap(src, dst);
+    }
+    return src;
+}
 
-        while (heads.size() == numChildren || (tr->empty() && heads.size() > 0)) {
-            pair<int64_t, uint32_t> next = heads.top();
-            //info("pre %ld %d %ld", heads.size(), next.second, next.first);
-            heads.pop();
-            //info("post %ld %d %ld", heads.size(), heads.top().second, heads.top().first);
-            uint32_t child = next.second;
-            assert(!accs[child]->empty());
-            AccessRecord acc = accs[child]->front();
-            accs[child]->pop_front();
-            tw->write(acc);
-            writtenRecords++;
-            if ((writtenRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-            if (accs[child]->empty()) {
-                delete accs[child];
-                accs[child] = nullptr;
+static void sortAndWriteRun(vector<PackedAccessRecord>* buf, vector<PackedAccessRecord>* tmp, uint32_t numThreads, Run* run) {
+    assert(tmp->size() >= buf->size());
+    PackedAccessRecord* sorted = parallelSort(buf->data(), tmp->data(), buf->size(), numThreads);
+    run->append(sorted, buf->size());
+}
+
+/* Merge */
+
+// Reads the records of a run within a cycle range, through a buffer. The
+// run's index bounds the part of the file that must be read.
+class RunReader {
+    private:
+        const Run* run;
+        vector<PackedAccessRecord> buf;
+        uint32_t cur;
+        uint32_t max;
+        uint64_t pos;  // next record to read from the file
+        uint64_t end;
+        uint64_t lastCycle;
+
+    public:
+        RunReader(const Run* _run, uint32_t bufRecords) : run(_run), buf(bufRecords), cur(0), max(0), pos(0), end(0), lastCycle(0) {}
+
+        // Positions the reader on records with cycles in [firstCycle, _lastCycle]
+        void seek(uint64_t firstCycle, uint64_t _lastCycle) {
+            const vector<uint64_t>& idx = run->index;
+            uint64_t first = lower_bound(idx.begin(), idx.end(), firstCycle) - idx.begin();  // idx[first-1] < firstCycle
+            uint64_t last = upper_bound(idx.begin(), idx.end(), _lastCycle) - idx.begin();  // idx[last] > _lastCycle
+            pos = first? (first - 1)*INDEX_STRIDE : 0;
+            end = MIN(last*INDEX_STRIDE, run->records);
+            lastCycle = _lastCycle;
+            fill();
+            while (!empty() && head().reqCycle < firstCycle) pop();
+        }
+
+        inline bool empty() const {return cur == max || buf[cur].reqCycle > lastCycle;}
+        inline const PackedAccessRecord& head() const {return buf[cur];}
+
+        inline void pop() {
+            if (++cur == max) fill();
+        }
+
+    private:
+        void fill() {
+            cur = 0;
+            max = (pos < end)? MIN((uint64_t)buf.size(), end - pos) : 0;
+            char* p = (char*) buf.data();
+            size_t left = max*sizeof(PackedAccessRecord);
+            off_t offset = pos*sizeof(PackedAccessRecord);
+            while (left) {
+                ssize_t r = pread(run->fd, p, left, offset);
+                if (r <= 0) panic("Short read on run file");
+                p += r;
+                offset += r;
+                left -= r;
+            }
+            pos += max;
+        }
+};
+
+/* Tournament tree of losers: each internal node holds the run that lost the
+ * match played there, and node 0 the overall winner, so replacing the winner
+ * takes one match per level, without the swaps a binary heap would need.
+ */
+class LoserTree {
+    private:
+        vector<RunReader*>& runs;
+        vector<uint32_t> tree;
+        uint32_t k;
+
+        // True if run a goes before run b; exhausted runs go last
+        inline bool before(uint32_t a, uint32_t b) const {
+            if (runs[a]->empty()) return false;
+            if (runs[b]->empty()) return true;
+            uint64_t ca = runs[a]->head().reqCycle;
+            uint64_t cb = runs[b]->head().reqCycle;
+            return (ca < cb) || (ca == cb && a < b);
+        }
+
+        // Plays the subtree rooted at node (in the implicit tree of 2k nodes, leaves at k..2k-1), returns its winner
+        uint32_t build(uint32_t node) {
+            if (node >= k) return node - k;
+            uint32_t l = build(2*node);
+            uint32_t r = build(2*node + 1);
+            if (before(l, r)) {
+                tree[node] = r;
+                return l;
             } else {
-                AccessRecord acc = accs[child]->front();
-                heads.push(make_pair(-acc.reqCycle, acc.childId));
+                tree[node] = l;
+                return r;
+            }
+        }
+
+    public:
+        explicit LoserTree(vector<RunReader*>& _runs) : runs(_runs), tree(MAX(_runs.size(), (size_t)1)*2), k(_runs.size()) {
+            tree[0] = k? build(1) : 0;
+        }
+
+        inline bool empty() const {return k == 0 || runs[tree[0]]->empty();}
+        inline const PackedAccessRecord& top() const {return runs[tree[0]]->head();}
+
+        inline void pop() {
+            uint32_t winner = tree[0];
+            runs[winner]->pop();
+            for (uint32_t node = (winner + k)/2; node > 0; node /= 2) {
+                if (before(tree[node], winner)) swap(tree[node], winner);
+            }
+            tree[0] = winner;
+        }
+};
+
+// Last cycle of each chunk, so chunks have about chunkRecords records. Chunks
+// never split a cycle, so a cycle with more records than that makes a larger
+// chunk.
+static vector<uint64_t> splitCycles(const vector<Run*>& runs, uint64_t chunkRecords) {
+    vector<uint64_t> samples;
+    for (const Run* r : runs) samples.insert(samples.end(), r->index.begin(), r->index.end());
+    sort(samples.begin(), samples.end());
+    vector<uint64_t> chunkEnds;
+    uint64_t step = MAX(chunkRecords/INDEX_STRIDE, 1ul);
+    for (uint64_t i = step; i < samples.size(); i += step) {
+        if (chunkEnds.empty() || samples[i] > chunkEnds.back()) chunkEnds.push_back(samples[i]);
+    }
+    if (chunkEnds.empty() || chunkEnds.back() != (uint64_t)-1) chunkEnds.push_back((uint64_t)-1);
+    return chunkEnds;
+}
+
+typedef function<void (const vector<PackedAccessRecord>&)> ChunkSink;
+
+// Merges runs into sink. Each thread has its own readers and output buffer,
+// and merges every numThreads-th chunk; the calling thread passes completed
+// chunks to the sink in order. memRecords bounds the threads' buffers.
+static void mergeRuns(const vector<Run*>& runs, uint32_t numThreads, uint64_t memRecords, const ChunkSink& sink) {
+    uint64_t share = memRecords/numThreads;
+    uint64_t chunkRecords = MAX(share/2, (uint64_t)MERGE_BLOCK_RECORDS);
+    uint32_t readerRecords = MAX(share/2/MAX(runs.size(), (size_t)1), (uint64_t)MIN_READER_RECORDS);
+    vector<uint64_t> chunkEnds = splitCycles(runs, chunkRecords);
+    uint64_t numChunks = chunkEnds.size();
+    uint64_t totalRecords = 0;
+    for (const Run* r : runs) totalRecords += r->records;
+
+    struct Slot {
+        vector<PackedAccessRecord> recs;
+        bool full;
+    };
+    vector<Slot> slots(numThreads);
+    mutex m;
+    condition_variable cv;
+
+    vector<thread> mergers;
+    for (uint32_t t = 0; t < numThreads; t++) {
+        slots[t].full = false;
+        mergers.emplace_back([&, t]() {
+            vector<RunReader*> readers;
+            for (const Run* r : runs) readers.push_back(new RunReader(r, readerRecords));
+            Slot& slot = slots[t];
+            slot.recs.reserve(MIN(chunkRecords, totalRecords));
+            for (uint64_t c = t; c < numChunks; c += numThreads) {
+                {
+                    unique_lock<mutex> l(m);
+                    cv.wait(l, [&]() {return !slot.full;});
+                }
+                uint64_t firstCycle = c? chunkEnds[c-1] + 1 : 0;
+                for (RunReader* rd : readers) rd->seek(firstCycle, chunkEnds[c]);
+                slot.recs.clear();
+                LoserTree lt(readers);
+                while (!lt.empty()) {
+                    slot.recs.push_back(lt.top());
+                    lt.pop();
+                }
+                lock_guard<mutex> l(m);
+                slot.full = true;
+                cv.notify_all();
             }
+            for (RunReader* rd : readers) delete rd;
+        });
+    }
+
+    for (uint64_t c = 0; c < numChunks; c++) {
+        Slot& slot = slots[c % numThreads];
+        {
+            unique_lock<mutex> l(m);
+            cv.wait(l, [&]() {return slot.full;});
+        }
+        sink(slot.recs);
+        lock_guard<mutex> l(m);
+        slot.full = false;
+        cv.notify_all();
+    }
+    for (thread& th : mergers) th.join();
+}
+
+static void usage(const char* prog) {
+    info("Sorts an access trace");
+    info("Usage: %s [-m <memory MB>] [-t <threads>] [-d <temp dir>] <input_trace> <output_trace>", prog);
+    info("  -m: memory budget for run, sort and merge buffers (default 4096 MB)");
+    info("  -t: sorting and merging threads (default: number of cores)");
+    info("  -d: directory for temporary run files (default: the output's directory)");
+    info("Output traces ending in " ZTRACE_SUFFIX " use the compressed format");
+    exit(1);
+}
+
+int main(int argc, char* const argv[]) {
+    InitLog(""); //no log header
+
+    uint64_t memMB = 4096;
+    uint32_t numThreads = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1l);
+    string tmpDir;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:t:d:")) != -1) {
+        switch (opt) {
+            case 'm': memMB = strtoul(optarg, nullptr, 0); break;
+            case 't': numThreads = strtoul(optarg, nullptr, 0); break;
+            case 'd': tmpDir = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || !memMB || !numThreads) usage(argv[0]);
+    const char* inFile = argv[optind];
+    const char* outFile = argv[optind + 1];
+    if (tmpDir.empty()) {
+        string out(outFile);
+        size_t slash = out.rfind('/');
+        tmpDir = (slash == string::npos)? "." : out.substr(0, slash);
+    }
+
+    gm_init(64<<20 /*64 MB, for the writer's buffers*/);
+
+    AccessTraceReader* tr = new AccessTraceReader(inFile);
+    uint32_t numChildren = tr->getNumChildren();
+    uint64_t totalRecords = tr->getNumRecords();
+
+    // Two run buffers (one being filled, one being sorted) and the sort's scratch buffer share the budget
+    uint64_t memRecords = memMB*(1ul << 20)/sizeof(PackedAccessRecord);
+    uint64_t runRecords = MAX(memRecords/3, (uint64_t)MERGE_BLOCK_RECORDS);
+    uint64_t numRuns = (totalRecords + runRecords - 1)/runRecords;
+    info("Sorting %ld records: %ld runs of up to %ld records, %d threads, temp files in %s",
+            totalRecords, numRuns, runRecords, numThreads, tmpDir.c_str());
+
+    // 1. Run formation
+    double startTime = getTime();
+    vector<PackedAccessRecord> bufs[2];
+    vector<PackedAccessRecord> tmp(MIN(runRecords, totalRecords));
+    thread sorter;
+    vector<Run*> runs;
+    uint32_t nextRunId = 0;
+    uint64_t readRecords = 0;
+    while (!tr->empty()) {
+        // The other buffer may still be sorting; this one was written out before it started
+        vector<PackedAccessRecord>& buf = bufs[runs.size() % 2];
+        buf.clear();
+        buf.reserve(MIN(runRecords, totalRecords - readRecords));
+        while (!tr->empty() && buf.size() < runRecords) {
+            buf.push_back(pack(tr->read()));
+            if ((++readRecords % (1 << 20)) == 0) printProgress("Sorting runs:", readRecords, totalRecords, startTime);
         }
+
+        if (sorter.joinable()) sorter.join();
+        runs.push_back(new Run(tmpDir, nextRunId++));
+        sorter = thread(sortAndWriteRun, &buf, &tmp, numThreads, runs.back());
+    }
+    if (sorter.joinable()) sorter.join();
+    for (vector<PackedAccessRecord>& buf : bufs) {
+        buf.clear();
+        buf.shrink_to_fit();
     }
-    printProgress(readRecords, writtenRecords, totalRecords);
+    tmp.clear();
+    tmp.shrink_to_fit();
+    delete tr;
+    double runTime = getTime() - startTime;
+    printProgress("Sorting runs:", readRecords, totalRecords, startTime);
     printf("\n");
-    assert(readRecords == writtenRecords);
     assert(readRecords == totalRecords);
+    info("Sorted %ld runs in %.1f s (%.2f Mrec/s)", runs.size(), runTime, readRecords/MAX(runTime, 1e-6)/1e6);
 
-    delete tr;
+    // 2. Merge. Intermediate passes merge groups of MAX_RUNS consecutive runs
+    // (so ties still go to the earlier run) until one pass can merge them all.
+    startTime = getTime();
+    uint32_t pass = 0;
+    while (runs.size() > MAX_RUNS) {
+        vector<Run*> merged;
+        for (uint32_t g = 0; g < runs.size(); g += MAX_RUNS) {
+            vector<Run*> group(runs.begin() + g, runs.begin() + MIN(g + MAX_RUNS, (uint32_t)runs.size()));
+            if (group.size() == 1) {
+                merged.push_back(group[0]);
+                continue;
+            }
+            Run* out = new Run(tmpDir, nextRunId++);
+            mergeRuns(group, numThreads, memRecords, [out](const vector<PackedAccessRecord>& chunk) {
+                out->append(chunk.data(), chunk.size());
+            });
+            for (Run* r : group) delete r;
+            merged.push_back(out);
+        }
+        info("Merge pass %d: %ld runs -> %ld runs (%.1f s)", pass++, runs.size(), merged.size(), getTime() - startTime);
+        runs.swap(merged);
+    }
+
+    AccessTraceWriter* tw = new AccessTraceWriter(outFile, numChildren);
+    uint64_t writtenRecords = 0;
+    uint64_t lastCycle = 0;
+    mergeRuns(runs, numThreads, memRecords, [&](const vector<PackedAccessRecord>& chunk) {
+        for (const PackedAccessRecord& pr : chunk) {
+            assert(pr.reqCycle >= lastCycle);
+            lastCycle = pr.reqCycle;
+            AccessRecord acc = unpack(pr);
+            tw->write(acc);
+        }
+        writtenRecords += chunk.size();
+        printProgress("Merging:", writtenRecords, totalRecords, startTime);
+    });
     tw->dump(false); //flushes it
     delete tw;
+    double mergeTime = getTime() - startTime;
+    printProgress("Merging:", writtenRecords, totalRecords, startTime);
+    printf("\n");
+
+    for (Run* r : runs) delete r;
+
+    assert(writtenRecords == totalRecords);
+    info("Merged %ld records in %.1f s (%.2f Mrec/s); total %.1f s", writtenRecords, mergeTime,
+            writtenRecords/MAX(mergeTime, 1e-6)/1e6, runTime + mergeTime);
     return 0;
 }
-
@@ -288,6 +288,10 @@ class VectorCounter : public VectorStat {
             __sync_fetch_and_add(&_counters[idx], 1);
         }
 
+        inline void set(uint32_t idx, uint64_t data) {
+            _counters[idx] = data;
+        }
+
         inline virtual uint64_t count(uint32_t idx) const {
             return _counters[idx];
         }
@@ -410,7 +414,23 @@ class HDF5Backend : public StatsBackend {
         HDF5BackendImpl* backend;
 
     public:
-        HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates);
+        /* asyncBuffers > 1 makes dumps only copy stats into a ring of that many buffers of bytesPerWrite, which a
+         * writer thread flushes in the background (unbuffered dumps still drain the ring before returning).
+         * Must be constructed by the process that stays alive for the whole simulation (i.e., during SimInit).
+         */
+        HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates, uint32_t asyncBuffers = 1);
+        virtual void dump(bool buffered);
+};
+
+
+class ColumnarBackendImpl;
+
+class ColumnarBackend : public StatsBackend {
+    private:
+        ColumnarBackendImpl* backend;
+
+    public:
+        ColumnarBackend(const char* filename, AggregateStat* rootStat, size_t bytesPerBlock, bool skipVectors, bool sumRegularAggregates);
         virtual void dump(bool buffered);
 };
 
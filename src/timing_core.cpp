@@ -77,6 +77,10 @@ void TimingCore::leave() {
     cRec.notifyLeave(curCycle);
 }
 
+void TimingCore::warmDataAccess(Address addr, bool isWrite) {
+    l1d->warm(addr, !isWrite, curCycle);
+}
+
 void TimingCore::loadAndRecord(Address addr) {
     uint64_t startCycle = curCycle;
     curCycle = l1d->load(addr, curCycle);
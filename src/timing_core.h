@@ -58,6 +58,8 @@ class TimingCore : public Core {
         virtual void join();
         virtual void leave();
 
+        void warmDataAccess(Address addr, bool isWrite);
+
         InstrFuncPtrs GetFuncPtrs();
 
         //Contention simulation interface
@@ -282,6 +282,7 @@ class TimingEvent {
     friend class ContentionSim;
     friend class DelayEvent; //DelayEvent is, for now, the only child of TimingEvent that should do anything other than implement simulate
     friend class CrossingEvent;
+    template <typename T, uint32_t B> friend class PrioQueue; //reads privCycle to place far events
 };
 
 class DelayEvent : public TimingEvent {
@@ -23,17 +23,23 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sched.h>
 #include <sstream>
 #include "trace_driver.h"
+#include "bithacks.h"
+#include "pin.H"
 #include "zsim.h"
 
-TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
-    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
+TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads, TraceBlockRing* ring)
+    : tr(ring? nullptr : new AccessTraceReader(filename)), cursor(ring? ring->newCursor() : nullptr),
+      numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
 {
     assert(numChildren > 0);
     assert(!useSkews || numChildren == 1);
-    if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
+    uint32_t traceChildren = ring? ring->getNumChildren() : tr->getNumChildren();
+    if (traceChildren != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, traceChildren);
     children = new ChildInfo[numChildren];
+    for (uint32_t c = 0; c < numChildren; c++) futex_init(&children[c].lock);
     futex_init(&lock);
     lastAcc.childId = -1;
     parent = proxies[0]->getParent();
@@ -46,6 +52,26 @@ TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std:
     } else {
         atw = nullptr;
     }
+
+    //Can't replay a single child in parallel
+    numThreads = MIN(MAX(_numThreads, 1u), numChildren);
+    threads = nullptr;
+    if (numThreads > 1) {
+        info("Replaying trace with %d threads", numThreads);
+        threads = new ReplayThread[numThreads];
+        for (uint32_t i = 0; i < numThreads; i++) {
+            futex_init(&threads[i].wakeLock);
+            futex_lock(&threads[i].wakeLock); //starts locked, so first actual call to lock blocks
+        }
+        futex_init(&waitLock);
+        futex_lock(&waitLock);
+        threadsDone = 0;
+        threadTicket = 0;
+        __sync_synchronize();
+        for (uint32_t i = 0; i < numThreads; i++) {
+            PIN_SpawnInternalThread(ReplayThreadTrampoline, this, 1024*1024, nullptr);
+        }
+    }
 }
 
 void TraceDriver::initStats(AggregateStat* parentStat) {
@@ -76,33 +102,44 @@ void TraceDriver::setParent(MemObject* _parent) {
 
 uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
     assert(childId < numChildren);
+    bool parallel = numThreads > 1;
+    if (parallel) futex_lock(&children[childId].lock);
     std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
     std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
-    assert((it != cStore.end()));
+    assert((it != cStore.end()) && it->second != I);
     *reqWriteback = (it->second == M);
     if (type == INVX) {
         it->second = S;
         children[childId].profInvx.inc();
     } else {
-        cStore.erase(it);
+        //In parallel replay, the child's thread may have an access in flight on this line that points to its state,
+        //so keep the entry until the end of the phase
+        if (parallel) {
+            it->second = I;
+            children[childId].invLines.push_back(lineAddr);
+        } else {
+            cStore.erase(it);
+        }
         if (srcId == childId) {
             children[childId].profSelfInv.inc();
         } else {
             children[childId].profCrossInv.inc();
         }
     }
+    if (parallel) futex_unlock(&children[childId].lock);
     return 0;
 }
 
 //Returns false if done, true otherwise
 bool TraceDriver::executePhase() {
+    if (numThreads > 1) return executePhaseParallel();
     uint64_t limit = zinfo->globPhaseCycles + zinfo->phaseLength;
 
     //Load valid access
     AccessRecord acc;
     if (lastAcc.childId == (uint32_t)-1) {
-        if (tr.empty()) return false;
-        acc = tr.read();
+        if (traceEmpty()) return false;
+        acc = traceRead();
         if (useSkews) acc.reqCycle += children[acc.childId].skew;
     } else {
         acc = lastAcc;
@@ -112,8 +149,8 @@ bool TraceDriver::executePhase() {
     //Run until we reach the cycle limit or run out of phases
     while (acc.reqCycle < limit) {
         executeAccess(acc);
-        if (tr.empty()) return false;
-        acc = tr.read();
+        if (traceEmpty()) return false;
+        acc = traceRead();
         if (useSkews) acc.reqCycle += children[acc.childId].skew;
     }
 
@@ -121,9 +158,80 @@ bool TraceDriver::executePhase() {
     return true;
 }
 
+bool TraceDriver::executePhaseParallel() {
+    uint64_t limit = zinfo->globPhaseCycles + zinfo->phaseLength;
+    for (uint32_t i = 0; i < numThreads; i++) threads[i].accs.clear();
+
+    //Partition this phase's accesses among replay threads. No skews here (useSkews needs a single child)
+    AccessRecord acc;
+    if (lastAcc.childId == (uint32_t)-1) {
+        if (traceEmpty()) return false;
+        acc = traceRead();
+    } else {
+        acc = lastAcc;
+        lastAcc.childId = (uint32_t)-1;
+    }
+
+    bool more = true;
+    while (acc.reqCycle < limit) {
+        assert(acc.childId < numChildren);
+        threads[acc.childId % numThreads].accs.push_back(acc);
+        if (traceEmpty()) {
+            more = false;
+            break;
+        }
+        acc = traceRead();
+    }
+    if (more) lastAcc = acc; //save this access for the next phase
+
+    //Replay
+    __sync_synchronize();
+    for (uint32_t i = 0; i < numThreads; i++) futex_unlock(&threads[i].wakeLock);
+    futex_lock_nospin(&waitLock);
+
+    //No accesses are in flight now, so drop invalidated lines (unless re-fetched), keeping cStores as small as in serial replay
+    for (uint32_t c = 0; c < numChildren; c++) {
+        std::unordered_map<Address, MESIState>& cStore = children[c].cStore;
+        for (Address lineAddr : children[c].invLines) {
+            std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
+            if (it != cStore.end() && it->second == I) cStore.erase(it);
+        }
+        children[c].invLines.clear();
+    }
+    return more;
+}
+
+void TraceDriver::ReplayThreadTrampoline(void* arg) {
+    TraceDriver* drv = static_cast<TraceDriver*>(arg);
+    uint32_t thid = __sync_fetch_and_add(&drv->threadTicket, 1);
+    drv->replayThreadLoop(thid);
+}
+
+void TraceDriver::replayThreadLoop(uint32_t thid) {
+    info("Started trace replay thread %d", thid);
+    while (true) {
+        futex_lock_nospin(&threads[thid].wakeLock);
+
+        for (const AccessRecord& acc : threads[thid].accs) {
+            lock_t* childLock = &children[acc.childId].lock;
+            futex_lock(childLock);
+            executeAccess(acc);
+            futex_unlock(childLock);
+        }
+
+        uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
+        if (val == numThreads) {
+            threadsDone = 0;
+            futex_unlock(&waitLock); //unblock caller
+        }
+    }
+}
+
 void TraceDriver::executeAccess(AccessRecord acc) {
     assert(acc.childId < numChildren);
     std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
+    //In parallel replay we hold the child's lock, and parents must do hand-over-hand locking with it
+    lock_t* childLock = (numThreads > 1)? &children[acc.childId].lock : nullptr;
 
     int64_t lat = 0;
     switch (acc.type) {
@@ -132,8 +240,8 @@ void TraceDriver::executeAccess(AccessRecord acc) {
             {
                 if (!playPuts) return;
                 std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                if (it == cStore.end() || it->second == I) return; //we don't currently have this line, skip
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, childLock, it->second, acc.childId};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
                 assert(it->second == I);
                 cStore.erase(it);
@@ -142,28 +250,25 @@ void TraceDriver::executeAccess(AccessRecord acc) {
         case GETS:
         case GETX:
             {
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                MESIState state = I;
-                if (it != cStore.end()) {
-                    if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
+                //The request works on the child's entry (I if we don't have the line), so invalidations that race with it are seen by the parent
+                MESIState& state = cStore[acc.lineAddr];
+                if (state != I) {
+                    if (!((state == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            MemReq req = {acc.lineAddr, (state == M)? PUTX : PUTS, acc.childId, &state, acc.reqCycle, childLock, state, acc.childId};
                             parent->access(req);
-                            assert(it->second == I);
+                            assert(state == I);
                         } else {
                             return; //skip
                         }
-                    } else {
-                        state = it->second;
                     }
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, childLock, state, acc.childId};
                 uint64_t respCycle = parent->access(req);
                 lat = respCycle - acc.reqCycle;
                 children[acc.childId].profLat.inc(lat);
                 children[acc.childId].skew += ((int64_t)lat - acc.latency);
                 assert(state != I);
-                cStore[acc.lineAddr] = state;
             }
             break;
         default:
@@ -176,7 +281,132 @@ void TraceDriver::executeAccess(AccessRecord acc) {
         // We always want the outout trace to be skewed regardless... otherwise it does not make sense to produce an output trace
         if (!useSkews) wAcc.reqCycle += children[acc.childId].skew;
         wAcc.latency = lat;
+        if (childLock) futex_lock(&lock);
         atw->write(wAcc);
+        if (childLock) futex_unlock(&lock);
     }
 }
 
+
+
+/* TraceBlockRing */
+
+TraceBlockRing::TraceBlockRing(std::string filename, uint32_t _numSlots, uint32_t _blockRecords)
+    : tr(filename), numChildren(tr.getNumChildren()), numSlots(_numSlots), blockRecords(_blockRecords), produced(0), finished(false), started(false)
+{
+    if (numSlots < 2 || blockRecords == 0) panic("Trace ring needs at least 2 blocks of at least 1 record, got %d blocks of %d", numSlots, blockRecords);
+    recs = new AccessRecord[(uint64_t)numSlots*blockRecords];
+    slotRecords = new uint32_t[numSlots];
+}
+
+TraceRingCursor* TraceBlockRing::newCursor() {
+    assert(!started);
+    TraceRingCursor* c = new TraceRingCursor(this);
+    cursors.push_back(c);
+    return c;
+}
+
+void TraceBlockRing::start() {
+    assert(!started && cursors.size());
+    started = true;
+    __sync_synchronize();
+    PIN_SpawnInternalThread(DecoderThreadTrampoline, this, 1024*1024, nullptr);
+}
+
+void TraceBlockRing::DecoderThreadTrampoline(void* arg) {
+    static_cast<TraceBlockRing*>(arg)->decoderLoop();
+}
+
+void TraceBlockRing::decoderLoop() {
+    info("Started trace decoder thread (%d blocks of %d records)", numSlots, blockRecords);
+    while (!tr.empty()) {
+        uint64_t b = produced;
+        //Wait until every reader is done with the block that last used this slot
+        while (true) {
+            uint64_t minReleased = b;
+            for (TraceRingCursor* c : cursors) minReleased = MIN(minReleased, c->released);
+            if (b - minReleased < numSlots) break;
+            sched_yield();
+        }
+
+        uint32_t slot = b % numSlots;
+        AccessRecord* slotRecs = &recs[(uint64_t)slot*blockRecords];
+        uint32_t n = 0;
+        while (n < blockRecords && !tr.empty()) slotRecs[n++] = tr.read();
+        slotRecords[slot] = n;
+        __sync_synchronize(); //block contents must be visible before it's published
+        produced = b + 1;
+    }
+    __sync_synchronize();
+    finished = true;
+}
+
+bool TraceRingCursor::advance() {
+    released = nextBlock; //we never go back, so the decoder can reuse everything before nextBlock
+    while (ring->produced <= nextBlock) {
+        //finished is set after the last block is published, so produced is final if we see it
+        if (ring->finished && ring->produced <= nextBlock) return false;
+        sched_yield();
+    }
+    __sync_synchronize();
+    uint32_t slot = nextBlock % ring->numSlots;
+    cur = &ring->recs[(uint64_t)slot*ring->blockRecords];
+    end = cur + ring->slotRecords[slot];
+    nextBlock++;
+    return cur != end;
+}
+
+/* TraceSweep */
+
+TraceSweep::TraceSweep(TraceBlockRing* _ring, std::vector<TraceDriver*>& drivers) : ring(_ring), numVariants(drivers.size()) {
+    assert(numVariants > 1);
+    variants = new Variant[numVariants];
+    for (uint32_t v = 0; v < numVariants; v++) {
+        variants[v].drv = drivers[v];
+        variants[v].more = true;
+        futex_init(&variants[v].wakeLock);
+        futex_lock(&variants[v].wakeLock); //starts locked, so first actual call to lock blocks
+    }
+    futex_init(&waitLock);
+    futex_lock(&waitLock);
+    variantsDone = 0;
+    variantTicket = 1; //variant 0 runs on the caller's thread
+    __sync_synchronize();
+
+    ring->start();
+    for (uint32_t v = 1; v < numVariants; v++) {
+        PIN_SpawnInternalThread(VariantThreadTrampoline, this, 1024*1024, nullptr);
+    }
+}
+
+bool TraceSweep::executePhase() {
+    __sync_synchronize();
+    for (uint32_t v = 1; v < numVariants; v++) futex_unlock(&variants[v].wakeLock);
+    if (variants[0].more) variants[0].more = variants[0].drv->executePhase();
+    futex_lock_nospin(&waitLock);
+
+    bool more = false;
+    for (uint32_t v = 0; v < numVariants; v++) more |= variants[v].more;
+    return more;
+}
+
+void TraceSweep::VariantThreadTrampoline(void* arg) {
+    TraceSweep* sweep = static_cast<TraceSweep*>(arg);
+    uint32_t v = __sync_fetch_and_add(&sweep->variantTicket, 1);
+    sweep->variantThreadLoop(v);
+}
+
+void TraceSweep::variantThreadLoop(uint32_t v) {
+    info("Started sweep variant thread %d", v);
+    while (true) {
+        futex_lock_nospin(&variants[v].wakeLock);
+
+        if (variants[v].more) variants[v].more = variants[v].drv->executePhase();
+
+        uint32_t val = __sync_add_and_fetch(&variantsDone, 1);
+        if (val == numVariants - 1) {
+            variantsDone = 0;
+            futex_unlock(&waitLock); //unblock caller
+        }
+    }
+}
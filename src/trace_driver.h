@@ -34,7 +34,82 @@
 
 /* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it */
 
+/* Parallel replay: with numThreads > 1, each phase the driver reads the phase's
+ * records and partitions them by child among replay threads (child c goes to
+ * thread c % numThreads), which then replay their streams concurrently, in
+ * trace order, and synchronize only at the end of the phase, as cores do in
+ * the bound phase. Each child is protected by its own lock, which is passed as
+ * the request's childLock so that parents do hand-over-hand locking as with
+ * regular caches. Each child's accesses are retraced in order and phases stay
+ * in order, but records from different children are interleaved arbitrarily
+ * within a phase, so retraced output must be re-sorted within each phase.
+ */
+
 class TraceDriverProxyCache;
+class TraceBlockRing;
+
+/* Sequential reader of a TraceBlockRing. Has the same empty()/read() interface
+ * as AccessTraceReader; empty() waits for the decoder if it is behind.
+ */
+class TraceRingCursor {
+    private:
+        TraceBlockRing* ring;
+        const AccessRecord* cur;
+        const AccessRecord* end;
+        uint64_t nextBlock;
+        volatile uint64_t released; //blocks this reader is done with; the decoder may overwrite them
+
+        friend class TraceBlockRing;
+
+    public:
+        explicit TraceRingCursor(TraceBlockRing* _ring) : ring(_ring), cur(nullptr), end(nullptr), nextBlock(0), released(0) {}
+
+        inline bool empty() {
+            if (likely(cur != end)) return false;
+            return !advance();
+        }
+
+        inline AccessRecord read() {
+            assert(cur < end);
+            return *cur++;
+        }
+
+    private:
+        bool advance();
+};
+
+/* Decodes a trace once for several consumers (configuration sweeps). A decoder
+ * thread fills a bounded ring of blocks of records, and each consumer reads
+ * them in order through its own cursor. A slot is refilled once all cursors
+ * have moved past it, so the slowest consumer throttles the decoder.
+ */
+class TraceBlockRing {
+    private:
+        AccessTraceReader tr;
+        uint32_t numChildren;
+        uint32_t numSlots;
+        uint32_t blockRecords;
+        AccessRecord* recs; //numSlots*blockRecords
+        uint32_t* slotRecords; //valid records in each slot
+        volatile uint64_t produced; //blocks decoded so far; block b lives in slot b % numSlots
+        volatile bool finished; //no more blocks after produced
+        std::vector<TraceRingCursor*> cursors;
+        bool started;
+
+        friend class TraceRingCursor;
+
+    public:
+        TraceBlockRing(std::string filename, uint32_t _numSlots, uint32_t _blockRecords);
+        uint32_t getNumChildren() const {return numChildren;}
+
+        //All cursors must be created before start()
+        TraceRingCursor* newCursor();
+        void start();
+
+    private:
+        static void DecoderThreadTrampoline(void* arg);
+        void decoderLoop();
+};
 
 class TraceDriver {
     private:
@@ -48,12 +123,25 @@ class TraceDriver {
             Counter profSelfInv; //invalidations in response to our own access
             Counter profCrossInv; //invalidations in response to another access
             Counter profInvx;
+            lock_t lock; //held while replaying this child's accesses and by invalidations (parallel replay only)
+            std::vector<Address> invLines; //lines left in I by invalidations in parallel replay, erased at the end of the phase
+        };
+
+        struct ReplayThread {
+            std::vector<AccessRecord> accs; //this phase's accesses from this thread's children
+            lock_t wakeLock;
         };
 
         ChildInfo* children;
-        lock_t lock; //NOTE: not needed for now
-        AccessTraceReader tr;
+        lock_t lock; //serializes retrace writes in parallel replay
+        AccessTraceReader* tr; //exactly one of tr and cursor is non-null
+        TraceRingCursor* cursor; //reading from a shared TraceBlockRing (configuration sweeps)
         uint32_t numChildren;
+        uint32_t numThreads; //replay threads; 1 replays serially from the caller's thread
+        ReplayThread* threads;
+        lock_t waitLock;
+        volatile uint32_t threadsDone;
+        volatile uint32_t threadTicket;
         bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child.
         bool playPuts; //If true, issues PUTS/PUTX requests as they appear in the trace. If false, it just issues the GETS/X requests, leaving it up to the parent to decide when to evict something (NOTE: if the parent is running OPT, it knows better!)
         bool playAllGets; //If true, if we have a get to an address that we already have, issue a put immediately before.
@@ -65,7 +153,8 @@ class TraceDriver {
         AccessRecord lastAcc;
 
     public:
-        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets);
+        //If ring is given, the trace is read from it instead of from filename
+        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads = 1, TraceBlockRing* ring = nullptr);
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
 
@@ -75,7 +164,45 @@ class TraceDriver {
         bool executePhase();
 
     private:
+        inline bool traceEmpty() {return cursor? cursor->empty() : tr->empty();}
+        inline AccessRecord traceRead() {return cursor? cursor->read() : tr->read();}
+
         inline void executeAccess(AccessRecord acc);
+
+        bool executePhaseParallel();
+        static void ReplayThreadTrampoline(void* arg);
+        void replayThreadLoop(uint32_t thid);
+};
+
+
+/* Runs several trace drivers, each on its own hierarchy, over the same trace.
+ * Each phase, the first driver runs on the caller's thread and the rest on
+ * their own threads; the phase ends when all of them are done with it.
+ */
+class TraceSweep {
+    private:
+        struct Variant {
+            TraceDriver* drv;
+            bool more; //false once this driver has replayed the whole trace
+            lock_t wakeLock;
+        };
+
+        TraceBlockRing* ring;
+        Variant* variants;
+        uint32_t numVariants;
+        lock_t waitLock;
+        volatile uint32_t variantsDone;
+        volatile uint32_t variantTicket;
+
+    public:
+        TraceSweep(TraceBlockRing* _ring, std::vector<TraceDriver*>& drivers);
+
+        //Returns false if all drivers are done, true otherwise
+        bool executePhase();
+
+    private:
+        static void VariantThreadTrampoline(void* arg);
+        void variantThreadLoop(uint32_t v);
 };
 
 
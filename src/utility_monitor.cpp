@@ -24,6 +24,7 @@
  */
 
 #include "utility_monitor.h"
+#include "bithacks.h"
 #include "hash.h"
 
 #define DEBUG_UMON 0
@@ -142,3 +143,127 @@ curMisses = 0;
                 }
 }
 
+
+
+// ShardsMon
+
+ShardsMon::ShardsMon(uint32_t _maxLines, uint32_t _sampleBits, uint32_t _bins)
+    : maxLines(_maxLines), sampleBits(_sampleBits), bins(_bins)
+{
+    assert(bins > 0 && maxLines >= bins);
+    tracked = MAX(maxLines >> sampleBits, 1u);
+
+    //Compact when timestamps run out; twice the tracked lines amortizes compaction to O(1) per access
+    stampCap = 2*tracked;
+    stampBits = ilog2(stampCap);
+    stampAddrs = gm_calloc<Address>(stampCap);
+    stampLive = gm_calloc<bool>(stampCap);
+    tree = gm_calloc<uint32_t>(stampCap + 1);
+    curStamp = 0;
+    live = 0;
+
+    curHist = gm_calloc<uint64_t>(bins + 1);
+    curAccesses = 0;
+
+    hf = new H3HashFamily(1, 32, 0x5A4D5EED);
+}
+
+void ShardsMon::initStats(AggregateStat* parentStat) {
+    profAccesses.init("accs", "Sampled accesses"); parentStat->append(&profAccesses);
+    profMisses.init("misses", "Sampled misses (cold or beyond the curve)"); parentStat->append(&profMisses);
+    profHist.init("rdHist", "Sampled hits per reuse-distance bin (bin b = b/bins of the curve size)", bins); parentStat->append(&profHist);
+}
+
+void ShardsMon::access(Address lineAddr) {
+    uint64_t sampleMask = ~(((uint64_t)-1LL) << sampleBits);
+    if ((hf->hash(0, lineAddr) & sampleMask) != 0) return;
+
+    uint32_t bin = bins;  // miss
+    g_unordered_map<Address, uint32_t>::iterator it = lastStamp.find(lineAddr);
+    if (it != lastStamp.end()) {
+        uint32_t stamp = it->second;
+        uint32_t dist = live - treeCountBelow(stamp + 1);  // distinct sampled lines accessed since
+        uint64_t scaledDist = ((uint64_t)dist) << sampleBits;
+        if (scaledDist < maxLines) bin = scaledDist*bins/maxLines;
+        stampLive[stamp] = false;
+        treeAdd(stamp, -1);
+        live--;
+    } else if (live == tracked) {
+        // Drop the LRU line, it is beyond the curve
+        uint32_t oldest = treeFirstLive();
+        lastStamp.erase(stampAddrs[oldest]);
+        stampLive[oldest] = false;
+        treeAdd(oldest, -1);
+        live--;
+    }
+
+    if (curStamp == stampCap) compact();
+    stampAddrs[curStamp] = lineAddr;
+    stampLive[curStamp] = true;
+    treeAdd(curStamp, 1);
+    lastStamp[lineAddr] = curStamp;
+    curStamp++;
+    live++;
+
+    curAccesses++;
+    curHist[bin]++;
+    profAccesses.inc();
+    if (bin < bins) profHist.inc(bin);
+    else profMisses.inc();
+}
+
+void ShardsMon::getMisses(uint64_t* misses) const {
+    uint64_t total = curAccesses;
+    for (uint32_t b = 0; b < bins; b++) {
+        misses[b] = total;
+        total -= curHist[b];
+    }
+    misses[bins] = total;
+}
+
+void ShardsMon::startNextInterval() {
+    curAccesses = 0;
+    for (uint32_t b = 0; b <= bins; b++) curHist[b] = 0;
+}
+
+void ShardsMon::treeAdd(uint32_t stamp, int32_t val) {
+    for (uint32_t i = stamp + 1; i <= stampCap; i += i & -i) tree[i] += val;
+}
+
+uint32_t ShardsMon::treeCountBelow(uint32_t stamp) const {
+    uint32_t count = 0;
+    for (uint32_t i = stamp; i > 0; i -= i & -i) count += tree[i];
+    return count;
+}
+
+uint32_t ShardsMon::treeFirstLive() const {
+    // Descend the tree to the largest prefix with no live timestamps
+    assert(live > 0);
+    uint32_t pos = 0;
+    for (uint32_t step = 1 << stampBits; step; step >>= 1) {
+        if (pos + step <= stampCap && tree[pos + step] == 0) pos += step;
+    }
+    assert(pos < stampCap && stampLive[pos]);
+    return pos;
+}
+
+void ShardsMon::compact() {
+    // Renumber live timestamps to 0..live-1, preserving their order, and rebuild the tree
+    uint32_t next = 0;
+    for (uint32_t s = 0; s < curStamp; s++) {
+        if (!stampLive[s]) continue;
+        stampAddrs[next] = stampAddrs[s];
+        stampLive[s] = false;
+        stampLive[next] = true;
+        lastStamp[stampAddrs[next]] = next;
+        next++;
+    }
+    assert(next == live);
+    curStamp = next;
+
+    for (uint32_t i = 1; i <= stampCap; i++) tree[i] = (i <= curStamp)? 1 : 0;
+    for (uint32_t i = 1; i <= stampCap; i++) {
+        uint32_t parent = i + (i & -i);
+        if (parent <= stampCap) tree[parent] += tree[i];
+    }
+}
@@ -26,6 +26,7 @@
 #ifndef UTILITY_MONITOR_H_
 #define UTILITY_MONITOR_H_
 
+#include "g_std/g_unordered_map.h"
 #include "galloc.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
@@ -77,5 +78,62 @@ class UMon : public GlobAlloc {
         uint32_t getBuckets() const { return buckets; }
 };
 
+/* Miss curves from sampled reuse distances (SHARDS, Waldspurger et al., FAST 2015).
+ * Lines are sampled by hashing (1 in 2^sampleBits), and each sampled access
+ * measures its LRU stack distance among sampled lines, which scaled up by
+ * 2^sampleBits estimates its full stack distance. This gives the miss curve of
+ * every LRU cache size up to maxLines in bins bins, unlike UMon, whose curve is
+ * limited to its number of ways.
+ *
+ * Only the most recent maxLines/2^sampleBits sampled lines are tracked. Older
+ * ones would miss in every size covered by the curve anyway, so memory is
+ * bounded without losing accuracy. Distances are counted with a Fenwick tree
+ * over the timestamps of each tracked line's last access.
+ */
+class ShardsMon : public GlobAlloc {
+    private:
+        uint32_t maxLines;
+        uint32_t sampleBits;
+        uint32_t bins;
+        uint32_t tracked; //max sampled lines in the stack
+
+        g_unordered_map<Address, uint32_t> lastStamp; //tracked line -> timestamp of its last access
+        Address* stampAddrs; //line at each timestamp
+        bool* stampLive; //true if the timestamp is the last access of a tracked line
+        uint32_t* tree; //Fenwick tree (1-based) over stampLive
+        uint32_t stampCap; //timestamps before compaction
+        uint32_t stampBits; //ilog2 of the tree's highest power of two
+        uint32_t curStamp;
+        uint32_t live;
+
+        uint64_t* curHist; //bins+1 entries, the last one counts misses (cold or beyond maxLines)
+        uint64_t curAccesses;
+
+        Counter profAccesses;
+        Counter profMisses;
+        VectorCounter profHist;
+
+        HashFamily* hf;
+
+    public:
+        ShardsMon(uint32_t _maxLines, uint32_t _sampleBits, uint32_t _bins);
+        void initStats(AggregateStat* parentStat);
+
+        void access(Address lineAddr);
+
+        uint64_t getNumAccesses() const { return curAccesses; }
+        //Fills bins+1 elements: misses[b] = sampled misses with a cache of b*maxLines/bins lines
+        void getMisses(uint64_t* misses) const;
+        void startNextInterval();
+
+        uint32_t getBins() const { return bins; }
+
+    private:
+        void treeAdd(uint32_t stamp, int32_t val);
+        uint32_t treeCountBelow(uint32_t stamp) const; //live timestamps < stamp
+        uint32_t treeFirstLive() const;
+        void compact();
+};
+
 #endif  // UTILITY_MONITOR_H_
 
@@ -41,12 +41,14 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "access_tracing.h"
+#include "checkpoint.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
 #include "cpuenum.h"
 #include "cpuid.h"
 #include "debug_zsim.h"
+#include "decoder_cache.h"
 #include "event_queue.h"
 #include "galloc.h"
 #include "init.h"
@@ -55,6 +57,7 @@
 #include "pin_cmd.h"
 #include "process_tree.h"
 #include "profile_stats.h"
+#include "sampling.h"
 #include "scheduler.h"
 #include "stats.h"
 #include "trace_driver.h"
@@ -112,9 +115,14 @@ static uint32_t cids[MAX_THREADS];
 // Per TID core pointers (TODO: phase out cid/tid state --- this is enough)
 Core* cores[MAX_THREADS];
 
+// Core each thread last ran on (or INVALID_CID); sampling warms it during fast-forward, when cores[tid] is null
+static uint32_t warmCids[MAX_THREADS];
+
 static inline void clearCid(uint32_t tid) {
     assert(tid < MAX_THREADS);
     assert(cids[tid] != INVALID_CID);
+    uint32_t cid = cids[tid];
+    if (cores[tid]) warmCids[tid] = cid;
     cids[tid] = INVALID_CID;
     cores[tid] = nullptr;
 }
@@ -189,6 +197,99 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, ADDRINT addr,
     fPtrs[tid].predStorePtr(tid, addr, pred);
 }
 
+/* Batched memory ops (sim.batchMemOps)
+ *
+ * Instead of an indirect call per load/store, each memory op just appends its
+ * address to a per-thread buffer. These record functions have no calls or
+ * branches, so Pin inlines them. The buffer is replayed through fPtrs at the
+ * start of the next BBL (right before its bblPtr call), or before any
+ * out-of-band handler that talks to the core or the scheduler. This preserves
+ * the exact bbl/load/store order the cores see with per-op calls (e.g.,
+ * OOOCore already defers the previous BBL's loads and stores to bbl()).
+ * Branches are still recorded directly; cores only stash their outcome.
+ *
+ * Instrumentation bounds the number of ops recorded per BBL, inserting an
+ * extra flush if a BBL has more than MEMOP_BUF_ENTRIES. REP-prefixed
+ * instructions run their memory ops an unknown number of times, so they
+ * flush and use the per-op calls.
+ */
+
+#define MEMOP_BUF_ENTRIES 256
+
+enum MemOpKind {
+    MEMOP_LOAD = 0,
+    MEMOP_STORE = 1,
+    MEMOP_PRED_LOAD = 2,
+    MEMOP_PRED_STORE = 3,
+    MEMOP_PRED_TRUE = 4,  // or'd with MEMOP_PRED_* if the instruction executed
+};
+
+struct MemOpBuf {
+    uint32_t n;
+    uint8_t kinds[MEMOP_BUF_ENTRIES];
+    ADDRINT addrs[MEMOP_BUF_ENTRIES];
+} ATTR_LINE_ALIGNED;
+
+static MemOpBuf memOpBufs[MAX_THREADS];
+
+VOID PIN_FAST_ANALYSIS_CALL RecordLoad(THREADID tid, ADDRINT addr) {
+    MemOpBuf& b = memOpBufs[tid];
+    uint32_t n = b.n;
+    b.kinds[n] = MEMOP_LOAD;
+    b.addrs[n] = addr;
+    b.n = n + 1;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL RecordStore(THREADID tid, ADDRINT addr) {
+    MemOpBuf& b = memOpBufs[tid];
+    uint32_t n = b.n;
+    b.kinds[n] = MEMOP_STORE;
+    b.addrs[n] = addr;
+    b.n = n + 1;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL RecordPredLoad(THREADID tid, ADDRINT addr, BOOL pred) {
+    MemOpBuf& b = memOpBufs[tid];
+    uint32_t n = b.n;
+    b.kinds[n] = MEMOP_PRED_LOAD | ((pred != 0) << 2);
+    b.addrs[n] = addr;
+    b.n = n + 1;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL RecordPredStore(THREADID tid, ADDRINT addr, BOOL pred) {
+    MemOpBuf& b = memOpBufs[tid];
+    uint32_t n = b.n;
+    b.kinds[n] = MEMOP_PRED_STORE | ((pred != 0) << 2);
+    b.addrs[n] = addr;
+    b.n = n + 1;
+}
+
+// Cheap if the buffer is empty (always the case without batching), so out-of-band handlers call it unconditionally
+VOID PIN_FAST_ANALYSIS_CALL FlushMemOps(THREADID tid) {
+    MemOpBuf& b = memOpBufs[tid];
+    uint32_t n = b.n;
+    if (likely(n == 0)) return;
+    b.n = 0;
+    // NOTE: Re-read fPtrs on every op; the first one may join and switch pointers
+    for (uint32_t i = 0; i < n; i++) {
+        ADDRINT addr = b.addrs[i];
+        switch (b.kinds[i]) {
+            case MEMOP_LOAD: fPtrs[tid].loadPtr(tid, addr); break;
+            case MEMOP_STORE: fPtrs[tid].storePtr(tid, addr); break;
+            case MEMOP_PRED_LOAD: fPtrs[tid].predLoadPtr(tid, addr, false); break;
+            case MEMOP_PRED_STORE: fPtrs[tid].predStorePtr(tid, addr, false); break;
+            case MEMOP_PRED_LOAD | MEMOP_PRED_TRUE: fPtrs[tid].predLoadPtr(tid, addr, true); break;
+            case MEMOP_PRED_STORE | MEMOP_PRED_TRUE: fPtrs[tid].predStorePtr(tid, addr, true); break;
+            default: panic("Invalid memop kind %d", b.kinds[i]);
+        }
+    }
+}
+
+VOID PIN_FAST_ANALYSIS_CALL BatchedBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    FlushMemOps(tid);
+    fPtrs[tid].bblPtr(tid, bblAddr, bblInfo);
+}
+
 
 //Non-simulation variants of analysis functions
 
@@ -260,6 +361,14 @@ VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
  * installs the normal FFI handlers (pretty much like joins work).
  *
  * REQUIREMENTS: Single-threaded during FF (non-FF can be MT)
+ *
+ * Sampling (sim.sampling.*) reuses this machinery with an endless sequence of
+ * points instead of the process' ffiPoints: FF intervals of samplingFFInstrs
+ * alternate with detailed intervals of samplingWarmupInstrs +
+ * samplingDetailedInstrs. While in FF, memory accesses and branches
+ * functionally warm the thread's last core (see warmCids). In each detailed
+ * interval, a second event opens a measurement window once the detailed
+ * warmup is done, and the FF-entry event closes it.
  */
 
 //TODO (dsm): Went for quick, dirty and contained here. This could use a cleanup.
@@ -270,6 +379,7 @@ static uint32_t ffiPoint;
 static uint64_t ffiInstrsDone;
 static uint64_t ffiInstrsLimit;
 static bool ffiNFF;
+static bool ffiSampling;
 
 //Track the non-FF instructions executed at the beginning of this and last interval.
 //Can only be updated at ends of phase, by the NFF tracking event.
@@ -288,9 +398,14 @@ VOID FFITrackNFFInterval() {
     uint32_t p = procIdx;
     uint64_t* _ffiFFStartInstrs = ffiFFStartInstrs;
     uint64_t* _ffiPrevFFStartInstrs = ffiPrevFFStartInstrs;
+    bool sampling = ffiSampling;
     auto ffiGet = [p, startInstrs]() { return zinfo->processStats->getProcessInstrs(p) - startInstrs; };
-    auto ffiFire = [p, _ffiFFStartInstrs, _ffiPrevFFStartInstrs]() {
-        info("FFI: Entering fast-forward for process %d", p);
+    auto ffiFire = [p, _ffiFFStartInstrs, _ffiPrevFFStartInstrs, sampling]() {
+        if (sampling) {
+            zinfo->samplingStats->endWindow(p);
+        } else {
+            info("FFI: Entering fast-forward for process %d", p);
+        }
         /* Note this is sufficient due to the lack of reinstruments on FF, and this way we do not need to touch global state */
         futex_lock(&zinfo->ffLock);
         assert(!zinfo->procArray[p]->isInFastForward());
@@ -299,6 +414,10 @@ VOID FFITrackNFFInterval() {
         *_ffiPrevFFStartInstrs = *_ffiFFStartInstrs;
         *_ffiFFStartInstrs = zinfo->processStats->getProcessInstrs(p);
     };
+    if (sampling) {
+        auto winFire = [p]() { zinfo->samplingStats->startWindow(p); };
+        zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, winFire, 0, zinfo->samplingWarmupInstrs, MAX_IPC*zinfo->phaseLength));
+    }
     zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->phaseLength));
 
     ffiNFF = true;
@@ -307,20 +426,30 @@ VOID FFITrackNFFInterval() {
 // Called on process start
 VOID FFIInit() {
     const g_vector<uint64_t>& ffiPoints = procTreeNode->getFFIPoints();
-    if (!ffiPoints.empty()) {
+    if (!ffiPoints.empty() || zinfo->sampling) {
         if (zinfo->ffReinstrument) panic("FFI and reinstrumenting on FF switches are incompatible");
         ffiEnabled = true;
+        ffiSampling = ffiPoints.empty(); //explicit ffiPoints take precedence over sampling
         ffiPoint = 0;
         ffiInstrsDone = 0;
-        ffiInstrsLimit = ffiPoints[0];
+        if (ffiSampling) {
+            ffiInstrsLimit = procTreeNode->isInFastForward()? zinfo->samplingFFInstrs : zinfo->samplingWarmupInstrs + zinfo->samplingDetailedInstrs;
+        } else {
+            ffiInstrsLimit = ffiPoints[0];
+        }
 
         ffiFFStartInstrs = gm_calloc<uint64_t>(1);
         ffiPrevFFStartInstrs = gm_calloc<uint64_t>(1);
         ffiNFF = false;
-        info("FFI mode initialized, %ld ffiPoints", ffiPoints.size());
+        if (ffiSampling) {
+            info("FFI mode initialized, sampling");
+        } else {
+            info("FFI mode initialized, %ld ffiPoints", ffiPoints.size());
+        }
         if (!procTreeNode->isInFastForward()) FFITrackNFFInterval();
     } else {
         ffiEnabled = false;
+        ffiSampling = false;
     }
 }
 
@@ -328,6 +457,11 @@ VOID FFIInit() {
 VOID FFIAdvance() {
     const g_vector<uint64_t>& ffiPoints = procTreeNode->getFFIPoints();
     ffiPoint++;
+    if (ffiSampling) {
+        //Sampling never finishes by itself. ffiNFF is set iff we are moving from a detailed to a FF interval
+        ffiInstrsLimit += ffiNFF? zinfo->samplingFFInstrs : zinfo->samplingWarmupInstrs + zinfo->samplingDetailedInstrs;
+        return;
+    }
     if (ffiPoint >= ffiPoints.size()) {
         info("Last ffiPoint reached, %ld instrs, limit %ld", ffiInstrsDone, ffiInstrsLimit);
         SimEnd();
@@ -343,7 +477,7 @@ VOID FFIBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
         FFIAdvance();
         assert(procTreeNode->isInFastForward());
         futex_lock(&zinfo->ffLock);
-        info("FFI: Exiting fast-forward");
+        if (!ffiSampling) info("FFI: Exiting fast-forward");
         ExitFastForward();
         futex_unlock(&zinfo->ffLock);
         FFITrackNFFInterval();
@@ -362,6 +496,49 @@ VOID FFIEntryBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     FFIBasicBlock(tid, bblAddr, bblInfo);
 }
 
+// Sampling: functional warming of the thread's last core while in FF. Threads
+// that start in FF have not run yet, so they adopt a free core. A core running
+// another thread is never warmed: we skip warming until it is free again.
+static inline Core* GetWarmCore(THREADID tid) {
+    uint32_t cid = warmCids[tid];
+    if (unlikely(cid == INVALID_CID)) {
+        for (uint32_t i = 0; i < zinfo->numCores; i++) {
+            uint32_t c = (procIdx + i) % zinfo->numCores;
+            if (zinfo->sched->isContextFree(c)) {
+                warmCids[tid] = c;
+                return zinfo->cores[c];
+            }
+        }
+        return nullptr;
+    }
+    return zinfo->sched->isContextFree(cid)? zinfo->cores[cid] : nullptr;
+}
+
+VOID FFIWarmLoad(THREADID tid, ADDRINT addr) {
+    Core* core = GetWarmCore(tid);
+    if (core) core->warmDataAccess(addr, false);
+}
+
+VOID FFIWarmStore(THREADID tid, ADDRINT addr) {
+    Core* core = GetWarmCore(tid);
+    if (core) core->warmDataAccess(addr, true);
+}
+
+VOID FFIWarmBranch(THREADID tid, ADDRINT branchPc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
+    Core* core = GetWarmCore(tid);
+    if (core) core->warmBranch(branchPc, taken);
+}
+
+VOID FFIWarmPredLoad(THREADID tid, ADDRINT addr, BOOL pred) {
+    Core* core = pred? GetWarmCore(tid) : nullptr;
+    if (core) core->warmDataAccess(addr, false);
+}
+
+VOID FFIWarmPredStore(THREADID tid, ADDRINT addr, BOOL pred) {
+    Core* core = pred? GetWarmCore(tid) : nullptr;
+    if (core) core->warmDataAccess(addr, true);
+}
+
 // Non-analysis pointer vars
 static const InstrFuncPtrs joinPtrs = {JoinAndLoadSingle, JoinAndStoreSingle, JoinAndBasicBlock, JoinAndRecordBranch, JoinAndPredLoadSingle, JoinAndPredStoreSingle, FPTR_JOIN};
 static const InstrFuncPtrs nopPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
@@ -370,9 +547,10 @@ static const InstrFuncPtrs ffPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFB
 
 static const InstrFuncPtrs ffiPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 static const InstrFuncPtrs ffiEntryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs ffiWarmPtrs = {FFIWarmLoad, FFIWarmStore, FFIBasicBlock, FFIWarmBranch, FFIWarmPredLoad, FFIWarmPredStore, FPTR_NOP};
 
 static const InstrFuncPtrs& GetFFPtrs() {
-    return ffiEnabled? (ffiNFF? ffiEntryPtrs : ffiPtrs) : ffPtrs;
+    return ffiEnabled? (ffiNFF? ffiEntryPtrs : (ffiSampling? ffiWarmPtrs : ffiPtrs)) : ffPtrs;
 }
 
 //Fast-forwarding
@@ -490,6 +668,12 @@ VOID EndOfPhaseActions() {
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
+
+    // All simulated threads are blocked and weave is done for this phase, so the hierarchy is consistent
+    if (unlikely(zinfo->checkpointFile != nullptr) && (zinfo->checkpointPending || zinfo->numPhases + 1 == zinfo->checkpointPhase)) {
+        zinfo->checkpointPending = false;
+        SaveCheckpoint(zinfo->checkpointFile);
+    }
     zinfo->profSimTime->transition(PROF_BOUND);
 }
 
@@ -528,7 +712,8 @@ static void PrintIp(THREADID tid, ADDRINT ip) {
 }
 #endif
 
-VOID Instruction(INS ins) {
+// bblMemOps tracks how many ops this BBL has buffered so far in batched mode
+VOID Instruction(INS ins, uint32_t& bblMemOps) {
     //Uncomment to print an instruction trace
     //INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)PrintIp, IARG_THREAD_ID, IARG_REG_VALUE, REG_INST_PTR, IARG_END);
 
@@ -539,6 +724,23 @@ VOID Instruction(INS ins) {
         AFUNPTR PredLoadFuncPtr = (AFUNPTR) IndirectPredLoadSingle;
         AFUNPTR PredStoreFuncPtr = (AFUNPTR) IndirectPredStoreSingle;
 
+        if (zinfo->batchMemOps) {
+            uint32_t memOps = (INS_IsMemoryRead(ins)? 1 : 0) + (INS_HasMemoryRead2(ins)? 1 : 0) + (INS_IsMemoryWrite(ins)? 1 : 0);
+            bool rep = INS_RepPrefix(ins) || INS_RepnePrefix(ins);
+            if (memOps && (rep || bblMemOps + memOps > MEMOP_BUF_ENTRIES)) {
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) FlushMemOps, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+                bblMemOps = 0;
+            }
+
+            if (!rep) {
+                LoadFuncPtr = (AFUNPTR) RecordLoad;
+                StoreFuncPtr = (AFUNPTR) RecordStore;
+                PredLoadFuncPtr = (AFUNPTR) RecordPredLoad;
+                PredStoreFuncPtr = (AFUNPTR) RecordPredStore;
+                bblMemOps += memOps;
+            }
+        }
+
         if (INS_IsMemoryRead(ins)) {
             if (!INS_IsPredicated(ins)) {
                 INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_END);
@@ -601,15 +803,17 @@ VOID Trace(TRACE trace, VOID *v) {
         // Visit every basic block in the trace
         for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
             BblInfo* bblInfo = Decoder::decodeBbl(bbl, zinfo->oooDecode);
-            BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/, (AFUNPTR)IndirectBasicBlock, IARG_FAST_ANALYSIS_CALL,
+            AFUNPTR BblFuncPtr = zinfo->batchMemOps? (AFUNPTR) BatchedBasicBlock : (AFUNPTR) IndirectBasicBlock;
+            BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/, BblFuncPtr, IARG_FAST_ANALYSIS_CALL,
                  IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_END);
         }
     }
 
     //Instruction instrumentation now here to ensure proper ordering
     for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        uint32_t bblMemOps = 0;  // the BBL call flushes the batch buffer
         for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
-            Instruction(ins);
+            Instruction(ins, bblMemOps);
         }
     }
 }
@@ -743,6 +947,7 @@ VOID VdsoCallPoint(THREADID tid) {
 }
 
 VOID VdsoRetPoint(THREADID tid, REG* raxPtr) {
+    FlushMemOps(tid);  // virtualized time reads core cycles
     if (vdsoPatchData[tid].level == 0) {
         warn("vDSO return without matching call --- did we instrument all the functions?");
         return;
@@ -838,6 +1043,7 @@ void SimThreadStart(THREADID tid) {
     //Initialize this thread's process-local data
     fPtrs[tid] = joinPtrs; //delayed, MT-safe barrier join
     clearCid(tid); //just in case, set an invalid cid
+    warmCids[tid] = INVALID_CID; //tids are reused, don't warm a dead thread's core
 }
 
 VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v) {
@@ -875,6 +1081,7 @@ VOID SimThreadFini(THREADID tid) {
 
 VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
     //NOTE: Thread has no valid cid here!
+    memOpBufs[tid].n = 0; //exit syscall already flushed; don't leak ops to the next thread with this tid
     if (fPtrs[tid].type == FPTR_NOP) {
         info("Shadow/NOP thread %d finished", tid);
         return;
@@ -886,6 +1093,8 @@ VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
 
 //Need to remove ourselves from running threads in case the syscall is blocking
 VOID SyscallEnter(THREADID tid, CONTEXT *ctxt, SYSCALL_STANDARD std, VOID *v) {
+    FlushMemOps(tid);  // must reach the core before we leave
+
     bool isNopThread = fPtrs[tid].type == FPTR_NOP;
     bool isRetryThread = fPtrs[tid].type == FPTR_RETRY;
 
@@ -1062,6 +1271,7 @@ VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
     for (uint32_t i = 0; i < MAX_THREADS; i++) {
         fPtrs[i] = joinPtrs;
         cids[i] = UNINITIALIZED_CID;
+        warmCids[i] = INVALID_CID;
         activeThreads[i] = false;
         inSyscall[i] = false;
         cores[i] = nullptr;
@@ -1114,6 +1324,7 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        if (zinfo->bblCache) zinfo->bblCache->save();
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
@@ -1133,8 +1344,10 @@ VOID SimEnd() {
 #define ZSIM_MAGIC_OP_ROI_END           (1026)
 #define ZSIM_MAGIC_OP_REGISTER_THREAD   (1027)
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
+#define ZSIM_MAGIC_OP_CHECKPOINT        (1034)
 
 VOID HandleMagicOp(THREADID tid, ADDRINT op) {
+    FlushMemOps(tid);
     switch (op) {
         case ZSIM_MAGIC_OP_ROI_BEGIN:
             if (!zinfo->ignoreHooks) {
@@ -1190,6 +1403,14 @@ VOID HandleMagicOp(THREADID tid, ADDRINT op) {
         case ZSIM_MAGIC_OP_HEARTBEAT:
             procTreeNode->heartbeat(); //heartbeats are per process for now
             return;
+        case ZSIM_MAGIC_OP_CHECKPOINT:
+            //Deferred to the end of the phase, when the memory hierarchy is quiescent
+            if (zinfo->checkpointFile) {
+                zinfo->checkpointPending = true;
+            } else {
+                info("Thread %d: Ignoring CHECKPOINT magic op, sim.checkpoint.saveFile not set", tid);
+            }
+            return;
 
         // HACK: Ubik magic ops
         case 1029:
@@ -1263,6 +1484,7 @@ VOID FakeCPUIDPost(THREADID tid, ADDRINT* eax, ADDRINT* ebx, ADDRINT* ecx, ADDRI
 
 //RDTSC faking
 VOID FakeRDTSCPost(THREADID tid, REG* eax, REG* edx) {
+    FlushMemOps(tid);  // so that phase cycles include this BBL's accesses
     if (fPtrs[tid].type == FPTR_NOP) return; //avoid virtualizing NOP threads.
 
     uint32_t cid = getCid(tid);
@@ -1507,6 +1729,7 @@ int main(int argc, char *argv[]) {
     for (uint32_t i = 0; i < MAX_THREADS; i++) {
         fPtrs[i] = joinPtrs;
         cids[i] = UNINITIALIZED_CID;
+        warmCids[i] = INVALID_CID;
     }
 
     info("Started process, PID %d", getpid()); //NOTE: external scripts expect this line, please do not change without checking first
@@ -1554,7 +1777,8 @@ int main(int argc, char *argv[]) {
     // Start trace-driven or exec-driven sim
     if (zinfo->traceDriven) {
         info("Running trace-driven simulation");
-        while (!zinfo->terminationConditionMet && zinfo->traceDriver->executePhase()) {
+        auto executePhase = []() { return zinfo->traceSweep? zinfo->traceSweep->executePhase() : zinfo->traceDriver->executePhase(); };
+        while (!zinfo->terminationConditionMet && executePhase()) {
             // info("Phase done");
             EndOfPhaseActions();
             zinfo->numPhases++;
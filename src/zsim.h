@@ -40,14 +40,18 @@ class StatsBackend;
 class ProcessTreeNode;
 class ProcessStats;
 class ProcStats;
+class SamplingStats;
+class MemObject;
 class EventQueue;
 class ContentionSim;
 class EventRecorder;
+class DecodedBblCache;
 class PinCmd;
 class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class TraceSweep;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -86,7 +90,8 @@ struct GlobSimInfo {
     Scheduler* sched;
 
     //Contention simulation
-    uint32_t numDomains;
+    uint32_t numDomains; //for cores and caches
+    uint32_t numMemDomains; //dedicated to memory controllers, numbered after the core/cache domains (0: mems share them)
     ContentionSim* contentionSim;
     EventRecorder** eventRecorders; //CID->EventRecorder* array
 
@@ -108,6 +113,7 @@ struct GlobSimInfo {
     bool blockingSyscalls;
     bool perProcessCpuEnum; //if true, cpus are enumerated according to per-process masks (e.g., a 16-core mask in a 64-core sim sees 16 cores)
     bool oooDecode; //if true, Decoder does OOO (instr->uop) decoding
+    DecodedBblCache* bblCache; //persistent decoded BBLs, nullptr if disabled
 
     PAD();
 
@@ -167,7 +173,22 @@ struct GlobSimInfo {
 
     struct LibInfo libzsimAddrs;
 
+    //Sampled simulation (SMARTS-style): per process, alternate samplingFFInstrs of fast-forwarding with functional warming
+    //and samplingWarmupInstrs + samplingDetailedInstrs of detailed simulation, measuring only the last samplingDetailedInstrs
+    bool sampling;
+    uint64_t samplingFFInstrs;
+    uint64_t samplingWarmupInstrs;
+    uint64_t samplingDetailedInstrs;
+    SamplingStats* samplingStats;
+
+    //Checkpointing of memory-hierarchy state (see checkpoint.h)
+    g_vector<MemObject*>* checkpointObjs; //caches and memories, in construction order
+    const char* checkpointFile; //nullptr if not saving
+    uint64_t checkpointPhase; //save at the end of this phase (0: only on CHECKPOINT magic op)
+    volatile bool checkpointPending; //set by the magic op, serviced at the end of the phase
+
     bool ffReinstrument; //true if we should reinstrument on ffwd, works fine with ST apps and it's faster since we run with basically no instrumentation, but it's not precise with MT apps
+    bool batchMemOps; //if true, loads/stores are buffered per thread and handed to the core in one go at the next BBL boundary
 
     //fftoggle stuff
     lock_t ffToggleLocks[256]; //f*ing Pin and its f*ing inability to handle external signals...
@@ -181,6 +202,7 @@ struct GlobSimInfo {
     // Trace-driven simulation (no cores)
     bool traceDriven;
     TraceDriver* traceDriver;
+    TraceSweep* traceSweep; //non-null if sweeping several configurations over the trace (traceDriver is the first one)
 };
 
 